@@ -0,0 +1,132 @@
+#ifndef COMP3421_ASSET_LOADER_HPP
+#define COMP3421_ASSET_LOADER_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ass3/model.hpp"
+#include "ass3/texture_2d.hpp"
+#include "ass3/texture_cache.hpp"
+#include "ass3/texture_streamer.hpp"
+
+// Background asset loading. Worker threads parse models and decode images; the GL thread only
+// uploads finished data, through pixel buffer objects, within a per-frame byte budget. 2D textures
+// come block compressed from the texture cache where the context can sample them, and are
+// uploaded straight from the cache file's mapping, or handed to a texture streamer when there is
+// one.
+namespace asset_loader {
+	// a finished decode waiting for the GL thread
+	struct upload_t {
+		enum KIND {
+			TEXTURE_2D,
+			CUBEMAP_FACE,
+			MODEL,
+		} kind = TEXTURE_2D;
+		GLuint texture = 0;
+		int face = 0; // CUBEMAP_FACE only
+		texture_2d::params_t params;
+		texture_2d::image_t image;
+		texture_cache::texture_t compressed; // TEXTURE_2D, replaces image when it has levels
+		model::model_data_t model;
+		model::texture_loader_t load_texture;
+		std::function<void(model::model_t)> on_model;
+	};
+
+	struct loader_t {
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<std::function<void()>> jobs; // guarded by mutex
+		std::deque<upload_t> uploads; // guarded by mutex
+		size_t pending = 0; // queued or running jobs plus waiting uploads, guarded by mutex
+		bool stopping = false; // guarded by mutex
+
+		// GL thread only
+		texture_streamer::streamer_t* streamer = nullptr; // streams 2D texture levels when set
+		size_t upload_budget = 0;
+		std::vector<GLuint> pbos;
+		size_t next_pbo = 0;
+		std::unordered_map<GLuint, size_t> in_flight; // uploads still to come, by texture
+		std::unordered_set<GLuint> cancelled; // destroyed while uploads for them were in flight
+		std::vector<model::mesh_report_t> reports; // of every model parsed rather than cached
+	};
+
+	/**
+	 * Start the worker threads
+	 * @param loader
+	 * @param n_workers - 0 to use every hardware thread but the GL one
+	 * @param upload_budget - bytes uploaded per update() (at least one upload always goes through)
+	 */
+	void init(loader_t& loader, unsigned n_workers = 0, size_t upload_budget = 16u << 20);
+
+	/**
+	 * Stop the workers and free the upload buffers. Textures that never finished loading keep
+	 * their placeholder contents, models that never finished are dropped. Destroyed textures still
+	 * waiting on uploads are deleted
+	 * @param loader
+	 */
+	void destroy(loader_t& loader);
+
+	/**
+	 * Create a texture immediately and fill it in the background
+	 * @param path - image file
+	 * @param params - sampling parameters, applied once the real data arrives
+	 * @param placeholder - RGBA colour of the 1x1 texture shown until then
+	 * @return texture handle, valid straight away
+	 */
+	GLuint load_texture_2d(loader_t& loader,
+	                       const std::string& path,
+	                       texture_2d::params_t const& params = texture_2d::params_t{},
+	                       glm::vec4 placeholder = glm::vec4(1.0f));
+
+	/**
+	 * Create a cubemap immediately and fill its faces in the background
+	 * @return texture handle, valid straight away
+	 */
+	GLuint load_cubemap(loader_t& loader,
+	                    const std::string& base_path,
+	                    const std::string& extension = ".jpg");
+
+	/**
+	 * Delete a texture from load_texture_2d or load_cubemap, and take it out of the streamer.
+	 * While uploads for it are still to come its name stays reserved, so GL cannot hand it out
+	 * again before they arrive, and it is deleted when the last of them is dropped
+	 * @param loader
+	 * @param texture
+	 */
+	void destroy_texture(loader_t& loader, GLuint texture);
+
+	/**
+	 * Parse a model in the background
+	 * @param path - path of the OBJ
+	 * @param on_ready - called on the GL thread, from update(), with the uploaded model
+	 * @param load_texture - creates the material textures on the GL thread, defaults to
+	 * load_texture_2d on this loader
+	 */
+	void load_model(loader_t& loader,
+	                const std::string& path,
+	                std::function<void(model::model_t)> on_ready,
+	                model::texture_loader_t load_texture = {});
+
+	/**
+	 * Upload finished assets within the budget. Call once per frame from the GL thread
+	 * @param loader
+	 */
+	void update(loader_t& loader);
+
+	/**
+	 * @return true when nothing is queued, decoding or waiting for upload
+	 */
+	bool idle(loader_t& loader);
+} // namespace asset_loader
+
+#endif // COMP3421_ASSET_LOADER_HPP
@@ -0,0 +1,93 @@
+#ifndef COMP3421_ASSET_REGISTRY_HPP
+#define COMP3421_ASSET_REGISTRY_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ass3/asset_loader.hpp"
+#include "ass3/model.hpp"
+#include "ass3/texture_2d.hpp"
+
+// Path-keyed, reference-counted ownership of textures, cubemaps and models. Every asset is
+// loaded once, shared by everything that acquires it, and freed when the last reference goes.
+// GL thread only.
+namespace asset_registry {
+	struct texture_entry_t {
+		GLuint handle = 0;
+		int refs = 0;
+	};
+
+	struct model_entry_t {
+		model::model_t model;
+		std::vector<GLuint> textures; // acquired on behalf of the model, released with it
+		std::vector<std::function<void(model::model_t)>> waiting; // acquired before it loaded
+		bool loading = false;
+		bool ready = false;
+		int refs = 0;
+	};
+
+	struct registry_t {
+		asset_loader::loader_t* loader = nullptr;
+		std::unordered_map<std::string, texture_entry_t> textures; // cubemap keys are prefixed
+		std::unordered_map<GLuint, std::string> texture_keys;
+		std::unordered_map<std::string, model_entry_t> models;
+	};
+
+	/**
+	 * @param registry
+	 * @param loader - performs the actual loads, must outlive the registry
+	 */
+	void init(registry_t& registry, asset_loader::loader_t& loader);
+
+	/**
+	 * Free every asset still held, regardless of reference counts
+	 * @param registry
+	 */
+	void destroy(registry_t& registry);
+
+	/**
+	 * Get a shared 2D texture, loading it on first use. params and placeholder only apply to the
+	 * first acquire of a path
+	 * @return texture handle, owned by the registry until released
+	 */
+	GLuint acquire_texture_2d(registry_t& registry,
+	                          const std::string& path,
+	                          texture_2d::params_t const& params = texture_2d::params_t{},
+	                          glm::vec4 placeholder = glm::vec4(1.0f));
+
+	/**
+	 * Get a shared cubemap, loading it on first use
+	 * @return texture handle, owned by the registry until released
+	 */
+	GLuint acquire_cubemap(registry_t& registry,
+	                       const std::string& base_path,
+	                       const std::string& extension = ".jpg");
+
+	/**
+	 * Drop one reference to a texture or cubemap from acquire_texture_2d/acquire_cubemap. The last
+	 * one destroys it through the loader, which holds on to the name while it is still loading
+	 * @param handle - 0 is ignored
+	 */
+	void release_texture(registry_t& registry, GLuint handle);
+
+	/**
+	 * Get a shared model, loading it on first use. The returned model_t shares its GL objects
+	 * with every other acquire of the same path
+	 * @param on_ready - called once the model is available, immediately if it already is
+	 */
+	void acquire_model(registry_t& registry,
+	                   const std::string& path,
+	                   std::function<void(model::model_t)> on_ready);
+
+	/**
+	 * Drop one reference to a model from acquire_model
+	 * @param path - the path it was acquired with
+	 */
+	void release_model(registry_t& registry, const std::string& path);
+} // namespace asset_registry
+
+#endif // COMP3421_ASSET_REGISTRY_HPP
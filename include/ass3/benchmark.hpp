@@ -0,0 +1,101 @@
+#ifndef COMP3421_BENCHMARK_HPP
+#define COMP3421_BENCHMARK_HPP
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "ass3/euler_camera.hpp"
+#include "ass3/renderer.hpp"
+
+// Scripted frame benchmark. A camera path is replayed for a fixed number of frames at a fixed
+// time step, and each frame's CPU time, GPU time (GL_TIME_ELAPSED), draw calls, triangles and
+// state changes are reported as JSON. Selected frames are saved as binary PPM images so runs can
+// be compared.
+//
+// Camera paths are text, one keyframe a line: "time x y z yaw pitch" with time in seconds and
+// angles in degrees as euler_camera keeps them, lines starting with # ignored. The camera is
+// interpolated linearly between keyframes and holds the last one past the end. The windowed mode
+// records paths in this format.
+namespace benchmark {
+	struct keyframe_t {
+		float time = 0.0f;
+		euler_camera::camera_t camera = {};
+	};
+
+	struct options_t {
+		std::string path; // camera path file, empty for the built in orbit
+		int frames = 600;
+		float time_step = 1.0f / 60.0f; // scene seconds per frame
+		int width = 1280;
+		int height = 720;
+		std::string output = "benchmark.json";
+		std::vector<int> dumps; // frames to save
+		std::string dump_prefix = "frame_"; // followed by the frame number and .ppm
+		std::string record; // windowed mode only: file the camera path is written to
+		std::string trace; // either mode: Chrome trace of the profiler's zones, written at exit
+		size_t texture_budget = 256u << 20; // either mode: bytes of streamed texture levels
+	};
+
+	struct frame_t {
+		double cpu_ms = 0.0; // update and submission, until the last GL call returns
+		double gpu_ms = 0.0;
+		size_t draw_calls = 0;
+		size_t triangles = 0;
+		size_t gl_calls = 0; // state changes that reached GL, see gl_state
+		size_t gl_elided = 0; // and that it dropped
+	};
+
+	/**
+	 * Read benchmark options from the command line
+	 * @param argc
+	 * @param argv
+	 * @param options - out
+	 * @return true if --benchmark was given, the windowed mode runs otherwise
+	 */
+	bool parse_args(int argc, char** argv, options_t& options);
+
+	/**
+	 * @param path - file in the keyframe format above
+	 * @return keyframes sorted by time
+	 */
+	std::vector<keyframe_t> load_path(const std::string& path);
+
+	/**
+	 * @return a loop around the scene, looking at its centre
+	 */
+	std::vector<keyframe_t> orbit_path();
+
+	/**
+	 * @param path
+	 * @param time
+	 * @return the camera at a time along the path
+	 */
+	euler_camera::camera_t sample(const std::vector<keyframe_t>& path, float time);
+
+	/**
+	 * Append a keyframe in the format load_path() reads
+	 * @param out
+	 * @param time
+	 * @param camera
+	 */
+	void record(std::ostream& out, float time, const euler_camera::camera_t& camera);
+
+	/**
+	 * Replay a path. Frames are drawn into the current default framebuffer
+	 * @param options
+	 * @param path
+	 * @param renderer - for its per-frame stats
+	 * @param draw_frame - update the scene for a camera and time, then draw it
+	 * @return per-frame results, also written to options.output
+	 */
+	std::vector<frame_t> run(const options_t& options,
+	                         const std::vector<keyframe_t>& path,
+	                         const renderer::renderer_t& renderer,
+	                         const std::function<void(const euler_camera::camera_t&, float)>& draw_frame);
+} // namespace benchmark
+
+#endif // COMP3421_BENCHMARK_HPP
@@ -0,0 +1,82 @@
+#ifndef COMP3421_BOUNDS_HPP
+#define COMP3421_BOUNDS_HPP
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+// Bounding volumes and view frustum tests
+namespace bounds {
+	// axis aligned box, empty (min > max) until a point is added
+	struct aabb_t {
+		glm::vec3 min = glm::vec3(std::numeric_limits<float>::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits<float>::infinity());
+	};
+
+	struct sphere_t {
+		glm::vec3 center = glm::vec3(0.0f);
+		float radius = -std::numeric_limits<float>::infinity(); // empty spheres never pass a test
+	};
+
+	// the six planes (left, right, bottom, top, near, far) as ax + by + cz + d >= 0 inside, stored
+	// by component so a plane can be broadcast against several spheres at once
+	struct frustum_t {
+		float a[6];
+		float b[6];
+		float c[6];
+		float d[6];
+	};
+
+	bool empty(const aabb_t& box);
+
+	/**
+	 * @param positions - tightly packed points
+	 * @param count
+	 * @return smallest box holding every point
+	 */
+	aabb_t from_points(const glm::vec3* positions, size_t count);
+
+	aabb_t merge(const aabb_t& a, const aabb_t& b);
+
+	/**
+	 * @param box
+	 * @param transform - affine
+	 * @return box around the transformed box
+	 */
+	aabb_t transform(const aabb_t& box, const glm::mat4& transform);
+
+	/**
+	 * @return sphere through the corners of the box
+	 */
+	sphere_t enclosing_sphere(const aabb_t& box);
+
+	/**
+	 * Extract the clip planes of a projection
+	 * @param view_proj - projection * view, the planes come out in world space
+	 * @return normalised planes
+	 */
+	frustum_t make_frustum(const glm::mat4& view_proj);
+
+	/**
+	 * Test spheres given as separate coordinate arrays, four at a time where SSE is available
+	 * @param frustum
+	 * @param x, y, z, radius - count entries each
+	 * @param count
+	 * @param visible - out, count entries, 1 for spheres that are at least partly inside
+	 */
+	void test_spheres(const frustum_t& frustum,
+	                  const float* x,
+	                  const float* y,
+	                  const float* z,
+	                  const float* radius,
+	                  size_t count,
+	                  uint8_t* visible);
+
+	/**
+	 * @return false if the box is entirely outside one of the planes
+	 */
+	bool test_aabb(const frustum_t& frustum, const aabb_t& box);
+} // namespace bounds
+
+#endif // COMP3421_BOUNDS_HPP
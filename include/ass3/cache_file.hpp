@@ -0,0 +1,65 @@
+#ifndef COMP3421_CACHE_FILE_HPP
+#define COMP3421_CACHE_FILE_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+
+// Helpers shared by the files caching processed assets next to (or apart from) their sources
+namespace cache_file {
+	// what a cache remembers about a file it was built from
+	struct source_info_t {
+		uint64_t size = 0;
+		int64_t mtime = 0;
+		uint64_t hash = 0;
+	};
+
+	const uint64_t HASH_SEED = 0xcbf29ce484222325ull;
+
+	/**
+	 * 64-bit FNV-1a
+	 * @param data
+	 * @param size - in bytes
+	 * @param hash - a previous hash to continue from
+	 * @return
+	 */
+	uint64_t hash_bytes(const void* data, size_t size, uint64_t hash = HASH_SEED);
+
+	/**
+	 * @param path
+	 * @param info - size and mtime filled in, the hash is left alone
+	 * @return false if the file cannot be read
+	 */
+	bool stat_source(const std::string& path, source_info_t& info);
+
+	/**
+	 * @param path
+	 * @param hash - of the file's contents
+	 * @return false if the file cannot be read
+	 */
+	bool hash_source(const std::string& path, uint64_t& hash);
+
+	/**
+	 * A source is unchanged if its size and mtime match, or failing that, if its contents hash to
+	 * the same value (e.g. after a fresh checkout touched every file)
+	 * @param path
+	 * @param cached - as stored when the cache was written
+	 * @return
+	 */
+	bool source_unchanged(const std::string& path, const source_info_t& cached);
+
+	/**
+	 * Write a file to a temporary one and rename it into place, so a crash mid-write never leaves a
+	 * truncated cache behind. Failures are reported on stderr
+	 * @param path
+	 * @param name - module the warnings are from
+	 * @param write_contents - writes the whole file to the stream
+	 * @return false if the file was not replaced
+	 */
+	bool write(const std::string& path,
+	           const char* name,
+	           const std::function<void(std::ofstream&)>& write_contents);
+} // namespace cache_file
+
+#endif // COMP3421_CACHE_FILE_HPP
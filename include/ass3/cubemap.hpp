@@ -12,6 +12,24 @@ namespace cubemap {
 	 * @return OpenGL texture handle
 	 */
 	GLuint make_cubemap(const std::string& base_path, const std::string& extension = ".jpg");
+
+	/**
+	 * Path of one face of a cubemap, in GL_TEXTURE_CUBE_MAP_POSITIVE_X + face order
+	 * @param face 0-5
+	 */
+	std::string face_path(const std::string& base_path, const std::string& extension, int face);
+
+	/**
+	 * Upload one face of an existing cubemap
+	 * @param data Client memory, or an offset into the bound GL_PIXEL_UNPACK_BUFFER
+	 */
+	void
+	upload_face(GLuint cubemap, int face, int width, int height, int n_channels, const void* data);
+
+	/**
+	 * Apply the sampling parameters every cubemap uses
+	 */
+	void set_params(GLuint cubemap);
 } // namespace cubemap
 
 #endif // COMP3421_ASS3_CUBEMAP_HPP
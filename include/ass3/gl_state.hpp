@@ -0,0 +1,146 @@
+#ifndef COMP3421_GL_STATE_HPP
+#define COMP3421_GL_STATE_HPP
+
+#include <glad/glad.h>
+#include <cstddef>
+
+// A shadow copy of the GL state the engine changes: program, vertex array, buffer and texture
+// bindings, framebuffers, viewport and the fixed-function switches it uses. Engine code binds and
+// enables through here instead of calling GL directly, and a call that would set what is already
+// set is dropped, so draws can bind everything they need without unbinding afterwards. Issued and
+// dropped calls are counted until the next begin_frame().
+//
+// The copy starts out unknown and only learns a value once it is set through here, so the first
+// call always reaches GL. Anything that changes state behind its back has to call invalidate().
+// Objects have to be deleted through here as well: GL unbinds a deleted name, and a new object can
+// come back with the same one. GL thread only.
+namespace gl_state {
+	// texture units tracked, binds to higher units go straight to GL
+	const GLuint MAX_TEXTURE_UNITS = 16;
+
+	enum call_t {
+		PROGRAM,
+		VERTEX_ARRAY,
+		BUFFER,
+		ACTIVE_TEXTURE,
+		TEXTURE,
+		FRAMEBUFFER,
+		VIEWPORT,
+		CAPABILITY, // glEnable and glDisable
+		DEPTH_MASK,
+		DEPTH_FUNC,
+		FRONT_FACE,
+		CULL_FACE,
+		BLEND_FUNC,
+		POLYGON_OFFSET,
+		N_CALLS,
+	};
+
+	struct stats_t {
+		size_t issued[N_CALLS] = {}; // reached GL
+		size_t elided[N_CALLS] = {}; // matched the shadow copy and were dropped
+		size_t total_issued = 0;
+		size_t total_elided = 0;
+	};
+
+	/**
+	 * Forget every shadowed value, the next call of each kind reaches GL
+	 */
+	void invalidate();
+
+	/**
+	 * Zero the counters
+	 */
+	void begin_frame();
+
+	/**
+	 * @return the counters since the last begin_frame()
+	 */
+	const stats_t& stats();
+
+	void use_program(GLuint program);
+
+	/**
+	 * Bind a vertex array. The element array buffer binding belongs to the vertex array, so it is
+	 * forgotten whenever this changes
+	 * @param vao
+	 */
+	void bind_vertex_array(GLuint vao);
+
+	/**
+	 * @param target - GL_*_BUFFER
+	 * @param buffer
+	 */
+	void bind_buffer(GLenum target, GLuint buffer);
+
+	/**
+	 * glBindBufferBase, which also binds the buffer to the generic target. Always issued, indexed
+	 * bindings are not shadowed
+	 * @param target - GL_UNIFORM_BUFFER
+	 * @param index
+	 * @param buffer
+	 */
+	void bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+
+	/**
+	 * Bind a texture to a unit, switching the active unit only when the binding changes
+	 * @param unit - from 0, not GL_TEXTURE0
+	 * @param target - GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BUFFER...
+	 * @param texture
+	 */
+	void bind_texture(GLuint unit, GLenum target, GLuint texture);
+
+	/**
+	 * @param target - GL_FRAMEBUFFER binds both the draw and the read framebuffer
+	 * @param framebuffer
+	 */
+	void bind_framebuffer(GLenum target, GLuint framebuffer);
+
+	/**
+	 * @param target - GL_DRAW_FRAMEBUFFER or GL_READ_FRAMEBUFFER
+	 * @return the bound framebuffer, from the shadow copy when it is known
+	 */
+	GLuint framebuffer(GLenum target);
+
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	/**
+	 * @param out - x, y, width and height, from the shadow copy when it is known
+	 */
+	void get_viewport(GLint out[4]);
+
+	void enable(GLenum capability);
+
+	void disable(GLenum capability);
+
+	/**
+	 * @param capability
+	 * @return whether it is enabled, from the shadow copy when it is known
+	 */
+	bool is_enabled(GLenum capability);
+
+	void depth_mask(GLboolean mask);
+
+	void depth_func(GLenum func);
+
+	void front_face(GLenum mode);
+
+	void cull_face(GLenum mode);
+
+	void blend_func(GLenum src, GLenum dst);
+
+	void polygon_offset(GLfloat factor, GLfloat units);
+
+	// delete objects, forgetting any binding of them first
+	void delete_program(GLuint program);
+
+	void delete_vertex_arrays(GLsizei n, const GLuint* vaos);
+
+	void delete_buffers(GLsizei n, const GLuint* buffers);
+
+	void delete_textures(GLsizei n, const GLuint* textures);
+
+	void delete_framebuffers(GLsizei n, const GLuint* framebuffers);
+} // namespace gl_state
+
+#endif // COMP3421_GL_STATE_HPP
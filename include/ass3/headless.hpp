@@ -0,0 +1,35 @@
+#ifndef COMP3421_HEADLESS_HPP
+#define COMP3421_HEADLESS_HPP
+
+// A GL 3.3 core context without a window, on EGL. Mesa's surfaceless platform is preferred, so it
+// runs on llvmpipe with no display or GPU; the default framebuffer is an offscreen pbuffer. Only
+// available when the build found EGL (ASS3_HEADLESS), init() fails otherwise.
+namespace headless {
+	// EGL handles, kept opaque so including this needs no EGL headers
+	struct context_t {
+		void* display = nullptr;
+		void* surface = nullptr;
+		void* context = nullptr;
+		int width = 0;
+		int height = 0;
+	};
+
+	/**
+	 * Create the context, make it current and load the GL functions through it
+	 * @param width - of the pbuffer standing in for the window
+	 * @param height
+	 * @return
+	 */
+	context_t init(int width, int height);
+
+	void destroy(context_t& context);
+
+	/**
+	 * The context's GL function loader, for entry points past what glad loads
+	 * @param name
+	 * @return
+	 */
+	void* proc_address(const char* name);
+} // namespace headless
+
+#endif // COMP3421_HEADLESS_HPP
@@ -0,0 +1,120 @@
+#ifndef COMP3421_LIGHT_CLUSTERS_HPP
+#define COMP3421_LIGHT_CLUSTERS_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Clustered light assignment. The view frustum is cut into screen tiles and exponentially spaced
+// depth slices; every frame each point light is binned into the clusters its range touches, and
+// the fragment shader only shades with the lights listed for its own cluster. Depth slices are
+// binned in parallel, then the light data, the per-cluster (offset, count) grid and the flat
+// index list are uploaded as texture buffers.
+namespace light_clusters {
+	const int TILES_X = 16;
+	const int TILES_Y = 9;
+	const int SLICES = 24;
+	const int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+
+	// lights past this many in one cluster are dropped from it, bounding per-fragment work
+	const uint32_t MAX_LIGHTS_PER_CLUSTER = 256;
+
+	// below this many lights, binning stays on the calling thread
+	const size_t PARALLEL_MIN_LIGHTS = 64;
+
+	// texels of light data per light in the RGBA32F buffer: position and radius, then the
+	// diffuse, ambient and specular colours
+	const int LIGHT_TEXELS = 4;
+
+	// colours are linear, the shader does not convert them
+	struct light_t {
+		glm::vec3 position; // world space
+		float radius; // no light reaches past it
+		glm::vec3 diffuse;
+		glm::vec3 ambient;
+		glm::vec3 specular;
+	};
+
+	// clusters one light touches, as half-open ranges
+	struct light_range_t {
+		int x0, x1;
+		int y0, y1;
+		int z0, z1;
+	};
+
+	// one depth slice's lists, binned by a single thread
+	struct slice_t {
+		std::vector<uint32_t> offsets; // per tile, into indices
+		std::vector<uint32_t> counts; // per tile
+		std::vector<uint32_t> indices;
+	};
+
+	struct clusters_t {
+		// workers each bin every n-th slice, the building thread takes a share as well
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::condition_variable done;
+		uint64_t generation = 0; // guarded by mutex, bumped for every parallel build
+		size_t remaining = 0; // guarded by mutex, workers still binning
+		bool stopping = false; // guarded by mutex
+
+		// inputs and outputs of the build in progress
+		std::vector<light_range_t> ranges;
+		std::vector<slice_t> slices;
+
+		// log-depth -> slice is log(depth) * depth_scale + depth_bias
+		float depth_scale = 0.0f;
+		float depth_bias = 0.0f;
+
+		// CPU copies of the buffers, kept to reuse their storage
+		std::vector<glm::vec4> light_texels;
+		std::vector<uint32_t> grid; // (offset, count) per cluster
+		std::vector<uint32_t> indices;
+
+		GLuint light_buffer = 0;
+		GLuint light_texture = 0;
+		GLuint grid_buffer = 0;
+		GLuint grid_texture = 0;
+		GLuint index_buffer = 0;
+		GLuint index_texture = 0;
+	};
+
+	/**
+	 * Create the buffers and start the worker threads
+	 * @param clusters
+	 * @param n_workers - 0 to use every hardware thread but the calling one
+	 */
+	void init(clusters_t& clusters, unsigned n_workers = 0);
+
+	/**
+	 * Stop the workers and free the buffers
+	 * @param clusters
+	 */
+	void destroy(clusters_t& clusters);
+
+	/**
+	 * Bin the lights for a view and upload the result
+	 * @param clusters
+	 * @param lights
+	 * @param view
+	 * @param projection - perspective, its near and far planes bound the slices
+	 */
+	void build(clusters_t& clusters,
+	           const std::vector<light_t>& lights,
+	           const glm::mat4& view,
+	           const glm::mat4& projection);
+
+	/**
+	 * Bind the light data, cluster grid and index list to three consecutive texture units
+	 * @param clusters
+	 * @param first_unit
+	 */
+	void bind(const clusters_t& clusters, GLuint first_unit);
+} // namespace light_clusters
+
+#endif // COMP3421_LIGHT_CLUSTERS_HPP
@@ -3,16 +3,63 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#include "ass3/bounds.hpp"
+#include "ass3/stream_buffer.hpp"
+
 namespace mesh {
-	// mesh_t contains only the essential data required to draw the mesh as well as to destroy it
+	// a level of detail is a range of the mesh's index buffer, level 0 being the full mesh. Every
+	// level indexes the same vertices
+	const int MAX_LODS = 4;
+
+	struct lod_t {
+		GLsizei first = 0; // in indices
+		GLsizei count = 0;
+		float error = 0.0f; // deviation from level 0, as a fraction of the mesh's largest extent
+	};
+
+	// vertex layouts init() can upload, all feeding the same attribute locations.
+	// FLOAT_VERTICES keeps every attribute as its own run of floats (44 bytes a vertex with all of
+	// them). COMPACT_VERTICES interleaves them as float positions, unorm8 colors, half float uvs and
+	// octahedral snorm16 normals (24 bytes). QUANTIZED_VERTICES also stores positions as unorm16
+	// across the mesh's bounds (20 bytes), undone by position_offset and position_scale
+	enum vertex_format_t {
+		FLOAT_VERTICES,
+		COMPACT_VERTICES,
+		QUANTIZED_VERTICES,
+	};
+
+	// mesh_t contains only the essential data required to draw and cull the mesh as well as to
+	// destroy it
 	struct mesh_t {
 		GLuint vao = 0;
 		GLuint vbo = 0;
 		GLuint ebo = 0;
-		GLsizei indices_count = 0;
+		GLenum index_type = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT when every vertex fits
+		GLsizei indices_count = 0; // of level 0
+		vertex_format_t format = FLOAT_VERTICES;
+		glm::vec3 position_offset = glm::vec3(0.0f); // model position = offset + stored * scale
+		glm::vec3 position_scale = glm::vec3(1.0f);
+		bounds::aabb_t bounds; // model space
+		lod_t lods[MAX_LODS];
+		int lod_count = 1;
+		float uv_density = 0.0f; // texture coordinate units per model space unit, 0 without them
+	};
+
+	// per-instance vertex attributes follow the mesh's own (0 to 3): a column per location for the
+	// transform, then an optional tint
+	const GLuint INSTANCE_TRANSFORM_ATTRIB = 4;
+	const GLuint INSTANCE_TINT_ATTRIB = 8;
+
+	// instances_t holds per-instance transforms (and tints) for drawing one mesh many times
+	struct instances_t {
+		GLuint vbo = 0;
+		GLsizei count = 0;
+		bool has_tints = false;
+		std::vector<glm::mat4> transforms; // kept client side for bounds
 	};
 
 	// mesh_template_t contains potentially mesh attributes - to be used on initialisation only
@@ -22,7 +69,30 @@ namespace mesh {
 		std::vector<glm::vec3> colors;
 		std::vector<glm::vec2> tex_coords;
 		std::vector<glm::vec3> normals;
-		std::vector<GLuint> indices;
+		std::vector<GLuint> indices; // every level of detail, back to back
+		std::vector<lod_t> lods; // ranges of indices, empty when it only holds level 0
+	};
+
+	// mesh_data_t points at vertex and index bytes already in the layout of its format, along with
+	// what the mesh_t needs to draw them - init() hands the bytes to GL untouched, so they can come
+	// straight from disk
+	struct mesh_data_t {
+		vertex_format_t format = FLOAT_VERTICES;
+		const void* vertices = nullptr;
+		size_t vertices_size = 0;
+		size_t vertex_count = 0;
+		const void* indices = nullptr;
+		size_t indices_count = 0; // of every level together
+		GLenum index_type = GL_UNSIGNED_INT;
+		const lod_t* lods = nullptr;
+		size_t lod_count = 0; // 0 when the indices only hold level 0
+		bool has_colors = false;
+		bool has_tex_coords = false;
+		bool has_normals = false;
+		bounds::aabb_t bounds; // model space
+		glm::vec3 position_offset = glm::vec3(0.0f);
+		glm::vec3 position_scale = glm::vec3(1.0f);
+		float uv_density = 0.0f;
 	};
 
 	/**
@@ -35,9 +105,40 @@ namespace mesh {
 	 * Register a buffer with the current OpenGL for the given mesh template
 	 * @param mesh_template - bloated struct of potential mesh attribute data (to be used on
 	 * initialisation only)
+	 * @param usage
+	 * @param format - vertex layout to upload
+	 * @return
+	 */
+	mesh_t init(mesh_template_t const& mesh_template,
+	            GLenum usage = GL_STATIC_DRAW,
+	            vertex_format_t format = FLOAT_VERTICES);
+
+	/**
+	 * Register a buffer with the current OpenGL for pre-packed mesh data
+	 * @param mesh_data - from pack(), or read back from where its bytes were stored
+	 * @param usage
 	 * @return
 	 */
-	mesh_t init(mesh_template_t const& mesh_template, GLenum usage = GL_STATIC_DRAW);
+	mesh_t init(mesh_data_t const& mesh_data, GLenum usage = GL_STATIC_DRAW);
+
+	/**
+	 * Pack a mesh template into the layout of a vertex format without touching GL
+	 * @param mesh_template
+	 * @param format - vertex layout to pack
+	 * @param vertices - filled with the packed vertex bytes
+	 * @param indices - filled with the index bytes, 16 bits each when every vertex fits
+	 * @return the mesh data, pointing into vertices, indices and the template's lods
+	 */
+	mesh_data_t pack(mesh_template_t const& mesh_template,
+	                 vertex_format_t format,
+	                 std::vector<uint8_t>& vertices,
+	                 std::vector<uint8_t>& indices);
+
+	/**
+	 * @param mesh_data
+	 * @return bytes of the mesh data's indices
+	 */
+	size_t indices_size(mesh_data_t const& mesh_data);
 
 	/**
 	 * Draw's the mesh statically
@@ -47,13 +148,67 @@ namespace mesh {
 	void draw(mesh_t const& mesh, GLenum draw_mode = GL_TRIANGLES);
 
 	/**
-	 * Update the mesh data using mesh_template then draw
+	 * @param mesh
+	 * @param lod - clamped to the levels the mesh has
+	 * @return the index range drawn for a level of detail
+	 */
+	lod_t const& select_lod(mesh_t const& mesh, int lod);
+
+	/**
+	 * Issue the draw call only, for callers that keep the mesh's vao bound across draws
+	 * @param mesh - its vao must be bound
+	 * @param draw_mode
+	 * @param lod - level of detail, clamped to the levels the mesh has
+	 */
+	void draw_bound(mesh_t const& mesh, GLenum draw_mode = GL_TRIANGLES, int lod = 0);
+
+	/**
+	 * Issue the draw call for any range of the mesh's indices (or vertices, without indices)
+	 * @param mesh - its vao must be bound
+	 * @param range
+	 * @param draw_mode
+	 */
+	void draw_range(mesh_t const& mesh, lod_t const& range, GLenum draw_mode = GL_TRIANGLES);
+
+	/**
+	 * Upload per-instance data
+	 * @param transforms - one per instance, applied before the node's model matrix
+	 * @param tints - empty, or one RGBA multiplier per instance
+	 * @param usage
+	 * @return
+	 */
+	instances_t init_instances(const std::vector<glm::mat4>& transforms,
+	                           const std::vector<glm::vec4>& tints = {},
+	                           GLenum usage = GL_STATIC_DRAW);
+
+	void destroy(instances_t const& instances);
+
+	/**
+	 * Draw every instance with one call. The instance attributes are attached to the mesh's vao
+	 * for the draw and detached again, so the vao can still be shared with plain draws
+	 * @param mesh - left bound afterwards
+	 * @param instances
+	 * @param draw_mode
+	 * @param lod - level of detail, clamped to the levels the mesh has
+	 */
+	void draw_instanced(mesh_t const& mesh,
+	                    instances_t const& instances,
+	                    GLenum draw_mode = GL_TRIANGLES,
+	                    int lod = 0);
+
+	/**
+	 * Write the mesh data from mesh_template into this frame's part of a stream buffer and draw
+	 * it, in the FLOAT_VERTICES layout. The mesh's vao points into the stream afterwards, so the
+	 * mesh should only be drawn through dynamic_draw from then on
 	 * @param mesh
 	 * @param mesh_template
+	 * @param stream - between begin_frame() and end_frame()
 	 * @param draw_mode
 	 */
-	void
-	dynamic_draw(mesh_t& mesh, const mesh_template_t& mesh_template, GLenum draw_mode = GL_TRIANGLES);
+	void dynamic_draw(mesh_t& mesh,
+	                  const mesh_template_t& mesh_template,
+	                  stream_buffer::stream_buffer_t& stream,
+	                  GLenum draw_mode = GL_TRIANGLES);
 } // namespace mesh
 
 #endif
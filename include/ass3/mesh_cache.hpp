@@ -0,0 +1,63 @@
+#ifndef COMP3421_MESH_CACHE_HPP
+#define COMP3421_MESH_CACHE_HPP
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "ass3/mesh.hpp"
+
+namespace mesh_cache {
+	// material_desc_t is the GL-free part of a model material - texture names are relative to
+	// the directory of the source OBJ
+	struct material_desc_t {
+		glm::vec4 diffuse = glm::vec4(1.0f);
+		glm::vec3 specular = glm::vec3(1.0f);
+		std::string diffuse_texname;
+		std::string specular_texname;
+	};
+
+	struct cached_mesh_t {
+		mesh::mesh_data_t data; // points into the mapping, valid until close()
+		int material_id = -1;
+	};
+
+	// cache_t is a read-only view of a memory-mapped cache file
+	struct cache_t {
+		void* mapping = nullptr;
+		size_t mapping_size = 0;
+		std::vector<cached_mesh_t> meshes;
+		std::vector<material_desc_t> materials;
+	};
+
+	/**
+	 * Map the cache file stored next to source_path
+	 * @param source_path - path of the OBJ the cache was built from
+	 * @param cache - filled in on success
+	 * @return false if there is no cache, it is from another version, or any of its sources
+	 * changed since it was written
+	 */
+	bool open(const std::string& source_path, cache_t& cache);
+
+	/**
+	 * Unmap a cache opened with open()
+	 * @param cache
+	 */
+	void close(cache_t& cache);
+
+	/**
+	 * Write the packed meshes of a model to the cache file next to source_path
+	 * @param source_path - path of the OBJ the data was built from
+	 * @param dependencies - other files (e.g. MTL libraries) whose changes invalidate the cache
+	 * @param meshes - from mesh::pack, stored byte for byte so open() can hand them to mesh::init
+	 * @param material_ids - index into materials for each mesh
+	 * @param materials - material table of the model
+	 */
+	void write(const std::string& source_path,
+	           const std::vector<std::string>& dependencies,
+	           const std::vector<mesh::mesh_data_t>& meshes,
+	           const std::vector<int>& material_ids,
+	           const std::vector<material_desc_t>& materials);
+} // namespace mesh_cache
+
+#endif // COMP3421_MESH_CACHE_HPP
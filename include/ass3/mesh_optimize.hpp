@@ -0,0 +1,62 @@
+#ifndef COMP3421_MESH_OPTIMIZE_HPP
+#define COMP3421_MESH_OPTIMIZE_HPP
+
+#include <glad/glad.h>
+#include <vector>
+
+#include "ass3/mesh.hpp"
+
+// Reorders a mesh template for the GPU without changing what it draws, in three steps:
+//  1. triangles are reordered for the post-transform vertex cache (Forsyth's scoring)
+//  2. the result is cut into clusters wherever the cache restarts anyway, and clusters facing
+//     out from the mesh's centre go first so they occlude the rest early (Tipsify's ordering)
+//  3. vertices are renumbered in the order the triangles first use them, for fetch locality
+// Every index range (level of detail) is reordered on its own, all of them share the vertices.
+namespace mesh_optimize {
+	// FIFO cache size stats are measured against, typical of post-transform caches
+	const size_t STATS_CACHE_SIZE = 16;
+
+	// a cluster is cut once its own cache miss rate is within this factor of its whole run's
+	const float OVERDRAW_THRESHOLD = 1.05f;
+
+	struct stats_t {
+		float acmr = 0.0f; // average cache miss ratio: vertex shader runs per triangle, 0.5 to 3
+		float atvr = 0.0f; // average transformed vertex ratio: shader runs per vertex used, 1 best
+	};
+
+	// stats of the first index range (level 0) either side of optimize()
+	struct report_t {
+		stats_t before;
+		stats_t after;
+	};
+
+	/**
+	 * Simulate a FIFO post-transform cache over a triangle list
+	 * @param indices
+	 * @param first - of the range to measure
+	 * @param count
+	 * @param vertex_count
+	 * @return
+	 */
+	stats_t analyze(const std::vector<GLuint>& indices,
+	                size_t first,
+	                size_t count,
+	                size_t vertex_count);
+
+	/**
+	 * Reorder the template's triangles and vertices, each level of detail separately
+	 * @param mesh_template - needs positions and a triangle list
+	 * @return
+	 */
+	report_t optimize(mesh::mesh_template_t& mesh_template);
+
+	/**
+	 * Like optimize(mesh_template), for templates whose index ranges are kept outside of it
+	 * @param mesh_template
+	 * @param ranges - triangle lists covering the template's indices
+	 * @return
+	 */
+	report_t optimize(mesh::mesh_template_t& mesh_template, const std::vector<mesh::lod_t>& ranges);
+} // namespace mesh_optimize
+
+#endif // COMP3421_MESH_OPTIMIZE_HPP
@@ -4,8 +4,12 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
+#include <functional>
+#include <string>
 #include <vector>
 #include "ass3/mesh.hpp"
+#include "ass3/mesh_cache.hpp"
+#include "ass3/mesh_optimize.hpp"
 
 namespace model {
     struct material_t {
@@ -30,8 +34,57 @@ namespace model {
         std::vector<material_t> materials;
     };
 
+    // the bytes mesh::pack produced for one mesh of a parsed OBJ
+    struct packed_mesh_t {
+        std::vector<uint8_t> vertices;
+        std::vector<uint8_t> indices;
+        std::vector<mesh::lod_t> lods;
+    };
+
+    // what mesh_optimize did to one mesh of a parsed OBJ
+    struct mesh_report_t {
+        std::string name; // the OBJ's path and the shape's name
+        mesh_optimize::report_t optimize;
+    };
+
+    // model_data_t is everything model::load needs before touching GL - built off the GL thread
+    struct model_data_t {
+        std::string search_path;
+        std::vector<mesh_cache::material_desc_t> materials;
+        std::vector<int> material_ids; // per mesh
+        std::vector<mesh::mesh_data_t> meshes; // point into packed or the cache's mapping
+        std::vector<packed_mesh_t> packed; // set when the OBJ was parsed
+        mesh_cache::cache_t cache; // set when the mesh cache was hit
+        std::vector<mesh_report_t> reports; // per mesh, set when the OBJ was parsed
+    };
+
+    // creates a texture for a path, lets callers choose between blocking and asynchronous loads
+    using texture_loader_t = std::function<GLuint(const std::string &path)>;
+
     model_t load(const std::string &path);
 
+    /**
+     * Read a model from the mesh cache, or parse the OBJ and refresh the cache. Makes no GL calls
+     * @param path - path of the OBJ
+     * @return CPU side model data, to be passed to upload() then release()
+     */
+    model_data_t parse(const std::string &path);
+
+    /**
+     * Create the GL meshes and materials for parsed model data
+     * @param data - result of parse()
+     * @param load_texture - creates the texture for a material map
+     * @return
+     */
+    model_t upload(const model_data_t &data, const texture_loader_t &load_texture);
+
+    /**
+     * Free the memory held by parsed model data
+     * @param data
+     */
+    void release(model_data_t &data);
+
+    // frees the meshes and material textures - use asset_registry::release_model for shared models
     void destroy(const model_t &model);
 } // namespace model
 
@@ -0,0 +1,74 @@
+#ifndef COMP3421_OBJ_PARSER_HPP
+#define COMP3421_OBJ_PARSER_HPP
+
+#include <string>
+#include <vector>
+
+// A parallel Wavefront OBJ/MTL parser. The data layout mirrors what tinyobjloader produces with
+// triangulation enabled, so code written against tinyobj's attrib/shapes/materials carries over.
+namespace obj_parser {
+	// 0-based indices into attrib_t pools, -1 when the face corner has no such attribute
+	struct index_t {
+		int vertex_index = -1;
+		int normal_index = -1;
+		int texcoord_index = -1;
+	};
+
+	struct mesh_t {
+		std::vector<index_t> indices; // 3 per triangle
+		std::vector<unsigned char> num_face_vertices; // always 3, kept for tinyobj parity
+		std::vector<int> material_ids; // per triangle, -1 if no material applies
+	};
+
+	struct shape_t {
+		std::string name;
+		mesh_t mesh;
+	};
+
+	struct attrib_t {
+		std::vector<float> vertices; // xyz
+		std::vector<float> normals; // xyz
+		std::vector<float> texcoords; // uv
+	};
+
+	struct material_t {
+		std::string name;
+		float ambient[3] = {1.0f, 1.0f, 1.0f};
+		float diffuse[3] = {1.0f, 1.0f, 1.0f};
+		float specular[3] = {0.0f, 0.0f, 0.0f};
+		float shininess = 1.0f;
+		float dissolve = 1.0f;
+		std::string ambient_texname;
+		std::string diffuse_texname;
+		std::string specular_texname;
+		std::string specular_highlight_texname;
+		std::string bump_texname;
+	};
+
+	struct obj_t {
+		attrib_t attrib;
+		std::vector<shape_t> shapes;
+		std::vector<material_t> materials;
+		std::vector<std::string> mtl_libs; // paths of the MTL libraries that were read
+	};
+
+	/**
+	 * Parse an OBJ file and the MTL libraries it references. The file is split into line-aligned
+	 * chunks which are parsed concurrently, then merged with global index fix-up. The chunks run
+	 * on a thread pool shared by every parse and on the calling thread.
+	 * @param path - path of the OBJ file
+	 * @param mtl_search_path - directory prefix (with trailing slash) for mtllib lookups
+	 * @param n_threads - most chunks to split the file into, 0 for one per hardware thread
+	 * @return the parsed file, polygons fan-triangulated
+	 */
+	obj_t parse(const std::string& path, const std::string& mtl_search_path, unsigned n_threads = 0);
+
+	/**
+	 * Parse the materials of a single MTL file
+	 * @param path
+	 * @return materials in file order
+	 */
+	std::vector<material_t> parse_mtl(const std::string& path);
+} // namespace obj_parser
+
+#endif // COMP3421_OBJ_PARSER_HPP
@@ -0,0 +1,103 @@
+#ifndef COMP3421_PROFILER_HPP
+#define COMP3421_PROFILER_HPP
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scoped CPU and GPU timing zones. CPU zones go into a ring per thread that only its own thread
+// writes and the GL thread drains, so recording never takes a lock. GPU zones are a pair of
+// GL_TIMESTAMP queries (elapsed-time queries cannot nest), taken from a ring a few frames deep:
+// a frame's results are read when its slot comes round again and dropped if still not available,
+// so reading never stalls. Drained zones feed rolling per-zone statistics and a Chrome trace
+// (chrome://tracing, ui.perfetto.dev) with GPU zones on a track of their own.
+//
+// Zones are placed with the PROFILE_* macros, which compile to nothing unless ASS3_PROFILE is
+// defined (every build type but Release). Zone names have to be string literals.
+namespace profiler {
+	// frames a GPU query slot waits before it is read back
+	const int GPU_FRAMES = 4;
+	const int MAX_GPU_ZONES = 64; // per frame, later zones are not timed
+
+	// events a thread can record between two begin_frame() calls before the rest are dropped
+	const size_t THREAD_EVENTS = 4096;
+
+	// samples per zone the statistics are taken over
+	const size_t STATS_WINDOW = 256;
+
+	// events kept for the trace, the oldest are dropped past it
+	const size_t MAX_TRACE_EVENTS = 1u << 20;
+
+	struct zone_stats_t {
+		std::string name; // prefixed "gpu " for GPU zones
+		size_t samples = 0; // in the window
+		double min_ms = 0.0;
+		double avg_ms = 0.0;
+		double p99_ms = 0.0;
+	};
+
+	// records a CPU zone from construction to destruction
+	struct cpu_zone_t {
+		const char* name;
+		uint64_t begin;
+
+		explicit cpu_zone_t(const char* zone_name);
+		~cpu_zone_t();
+		cpu_zone_t(const cpu_zone_t&) = delete;
+		cpu_zone_t& operator=(const cpu_zone_t&) = delete;
+	};
+
+	// records a GPU zone around the GL commands issued from construction to destruction. GL
+	// thread only
+	struct gpu_zone_t {
+		int slot; // -1 when the frame ran out of queries
+
+		explicit gpu_zone_t(const char* zone_name);
+		~gpu_zone_t();
+		gpu_zone_t(const gpu_zone_t&) = delete;
+		gpu_zone_t& operator=(const gpu_zone_t&) = delete;
+	};
+
+	/**
+	 * Create the GPU queries, needs a current GL context
+	 */
+	void init();
+
+	void destroy();
+
+	/**
+	 * Read back the GPU zones of GPU_FRAMES ago, drain every thread's CPU zones and start timing
+	 * a new frame. Once a frame, from the GL thread
+	 */
+	void begin_frame();
+
+	/**
+	 * @return statistics of every zone seen so far, by name
+	 */
+	std::vector<zone_stats_t> stats();
+
+	/**
+	 * Write the drained zones as Chrome trace event JSON
+	 * @param path
+	 */
+	void write_trace(const std::string& path);
+} // namespace profiler
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef ASS3_PROFILE
+#define PROFILE_FRAME() profiler::begin_frame()
+#define PROFILE_ZONE(name) profiler::cpu_zone_t PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+// times the zone on both the CPU and the GPU
+#define PROFILE_GPU_ZONE(name)                                                        \
+	profiler::cpu_zone_t PROFILE_CONCAT(profile_zone_, __LINE__)(name);               \
+	profiler::gpu_zone_t PROFILE_CONCAT(profile_gpu_zone_, __LINE__)(name)
+#else
+#define PROFILE_FRAME() ((void)0)
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_GPU_ZONE(name) ((void)0)
+#endif
+
+#endif // COMP3421_PROFILER_HPP
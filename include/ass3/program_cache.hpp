@@ -0,0 +1,47 @@
+#ifndef COMP3421_PROGRAM_CACHE_HPP
+#define COMP3421_PROGRAM_CACHE_HPP
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <string>
+
+// Linked programs are saved as driver binaries (glGetProgramBinary) and restored with
+// glProgramBinary on later runs instead of being compiled again. A binary is keyed by a hash of
+// the shader sources with their defines and the GL vendor, renderer and version, so an edited
+// shader or another driver compiles afresh, as does a binary the driver rejects; either way the
+// new binary replaces the old one.
+//
+// The binary entry points are GL 4.1 (ARB_get_program_binary), past the 3.3 the loader is
+// generated for, so init() looks them up through the context's own loader. Without them, or
+// without any binary format, every program is compiled as before.
+namespace program_cache {
+	struct stats_t {
+		size_t restored = 0; // from a binary
+		size_t compiled = 0; // from source, binary missing or stale
+		size_t rejected = 0; // compiled because the driver refused a binary
+	};
+
+	/**
+	 * Look up the binary entry points, needs a current context
+	 * @param load - the loader the context was set up with (glfwGetProcAddress, eglGetProcAddress)
+	 */
+	void init(GLADloadproc load);
+
+	/**
+	 * Restore a program from the cache or compile and link it, caching the result
+	 * @param vs_path
+	 * @param fs_path
+	 * @param defines - lines put after the #version line of both sources, e.g. "#define FOO\n"
+	 * @return a linked program, compile and link errors are fatal
+	 */
+	GLuint load(const std::string& vs_path,
+	            const std::string& fs_path,
+	            const std::string& defines = "");
+
+	/**
+	 * @return what load() did since init()
+	 */
+	const stats_t& stats();
+} // namespace program_cache
+
+#endif // COMP3421_PROGRAM_CACHE_HPP
@@ -0,0 +1,101 @@
+#ifndef COMP3421_RENDER_GRAPH_HPP
+#define COMP3421_RENDER_GRAPH_HPP
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A frame described as passes that declare the attachments they read and write. Compiling the
+// graph walks back from the back buffer: passes whose outputs nothing downstream reads are culled,
+// and the attachments of the rest are taken from a pool of window sized textures, where one
+// texture serves every attachment of its format whose lifetimes do not overlap. The pool is
+// rebuilt whenever the window's framebuffer changes size.
+namespace render_graph {
+	using resource_id_t = uint32_t;
+
+	// the default framebuffer, a pass writing it writes nothing else
+	const resource_id_t BACK_BUFFER = 0;
+
+	struct resource_t {
+		std::string name;
+		GLenum format = GL_NONE; // sized internal format, depth formats become depth attachments
+		GLuint texture = 0; // from the pool, valid during execute() for live passes
+	};
+
+	struct pass_t {
+		std::string name;
+		std::vector<resource_id_t> reads;
+		std::vector<resource_id_t> writes; // colour attachments in order, plus at most one depth
+		std::function<void()> execute; // called with its framebuffer bound and viewport set
+		bool live = false;
+		GLuint fbo = 0;
+	};
+
+	struct pooled_texture_t {
+		GLuint texture = 0;
+		GLenum format = GL_NONE;
+	};
+
+	// counters from the last compile
+	struct stats_t {
+		size_t culled_passes = 0;
+		size_t textures = 0; // in the pool
+		size_t attachments = 0; // served by the pool, more than textures when aliased
+	};
+
+	struct graph_t {
+		std::vector<resource_t> resources; // BACK_BUFFER first
+		std::vector<pass_t> passes; // in execution order
+		std::vector<pooled_texture_t> pool;
+		int width = 0; // of the pool's textures
+		int height = 0;
+		bool compiled = false;
+		stats_t stats;
+	};
+
+	graph_t init();
+
+	void destroy(graph_t& graph);
+
+	/**
+	 * Declare a window sized attachment
+	 * @param graph
+	 * @param name
+	 * @param format - sized internal format, e.g. GL_RGBA16F or GL_DEPTH_COMPONENT24
+	 * @return
+	 */
+	resource_id_t add_resource(graph_t& graph, const std::string& name, GLenum format);
+
+	/**
+	 * Append a pass, after every pass it reads from
+	 * @param graph
+	 * @param name
+	 * @param reads
+	 * @param writes
+	 * @param execute
+	 */
+	void add_pass(graph_t& graph,
+	              const std::string& name,
+	              std::vector<resource_id_t> reads,
+	              std::vector<resource_id_t> writes,
+	              std::function<void()> execute);
+
+	/**
+	 * Run the live passes, recompiling first if passes were added or the size changed
+	 * @param graph
+	 * @param width - of the window's framebuffer
+	 * @param height
+	 */
+	void execute(graph_t& graph, int width, int height);
+
+	/**
+	 * @param graph
+	 * @param resource
+	 * @return the texture behind an attachment, for passes that read it
+	 */
+	GLuint texture(const graph_t& graph, resource_id_t resource);
+} // namespace render_graph
+
+#endif // COMP3421_RENDER_GRAPH_HPP
@@ -0,0 +1,118 @@
+#ifndef COMP3421_RENDER_QUEUE_HPP
+#define COMP3421_RENDER_QUEUE_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "ass3/mesh.hpp"
+#include "ass3/model.hpp"
+
+// A flat list of draw packets, built by scene traversal and radix sorted by a 64 bit key so that
+// draws sharing a program, textures and material end up next to each other.
+//
+// Key layout, most significant bit first:
+//   opaque:      [1 layer = 0][6 program][14 textures][13 material][24 depth, near first][6 unused]
+//   translucent: [1 layer = 1][24 depth, far first][6 program][14 textures][13 material][6 unused]
+// Opaque draws are grouped by state then ordered front to back, translucent draws have to be
+// ordered back to front before anything else.
+namespace render_queue {
+	const int PROGRAM_BITS = 6; // enough for every variant of the main program
+	const int TEXTURES_BITS = 14;
+	const int MATERIAL_BITS = 13;
+	const int DEPTH_BITS = 24;
+
+	// view space depth mapped onto the depth bits, draws beyond it share the last bucket
+	const float MAX_SORT_DEPTH = 1000.0f;
+
+	// packet flags, water draws get their own program variant
+	const uint8_t FLAG_WATER = 1u << 0;
+	const uint8_t FLAG_WATER_SURFACE = 1u << 1;
+
+	struct packet_t {
+		uint64_t key = 0;
+		GLuint program = 0;
+		const mesh::mesh_t* mesh = nullptr;
+		const model::material_t* material = nullptr;
+		const mesh::instances_t* instances = nullptr; // set for instanced draws
+		uint32_t transform = 0; // index of the world matrix, owned by the caller
+		uint32_t material_id = 0; // equal ids have equal material block contents
+		uint8_t flags = 0;
+		uint8_t lod = 0; // level of detail to draw
+		uint8_t variant = 0; // the caller's name for the program, e.g. its feature set
+	};
+
+	struct sort_item_t {
+		uint64_t key;
+		uint32_t packet;
+	};
+
+	// the textures a draw binds, unit by unit
+	struct texture_set_t {
+		GLuint units[5];
+	};
+
+	// material parameters that end up in the material uniform block
+	struct material_state_t {
+		float values[12]; // ambient, diffuse, specular, phong exponent, cube map factor
+	};
+
+	// FNV-1a over the bytes of a padding-free key struct, with bytewise equality
+	struct bytes_hash_t {
+		template <typename T>
+		size_t operator()(const T& value) const {
+			auto bytes = reinterpret_cast<const unsigned char*>(&value);
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(T); ++i) {
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+			return (size_t)hash;
+		}
+	};
+
+	struct bytes_equal_t {
+		template <typename T>
+		bool operator()(const T& a, const T& b) const {
+			return std::memcmp(&a, &b, sizeof(T)) == 0;
+		}
+	};
+
+	struct queue_t {
+		std::vector<packet_t> packets;
+		std::vector<sort_item_t> order; // packets in submission order after sort()
+		std::vector<sort_item_t> scratch;
+
+		// dense ids for the key fields, kept between frames so the keys stay stable. Only the low
+		// bits make it into the key, so ids past the field width just sort less tightly
+		std::unordered_map<GLuint, uint32_t> program_ids;
+		std::unordered_map<texture_set_t, uint32_t, bytes_hash_t, bytes_equal_t> texture_ids;
+		std::unordered_map<material_state_t, uint32_t, bytes_hash_t, bytes_equal_t> material_ids;
+	};
+
+	/**
+	 * Drop last frame's packets, keeping their storage
+	 * @param queue
+	 */
+	void clear(queue_t& queue);
+
+	/**
+	 * Fill in the key and material id of a packet and queue it
+	 * @param queue
+	 * @param packet - program, mesh, material, transform and flags set
+	 * @param view_depth - distance of the draw along the view direction
+	 * @param translucent - sort back to front after all opaque draws
+	 */
+	void push(queue_t& queue, packet_t packet, float view_depth, bool translucent);
+
+	/**
+	 * Order the packets by key into queue.order, a stable LSD radix sort which skips the byte
+	 * passes every key agrees on
+	 * @param queue
+	 */
+	void sort(queue_t& queue);
+} // namespace render_queue
+
+#endif // COMP3421_RENDER_QUEUE_HPP
@@ -4,18 +4,152 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 
 #include "ass3/scene.hpp"
 #include "ass3/euler_camera.hpp"
+#include "ass3/light_clusters.hpp"
+#include "ass3/render_queue.hpp"
+#include "ass3/scene_graph.hpp"
+#include "ass3/shadows.hpp"
+#include "ass3/stream_buffer.hpp"
+#include "ass3/terrain.hpp"
+#include "ass3/texture_streamer.hpp"
 
 namespace renderer {
+	// a node drops to level of detail i + 1 once its bounding sphere covers less than
+	// LOD_SCREEN_SIZES[i] of the screen height. Switching back needs the size to cross the
+	// threshold by LOD_HYSTERESIS (relative) the other way
+	const float LOD_SCREEN_SIZES[mesh::MAX_LODS - 1] = {0.25f, 0.1f, 0.04f};
+	const float LOD_HYSTERESIS = 0.15f;
+
+	// first of the three texture units light_clusters::bind() takes, after the material's five
+	const GLuint CLUSTER_TEXTURE_UNIT = 5;
+	const GLuint SHADOW_TEXTURE_UNIT = 8;
+
+	// per-frame geometry written through renderer_t::stream, split between the frames in flight
+	const size_t STREAM_CAPACITY = 12u << 20;
+
+	// material features the main program is specialised on, each a #define in shader.vert and
+	// shader.frag. A draw uses the variant with exactly its material's features, so it skips the
+	// fetches and blends of maps it does not have
+	enum feature_t : uint32_t {
+		FEATURE_DIFFUSE_MAP = 1u << 0,
+		FEATURE_SPECULAR_MAP = 1u << 1,
+		FEATURE_NORMAL_MAP = 1u << 2,
+		FEATURE_CUBE_MAP = 1u << 3, // reflection
+		FEATURE_HEIGHT_MAP = 1u << 4, // vertex displacement
+		FEATURE_WATER = 1u << 5,
+	};
+	const uint32_t N_FEATURES = 6;
+	const uint32_t N_VARIANTS = 1u << N_FEATURES;
+	static_assert(N_VARIANTS <= 256, "render_queue::packet_t::variant holds a feature set");
+
+	// uniform block binding points, assigned to every program at link time
+	const GLuint CAMERA_BLOCK_BINDING = 0;
+	const GLuint LIGHTS_BLOCK_BINDING = 1;
+	const GLuint MATERIAL_BLOCK_BINDING = 2;
+
+	// std140 mirrors of the uniform blocks in shader.vert/shader.frag. vec3 members are followed
+	// by explicit padding since std140 aligns them to 16 bytes
+	struct camera_block_t {
+		glm::mat4 view_proj;
+		glm::vec3 camera_pos;
+		float pad0;
+		glm::vec4 clip_plane;
+		float now;
+		float pad1[3];
+		glm::vec3 view_dir; // camera forward, fragments find their cluster's slice along it
+		float pad2;
+		glm::vec4 cluster_depth; // log-depth to slice scale and bias, slice count
+		glm::vec4 cluster_tiles; // tile size in pixels, tile counts
+	};
+
+	struct light_block_t {
+		glm::vec3 position; // direction for the sun
+		float pad0;
+		glm::vec3 diffuse;
+		float pad1;
+		glm::vec3 ambient;
+		float pad2;
+		glm::vec3 specular;
+		float pad3;
+	};
+
+	// colours are converted to linear before upload, point lights go through light_clusters
+	struct lights_block_t {
+		light_block_t sun;
+		light_block_t spot;
+		glm::mat4 shadow_matrices[shadows::CASCADES]; // world -> each cascade's shadow map
+		glm::vec4 cascade_ends; // view depth each cascade is used up to
+	};
+	static_assert(shadows::CASCADES <= 4, "cascade_ends holds at most four cascades");
+
+	struct material_block_t {
+		glm::vec3 ambient;
+		float pad0;
+		glm::vec4 diffuse;
+		glm::vec3 specular;
+		float phong_exp;
+		float cube_map_factor; // read by the CUBE_MAP variants only
+		float pad1[3];
+	};
+
+	// a linked program and the locations of all its active uniforms, reflected once at link time
+	struct program_t {
+		GLuint handle = 0;
+		std::unordered_map<std::string, GLint> uniforms;
+	};
+
+	// the main program compiled for one feature set, and its per-draw uniforms outside the blocks
+	struct variant_t {
+		program_t program;
+		GLint model_loc = -1;
+		GLint tex_coord_transform_loc = -1;
+		GLint position_offset_loc = -1;
+		GLint position_scale_loc = -1;
+		GLint octahedral_normals_loc = -1;
+	};
+
+	// colours are sRGB like the sun's and spot's, clustering converts them to linear
+	struct point_light_t {
+		glm::vec3 position;
+		glm::vec3 diffuse;
+		glm::vec3 ambient = glm::vec3(0.25f);
+		glm::vec3 specular = glm::vec3(0.12f);
+		float radius = 40.0f; // falls off to nothing here, bounds the clusters the light is put in
+	};
+
+	// counters from the last render()
+	struct stats_t {
+		size_t drawn_meshes = 0;
+		size_t culled_meshes = 0;
+		size_t drawn_chunks = 0; // terrain
+		size_t culled_chunks = 0;
+		size_t draw_calls = 0; // shadow casters included
+		size_t triangles = 0; // of the main pass
+	};
+
 	struct renderer_t {
 		glm::mat4 projection;
 
-		GLuint program;
-		GLuint skybox_program;
+		// by feature set, compiled the first time a draw needs one (handle 0 until then)
+		variant_t variants[N_VARIANTS];
+		program_t skybox_program;
+		GLint skybox_view_proj_loc = -1;
+
+		GLuint camera_ubo = 0;
+		GLuint lights_ubo = 0;
+		GLuint material_ubo = 0;
+
+		shadows::shadows_t shadows; // of the sun
+
+		// for mesh::dynamic_draw, segments are handed over by every render()
+		stream_buffer::stream_buffer_t stream;
 
 		// directional light attributes
 		glm::vec3 sun_light_dir = glm::normalize(glm::vec3(0) - glm::vec3(-25, 20, -25));
@@ -28,16 +162,43 @@ namespace renderer {
 		glm::vec3 spot_light_diffuse = glm::vec3(0.6f, 0.45f, 0.35f);
 		glm::vec3 spot_light_ambient = glm::vec3(0.2f);
 		glm::vec3 spot_light_specular = glm::vec3(0.12f);
-        
+
+		// binned into clusters every render(), so only the few near a fragment shade it
+		std::vector<point_light_t> point_lights = {
+		   {glm::vec3(0, 5, -14), glm::vec3(20.f, 18.f, 15.f)},
+		   {glm::vec3(25, 5, -25), glm::vec3(0.f, 15.f, 0.f)},
+		   {glm::vec3(30, 5, 54), glm::vec3(15.f, 0.f, 0.f)},
+		   {glm::vec3(24, 5, -39), glm::vec3(0.f, 0.f, 15.f)},
+		   {glm::vec3(46, 5, -44), glm::vec3(15.f, 15.f, 0.f)},
+		};
 		
 		glm::vec4 clip_plane = glm::vec4(0, 1, 0, -0.8);
+
+		float time = 0.0f; // seconds, animates the water, set by the caller every frame
+
+		// told which mip levels the drawn materials need, when set
+		texture_streamer::streamer_t* streamer = nullptr;
+
+		// rebuilt by every render(), kept here to reuse their storage
+		render_queue::queue_t queue;
+		std::vector<uint8_t> subtree_visible;
+		std::vector<uint8_t> node_lods; // level each node was last drawn at, by node id
+		std::vector<terrain::chunk_t> terrain_chunks;
+		std::vector<light_clusters::light_t> cluster_lights;
+
+		// owns worker threads and a mutex, so it stays put while the renderer is moved
+		std::unique_ptr<light_clusters::clusters_t> clusters;
+
+		stats_t stats;
 	};
 
 	renderer_t init(const glm::mat4& projection);
 
-	void render(const renderer_t& renderer,
+	void destroy(renderer_t& renderer);
+
+	void render(renderer_t& renderer,
 	            const euler_camera::camera_t& camera,
-	            const scene::node_t& scene,
+	            const scene_graph::graph_t& scene,
 	            const model::model_t& skybox);
 } // namespace renderer
 
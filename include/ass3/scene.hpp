@@ -3,6 +3,8 @@
 
 #include "ass3/model.hpp"
 #include "ass3/euler_camera.hpp"
+#include "ass3/asset_registry.hpp"
+#include "ass3/terrain.hpp"
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 #include <vector>
@@ -15,19 +17,24 @@ namespace scene {
 			REFLECTIVE,
 			WATER_SURFACE,
 			WATER,
+			INSTANCED, // model drawn once per entry of instances
+			TERRAIN, // terrain drawn as chunks picked around the camera, no model
 		} kind = EMPTY;
 		model::model_t model;
+		mesh::instances_t instances; // INSTANCED only
+		terrain::terrain_t terrain; // TERRAIN only
 		glm::vec3 translation = glm::vec3(0.0);
 		glm::vec3 rotation = glm::vec3(0.0); // vec3 of euler angles
 		glm::vec3 scale = glm::vec3(1.0);
 		std::vector<node_t> children;
 		glm::vec2 polygon_offset = glm::vec2(0.0); // (factor, units)
 		bool invisible = false;
+		bool dynamic = false; // moves often, its shadows are drawn every frame instead of cached
 	};
 
-	node_t make_marccoin();
+	node_t make_marccoin(asset_registry::registry_t& registry);
 
-	node_t make_sand_volume(int width, int height, int depth);
+	node_t make_sand_volume(asset_registry::registry_t& registry, int width, int height, int depth);
 
 	node_t make_water_volume(int width,
 	                         int height,
@@ -35,7 +42,18 @@ namespace scene {
 	                         GLuint refraction_map = 0,
 	                         GLuint reflection_map = 0);
 
-	model::model_t make_skybox();
+	/**
+	 * One node drawing many copies of a model in a single call per mesh
+	 * @param model - may be empty and set later, e.g. once it has loaded
+	 * @param transforms - placement of each copy relative to the node
+	 * @param tints - empty, or a diffuse multiplier per copy
+	 * @return
+	 */
+	node_t make_instanced(model::model_t model,
+	                      const std::vector<glm::mat4>& transforms,
+	                      const std::vector<glm::vec4>& tints = {});
+
+	model::model_t make_skybox(asset_registry::registry_t& registry);
 
 } // namespace scene
 
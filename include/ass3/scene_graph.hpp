@@ -0,0 +1,106 @@
+#ifndef COMP3421_SCENE_GRAPH_HPP
+#define COMP3421_SCENE_GRAPH_HPP
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "ass3/bounds.hpp"
+#include "ass3/model.hpp"
+#include "ass3/scene.hpp"
+#include "ass3/terrain.hpp"
+
+// The runtime form of a scene: node_t trees are flattened into parallel arrays indexed by node id.
+// Parents always have a lower id than their children, so world matrices are brought up to date
+// by one forward pass that only recomputes nodes whose local transform, or an ancestor's, changed.
+// Descendants are also stored right after their ancestor, so a whole subtree can be skipped by
+// jumping to its end. Subtree bounds are then redone only for the recomputed nodes and their
+// ancestors.
+namespace scene_graph {
+	using node_id_t = uint32_t;
+
+	const node_id_t NO_PARENT = ~node_id_t{0};
+
+	struct graph_t {
+		// local state, one entry per node
+		std::vector<glm::vec3> translations;
+		std::vector<glm::vec3> rotations; // euler angles, applied z then y then x
+		std::vector<glm::vec3> scales;
+		std::vector<node_id_t> parents; // NO_PARENT for roots
+		std::vector<scene::node_t::KIND> kinds;
+		std::vector<model::model_t> models;
+		std::vector<mesh::instances_t> instances; // used by INSTANCED nodes
+		std::vector<uint8_t> invisible;
+		std::vector<uint8_t> dynamic;
+		std::vector<bounds::aabb_t> local_bounds; // of the node's own meshes, every instance of them
+		std::vector<node_id_t> subtree_ends; // one past the node's last descendant
+
+		// TERRAIN nodes are rare and their state large, so it is kept aside rather than per node
+		std::vector<node_id_t> terrain_nodes;
+		std::vector<terrain::terrain_t> terrains; // parallel to terrain_nodes
+
+		// derived by update()
+		std::vector<glm::mat4> worlds;
+		std::vector<uint8_t> hidden; // invisible, or below an invisible node
+		std::vector<bounds::aabb_t> world_bounds; // of the node's own meshes
+		std::vector<bounds::aabb_t> subtree_bounds; // of the node and its descendants
+		std::vector<uint32_t> subtree_meshes; // mesh count of the node and its descendants
+
+		// world space spheres around each node and its descendants, one array per component
+		std::vector<float> subtree_x;
+		std::vector<float> subtree_y;
+		std::vector<float> subtree_z;
+		std::vector<float> subtree_radius;
+
+		std::vector<uint8_t> dirty; // local state changed since the last update()
+		size_t first_dirty = 0; // update() starts scanning here
+		std::vector<node_id_t> refresh; // update()'s scratch: nodes whose subtree data is redone
+		uint64_t static_version = 0; // bumped by every update() that moved a non-dynamic node
+	};
+
+	/**
+	 * Append a node_t and all of its descendants
+	 * @param graph
+	 * @param node - subtree to copy in
+	 * @param parent - existing node to attach it under, NO_PARENT for a new root. Its subtree has
+	 * to end at the back of the graph, i.e. children go in before anything outside the parent
+	 * @return id of the subtree root, its descendants follow it in depth-first order
+	 */
+	node_id_t add(graph_t& graph, const scene::node_t& node, node_id_t parent = NO_PARENT);
+
+	/**
+	 * @return number of nodes
+	 */
+	size_t size(const graph_t& graph);
+
+	/**
+	 * Flag a node whose local state was changed by writing the arrays directly
+	 * @param graph
+	 * @param id
+	 */
+	void mark_dirty(graph_t& graph, node_id_t id);
+
+	void set_translation(graph_t& graph, node_id_t id, glm::vec3 translation);
+
+	void set_rotation(graph_t& graph, node_id_t id, glm::vec3 rotation);
+
+	void set_scale(graph_t& graph, node_id_t id, glm::vec3 scale);
+
+	void set_invisible(graph_t& graph, node_id_t id, bool invisible);
+
+	/**
+	 * Replace a node's model and refresh its bounds
+	 * @param graph
+	 * @param id
+	 * @param model
+	 */
+	void set_model(graph_t& graph, node_id_t id, model::model_t model);
+
+	/**
+	 * Recompute the world matrices, bounds and visibility of dirty nodes and their descendants
+	 * @param graph
+	 */
+	void update(graph_t& graph);
+} // namespace scene_graph
+
+#endif // COMP3421_SCENE_GRAPH_HPP
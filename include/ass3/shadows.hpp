@@ -0,0 +1,104 @@
+#ifndef COMP3421_SHADOWS_HPP
+#define COMP3421_SHADOWS_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "ass3/scene_graph.hpp"
+#include "ass3/terrain.hpp"
+
+// Cascaded shadow maps for the sun. The view frustum up to SHADOW_DISTANCE is split into
+// CASCADES depth ranges, each covered by an orthographic map around a sphere enclosing it.
+// Cascades are padded and only move once their range leaves them, so the depth of static casters
+// is cached per cascade and re-rendered only when the cascade moves, the light turns or a static
+// node changes. Every frame the cached depth is copied into the sampled maps and the dynamic
+// casters are drawn over it. Casters are culled against each cascade's light frustum.
+namespace shadows {
+	const int CASCADES = 3;
+	const GLsizei MAP_SIZE = 2048;
+
+	// view depth past which nothing is shadowed, well short of the far plane
+	const float SHADOW_DISTANCE = 120.0f;
+
+	// cascade ends blend logarithmic (1) and uniform (0) splits
+	const float SPLIT_LAMBDA = 0.75f;
+
+	// cascades are this much (relative) larger than their depth range's sphere, the slack the
+	// camera can move through before one has to move and its cache is redrawn
+	const float CACHE_MARGIN = 0.25f;
+
+	// casters up to this far towards the sun from a cascade still throw shadows into it
+	const float CASTER_DISTANCE = 100.0f;
+
+	struct cascade_t {
+		glm::vec3 center = glm::vec3(0.0f); // world space
+		float radius = 0.0f;
+		float end = 0.0f; // view depth the cascade is used up to
+		glm::mat4 view_proj = glm::mat4(1.0f); // world -> light clip space
+
+		// what the static depth was last drawn for
+		bool cached = false;
+		uint64_t static_version = 0;
+		glm::vec3 light_dir = glm::vec3(0.0f);
+		bool composited_dynamic = false; // the sampled map holds dynamic casters too
+	};
+
+	// counters from the last update()
+	struct stats_t {
+		size_t static_redraws = 0; // cascades whose cache was redrawn
+		size_t static_casters = 0; // meshes and terrain chunks drawn into caches
+		size_t dynamic_casters = 0;
+	};
+
+	struct shadows_t {
+		GLuint program = 0;
+		GLint light_view_proj_loc = -1;
+		GLint model_loc = -1;
+		GLint tex_coord_transform_loc = -1;
+		GLint position_offset_loc = -1;
+		GLint position_scale_loc = -1;
+
+		GLuint static_maps = 0; // depth array, the cached static casters per cascade
+		GLuint maps = 0; // depth array with comparison, sampled by shader.frag
+		GLuint draw_fbo = 0;
+		GLuint read_fbo = 0;
+
+		cascade_t cascades[CASCADES];
+
+		// kept here to reuse their storage
+		std::vector<uint8_t> subtree_visible;
+		std::vector<terrain::chunk_t> chunks;
+
+		stats_t stats;
+	};
+
+	shadows_t init();
+
+	void destroy(shadows_t& shadows);
+
+	/**
+	 * Fit the cascades to the view and bring their maps up to date. Changes the framebuffer,
+	 * viewport, program and vertex array bindings
+	 * @param shadows
+	 * @param scene
+	 * @param light_dir - direction the sun shines in
+	 * @param view
+	 * @param projection - perspective
+	 */
+	void update(shadows_t& shadows,
+	            const scene_graph::graph_t& scene,
+	            glm::vec3 light_dir,
+	            const glm::mat4& view,
+	            const glm::mat4& projection);
+
+	/**
+	 * @param shadows
+	 * @param cascade
+	 * @return world -> shadow map texture space, with depth in z
+	 */
+	glm::mat4 shadow_matrix(const shadows_t& shadows, int cascade);
+} // namespace shadows
+
+#endif // COMP3421_SHADOWS_HPP
@@ -0,0 +1,32 @@
+#ifndef COMP3421_SIMPLIFY_HPP
+#define COMP3421_SIMPLIFY_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Quadric error mesh simplification (Garland & Heckbert) by edge collapse onto existing vertices.
+// Vertices are never moved or created, so every reduced index buffer can share the original
+// vertex buffer. Border edges are never collapsed; since welding keeps vertices on UV and normal
+// seams apart, seams show up as borders and stay closed too.
+namespace simplify {
+	/**
+	 * Reduce a triangle list
+	 * @param positions - vertex positions
+	 * @param vertex_count
+	 * @param indices - triangle list
+	 * @param target_index_count - stop once the result has at most this many indices
+	 * @param max_error - stop before a collapse would move the surface further than this, as a
+	 * fraction of the mesh's largest extent
+	 * @param result_error - out, the largest error of any collapse made, in the same units
+	 * @return the reduced triangle list
+	 */
+	std::vector<GLuint> simplify(const glm::vec3* positions,
+	                             size_t vertex_count,
+	                             const std::vector<GLuint>& indices,
+	                             size_t target_index_count,
+	                             float max_error,
+	                             float* result_error = nullptr);
+} // namespace simplify
+
+#endif // COMP3421_SIMPLIFY_HPP
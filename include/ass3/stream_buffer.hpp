@@ -0,0 +1,59 @@
+#ifndef COMP3421_STREAM_BUFFER_HPP
+#define COMP3421_STREAM_BUFFER_HPP
+
+#include <glad/glad.h>
+#include <cstddef>
+
+// One buffer, allocated once, that per-frame geometry is written into instead of reallocating
+// buffers of its own. It is split into a segment per frame in flight and each frame writes only
+// into its own segment, so writes never wait on the GPU: mappings are unsynchronized, and the
+// fence placed at the end of a frame is only waited on when its segment comes round again.
+namespace stream_buffer {
+	const int FRAMES_IN_FLIGHT = 3;
+
+	// every allocation starts on this boundary, enough for any vertex attribute or index type
+	const size_t ALIGNMENT = 16;
+
+	struct stream_buffer_t {
+		GLuint buffer = 0;
+		size_t segment_size = 0;
+		int segment = 0; // the current frame's
+		size_t head = 0; // next free byte
+		GLsync fences[FRAMES_IN_FLIGHT] = {};
+		size_t stalls = 0; // frames that had to wait for the GPU to release their segment
+	};
+
+	/**
+	 * @param capacity - in bytes, of all segments together
+	 * @return
+	 */
+	stream_buffer_t init(size_t capacity);
+
+	void destroy(stream_buffer_t& stream);
+
+	/**
+	 * Start writing into the next segment, waiting for the GPU to finish with it if needed
+	 * @param stream
+	 */
+	void begin_frame(stream_buffer_t& stream);
+
+	/**
+	 * Fence everything drawn from the current segment
+	 * @param stream
+	 */
+	void end_frame(stream_buffer_t& stream);
+
+	/**
+	 * Map a fresh range of the current segment for writing. The buffer is left bound to
+	 * GL_ARRAY_BUFFER until unmap()
+	 * @param stream
+	 * @param size - in bytes, has to fit what is left of the segment
+	 * @param offset - out, of the range in the buffer
+	 * @return write-only pointer to the range
+	 */
+	void* map(stream_buffer_t& stream, size_t size, size_t& offset);
+
+	void unmap(stream_buffer_t& stream);
+} // namespace stream_buffer
+
+#endif // COMP3421_STREAM_BUFFER_HPP
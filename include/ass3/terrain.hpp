@@ -0,0 +1,71 @@
+#ifndef COMP3421_TERRAIN_HPP
+#define COMP3421_TERRAIN_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "ass3/bounds.hpp"
+#include "ass3/mesh.hpp"
+#include "ass3/model.hpp"
+
+// A large ground plane drawn as quadtree chunks. Every chunk reuses one unit grid mesh, scaled to
+// its square, so chunks further from the viewer cover more ground with the same vertex count.
+// Splitting by distance keeps neighbouring chunks within one level of each other; a chunk next
+// to a coarser one folds the odd vertices of that edge onto their even neighbours, so both sides
+// share the same edge and no cracks open once the height map displaces them.
+namespace terrain {
+	// quads along a chunk edge, even so that every other edge vertex can be folded away
+	const int CHUNK_CELLS = 32;
+
+	// a chunk is split while the viewer is closer than this many chunk sizes. Above ~1.5 a chunk
+	// can never border one more than a level finer than itself
+	const float SPLIT_DISTANCE = 2.0f;
+
+	// the most the vertex shaders' height map adds to a vertex, along world y
+	const float MAX_HEIGHT = 1.0f;
+
+	// edges of a chunk bordering a coarser one, in the plane's local space
+	const int STITCH_MIN_Y = 1;
+	const int STITCH_MAX_X = 2;
+	const int STITCH_MAX_Y = 4;
+	const int STITCH_MIN_X = 8;
+	const int STITCH_VARIANTS = 16;
+
+	struct terrain_t {
+		glm::vec2 size = glm::vec2(0.0f); // extent of the plane, centred on the origin in local xy
+		int max_depth = 0; // quadtree levels below the root
+		mesh::mesh_t grid; // unit square, (CHUNK_CELLS + 1)^2 vertices, +z facing
+		mesh::lod_t variants[STITCH_VARIANTS]; // ranges of the grid's indices, by stitch mask
+		model::material_t material;
+	};
+
+	// a quadtree leaf picked by select()
+	struct chunk_t {
+		glm::mat4 transform; // unit grid -> plane local space
+		glm::vec4 tex_coord_transform; // offset in xy, scale in zw, maps the grid's uvs onto the plane's
+		bounds::aabb_t bounds; // plane local space, flat
+		int stitch = 0; // STITCH_* mask
+		int depth = 0;
+	};
+
+	/**
+	 * Build the shared grid for a plane with roughly one quad per unit at the finest level, the
+	 * same density as shapes::make_plane(width, height)
+	 * @param size - width and height of the plane
+	 * @param material
+	 * @return
+	 */
+	terrain_t init(glm::vec2 size, const model::material_t& material);
+
+	void destroy(const terrain_t& terrain);
+
+	/**
+	 * Refine the quadtree around the viewer
+	 * @param terrain
+	 * @param viewer - position in the plane's local space
+	 * @param chunks - out, cleared first. Every leaf is listed, culling is left to the caller
+	 */
+	void select(const terrain_t& terrain, glm::vec3 viewer, std::vector<chunk_t>& chunks);
+} // namespace terrain
+
+#endif // COMP3421_TERRAIN_HPP
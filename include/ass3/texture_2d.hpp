@@ -3,20 +3,65 @@
 
 #include <glad/glad.h>
 #include <string>
+#include <vector>
 
 namespace texture_2d {
 
+    // what a texture's texels hold, picks its compressed format and how its mips are filtered
+    enum content_t {
+        COLOR, // sRGB colour, with or without alpha
+        NORMAL, // tangent space normals, only x and y are kept and z is rebuilt when sampling
+        HEIGHT, // a single linear channel
+    };
+
     struct params_t {
         GLint wrap_s = GL_REPEAT; // wrapping mode on S axis
         GLint wrap_t = GL_REPEAT; // wrapping mode on T axis
         GLint filter_min = GL_LINEAR_MIPMAP_LINEAR; // filtering mode if texture pixels < screen pixels
         GLint filter_max = GL_LINEAR; // filtering mode if texture pixels > screen pixels
+        content_t content = COLOR;
+    };
+
+    // decoded pixels living in client memory
+    struct image_t {
+        int width = 0;
+        int height = 0;
+        int n_channels = 0;
+        std::vector<unsigned char> pixels;
     };
 
     void bind(GLuint tex);
 
     GLuint init(std::string file_name, params_t const &params = params_t{});
 
+    /**
+     * Decode an image file without touching GL, so it can run on any thread
+     * @param file_name - image to decode
+     * @param flip_vertically - flip rows so the first row is the bottom of the image
+     * @return decoded image
+     */
+    image_t decode(const std::string &file_name, bool flip_vertically = true);
+
+    /**
+     * Upload pixels into an existing texture and apply params
+     * @param tex - texture handle
+     * @param data - client memory, or an offset into the bound GL_PIXEL_UNPACK_BUFFER
+     */
+    void upload(GLuint tex, int width, int height, int n_channels, const void *data,
+                params_t const &params = params_t{});
+
+    /**
+     * Apply wrapping and filtering params to the texture bound to unit 0
+     * @param params
+     */
+    void set_params(params_t const &params);
+
+    /**
+     * @param params
+     * @return whether params.filter_min samples mipmaps
+     */
+    bool uses_mipmaps(params_t const &params);
+
     void destroy(GLuint tex);
 }
 
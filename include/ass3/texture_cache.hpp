@@ -0,0 +1,99 @@
+#ifndef COMP3421_TEXTURE_CACHE_HPP
+#define COMP3421_TEXTURE_CACHE_HPP
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ass3/texture_2d.hpp"
+
+// Block-compressed textures with their whole mip chain, built once from the source image and
+// cached next to it as <image>.texcache. Colour maps are BC1, or BC3 when they have alpha, normal
+// maps BC5 (x and y) and height maps BC4, so a texture takes a quarter to an eighth of its
+// uncompressed size and loads with no decode and no glGenerateMipmap.
+//
+// Mips are box filtered on the CPU: colour in linear space (the 2.2 gamma the shaders use),
+// normals renormalised. The cache is rebuilt when its source changes, like the mesh cache. BC4
+// and BC5 are core GL, BC1 and BC3 need EXT_texture_compression_s3tc; without it colour maps fall
+// back to uncompressed uploads.
+namespace texture_cache {
+	enum format_t : uint32_t {
+		BC1, // opaque RGB, 8 bytes a block
+		BC3, // RGBA, 16 bytes a block
+		BC4, // R, 8 bytes a block
+		BC5, // RG, 16 bytes a block
+	};
+
+	struct level_t {
+		uint32_t width;
+		uint32_t height;
+		uint64_t offset; // of the level's blocks in texture_t::data()
+		uint64_t size;
+	};
+
+	// a read-only view of a memory-mapped cache file, or blocks encoded in memory
+	struct texture_t {
+		void* mapping = nullptr;
+		size_t mapping_size = 0;
+		std::vector<unsigned char> blocks; // encoded, when there is no mapping
+		format_t format = BC1;
+		std::vector<level_t> levels; // largest first
+
+		const unsigned char* data() const;
+	};
+
+	/**
+	 * @param format
+	 * @return the GL internal format its blocks are uploaded as
+	 */
+	GLenum internal_format(format_t format);
+
+	/**
+	 * Find out which formats the context can sample, needs a current context. Call before any
+	 * texture is loaded, until then only the core formats are used
+	 */
+	void init();
+
+	/**
+	 * Map the cached compressed texture of an image, or decode the image, compress it and write the
+	 * cache. Makes no GL calls
+	 * @param source_path - the image file
+	 * @param content - what the image holds
+	 * @param texture - filled in on success
+	 * @param image - the decoded image instead, when the context cannot sample the format
+	 * @return false if it fell back to image
+	 */
+	bool load(const std::string& source_path,
+	          texture_2d::content_t content,
+	          texture_t& texture,
+	          texture_2d::image_t& image);
+
+	/**
+	 * Compress an image and build its mips. Makes no GL calls
+	 * @param image - rows bottom first, as texture_2d::decode flips them
+	 * @param content
+	 * @param texture - filled in on success
+	 * @return false if the context cannot sample the format the image needs
+	 */
+	bool encode(const texture_2d::image_t& image,
+	            texture_2d::content_t content,
+	            texture_t& texture);
+
+	/**
+	 * Upload the levels of a compressed texture, straight from its mapping
+	 * @param tex - texture handle
+	 * @param texture
+	 * @param params - only level 0 is uploaded when filter_min does not use mipmaps
+	 * @return bytes uploaded
+	 */
+	size_t upload(GLuint tex, const texture_t& texture, texture_2d::params_t const& params);
+
+	/**
+	 * Unmap a texture from load() and free its blocks
+	 * @param texture
+	 */
+	void close(texture_t& texture);
+} // namespace texture_cache
+
+#endif // COMP3421_TEXTURE_CACHE_HPP
@@ -0,0 +1,128 @@
+#ifndef COMP3421_TEXTURE_STREAMER_HPP
+#define COMP3421_TEXTURE_STREAMER_HPP
+
+#include <glad/glad.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ass3/texture_2d.hpp"
+#include "ass3/texture_cache.hpp"
+
+// Mip level streaming for compressed 2D textures. Only a texture's small levels are uploaded when
+// it loads; the renderer reports how finely each one is sampled every frame and the finer levels
+// it needs are read from the texture cache file on a background thread, then uploaded by update().
+// GL_TEXTURE_BASE_LEVEL hides the levels that are not resident, so a texture always samples its
+// finest loaded level.
+//
+// The streamed levels share a memory budget. When a load would go over it, the levels of the
+// textures drawn longest ago are dropped first, down to what they still need. The small levels
+// count towards the budget but are never dropped.
+namespace texture_streamer {
+	// levels at most this many texels across stay resident from the start
+	const uint32_t RESIDENT_SIZE = 64;
+
+	// consecutive levels of one texture, read on the background thread
+	struct load_t {
+		GLuint texture = 0;
+		uint64_t id = 0; // of the entry, tells a reused handle from the one that asked
+		size_t first = 0; // index of levels[0] in the texture
+		std::vector<texture_cache::level_t> levels; // offsets into source
+		const unsigned char* source = nullptr; // the texture cache's blocks, read only
+		std::vector<unsigned char> blocks; // the levels back to back, filled in by the thread
+	};
+
+	struct entry_t {
+		uint64_t id = 0;
+		texture_cache::texture_t cache; // kept open to read finer levels from
+		size_t tail = 0; // first level of the permanent ones
+		size_t resident = 0; // finest level uploaded
+		size_t wanted = 0; // finest level asked for this frame
+		uint64_t last_used = 0; // frame of the last request
+		bool loading = false;
+	};
+
+	struct stats_t {
+		size_t resident_bytes = 0; // of the streamed textures, their permanent levels included
+		size_t loaded_bytes = 0; // streamed in since init()
+		size_t evicted_bytes = 0; // dropped since init()
+		size_t evictions = 0;
+	};
+
+	struct streamer_t {
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<load_t> loads; // waiting for the thread, guarded by mutex
+		std::deque<load_t> finished; // waiting for upload, guarded by mutex
+		bool stopping = false; // guarded by mutex
+
+		// GL thread only
+		size_t budget = 0;
+		size_t upload_budget = 0;
+		size_t reserved = 0; // bytes of the loads in flight
+		uint64_t next_id = 1;
+		uint64_t frame = 1;
+		std::unordered_map<GLuint, entry_t> entries;
+		std::vector<entry_t> retired; // removed while a load was in flight
+		stats_t stats;
+	};
+
+	/**
+	 * Start the loading thread
+	 * @param streamer
+	 * @param budget - bytes of texture levels resident at once
+	 * @param upload_budget - bytes uploaded per update() (at least one load always goes through)
+	 */
+	void init(streamer_t& streamer, size_t budget, size_t upload_budget = 8u << 20);
+
+	/**
+	 * Stop the thread and close every texture's cache. The textures themselves are left alone
+	 * @param streamer
+	 */
+	void destroy(streamer_t& streamer);
+
+	/**
+	 * Upload a compressed texture's small levels and stream the rest. Textures without mipmaps,
+	 * or with nothing to stream, are uploaded whole and their cache closed
+	 * @param streamer
+	 * @param tex - texture handle
+	 * @param texture - from texture_cache::load, taken over by the streamer
+	 * @param params
+	 * @return bytes uploaded
+	 */
+	size_t add(streamer_t& streamer,
+	           GLuint tex,
+	           texture_cache::texture_t& texture,
+	           texture_2d::params_t const& params);
+
+	/**
+	 * Ask for the level a texture needs this frame. Handles the streamer does not know are
+	 * ignored, so every map of a material can be passed
+	 * @param streamer
+	 * @param tex - texture handle
+	 * @param uv_per_pixel - texture coordinate units covered by a pixel where it is sampled most
+	 * finely
+	 */
+	void request(streamer_t& streamer, GLuint tex, float uv_per_pixel);
+
+	/**
+	 * Upload finished levels, start loads for this frame's requests and drop levels to stay in
+	 * the budget. Call once per frame from the GL thread, after rendering
+	 * @param streamer
+	 */
+	void update(streamer_t& streamer);
+
+	/**
+	 * Forget a texture, before it is destroyed
+	 * @param streamer
+	 * @param tex - handles the streamer does not know are ignored
+	 */
+	void remove(streamer_t& streamer, GLuint tex);
+} // namespace texture_streamer
+
+#endif // COMP3421_TEXTURE_STREAMER_HPP
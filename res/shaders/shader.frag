@@ -1,28 +1,43 @@
 #version 330 core
 
+// compiled once per material feature set, each feature a #define - see renderer::feature_t.
+// Maps a material does not have are neither declared nor sampled
+
 in vec2 vTexCoord;
 in vec3 vNormal;
 in vec3 vPosition;
 in vec3 vView;
+in vec4 vTint;
+in mat3 vNormalMatrix;
 noperspective in vec2 vScreenCoord;
 
 layout (location = 0) out vec4 fFragColor;
 layout (location = 1) out vec4 BrightColor;
 
+#ifdef DIFFUSE_MAP
 uniform sampler2D uDiffuseMap;
-uniform float uDiffuseMapFactor;
-
+#endif
+#ifdef SPECULAR_MAP
 uniform sampler2D uSpecularMap;
-uniform float uSpecularMapFactor;
-
+#endif
+#ifdef CUBE_MAP
 uniform samplerCube uCubeMap;
-uniform float uCubeMapFactor;
-
+#endif
+#ifdef NORMAL_MAP
 uniform sampler2D uNormalMap;
-uniform float uNormalMapFactor;
+#endif
 
 uniform sampler2D hdrBuffer;
 
+// point lights binned per cluster - see light_clusters. Four texels per light: position and
+// radius, then linear diffuse, ambient and specular
+uniform samplerBuffer uLightData;
+uniform usamplerBuffer uClusterGrid; // offset into uLightIndices and light count, per cluster
+uniform usamplerBuffer uLightIndices;
+
+// the sun's cascades, one layer each - see shadows
+uniform sampler2DArrayShadow uShadowMap;
+
 struct Material {
     vec3 ambient;
     vec4 diffuse;
@@ -47,18 +62,37 @@ struct SpotLight {
 struct PointLight
 {
     vec3 position;
+    float radius;
     vec3 diffuse;
     vec3 ambient;
     vec3 specular;
 };
 
-uniform Material uMat;
-uniform DirLight uSun;
-uniform SpotLight uSpot;
-uniform PointLight uPoint[5];
+// per-frame data, shared with shader.vert - layout mirrors renderer::camera_block_t
+layout (std140) uniform Camera {
+    mat4 uViewProj;
+    vec3 uCameraPos;
+    vec4 uClipPlane;
+    float uNow;
+    vec3 uViewDir;
+    vec4 uClusterDepth; // log-depth to slice scale and bias, slice count
+    vec4 uClusterTiles; // tile size in pixels, tile counts
+};
+
+// layout mirrors renderer::lights_block_t, colours are linear
+layout (std140) uniform Lights {
+    DirLight uSun;
+    SpotLight uSpot;
+    mat4 uShadowMatrices[CASCADES]; // CASCADES is shadows::CASCADES, defined by the renderer
+    vec4 uCascadeEnds;
+};
+
+// layout mirrors renderer::material_block_t
+layout (std140) uniform MaterialBlock {
+    Material uMat;
+    float uCubeMapFactor;
+};
 
-uniform mat4 uModel;
-uniform vec3 uCameraPos;
 uniform bool blinn = true;
 uniform float exposure = 2.0;
 
@@ -74,13 +108,24 @@ vec3 linear_to_sRGB(vec3 col) {
     return pow(col, vec3(1/2.2));
 }
 
-vec3 calc_dir_light(DirLight light, vec3 mat_ambient, vec3 mat_diffuse, vec3 mat_specular, vec3 normal, vec3 view_dir) {
+vec3 calc_dir_light(DirLight light, vec3 mat_ambient, vec3 mat_diffuse, vec3 mat_specular, vec3 normal, vec3 view_dir, float visibility) {
     vec3 ambient = light.ambient * mat_diffuse * mat_ambient;
     vec3 diffuse = light.diffuse * mat_diffuse * max(0, dot(-light.direction, fNormal));
     vec3 reflected = reflect(light.direction, vNormal);
     vec3 halfway = normalize(light.direction + fView);
     vec3 specular = light.specular * mat_specular * pow(max(dot(normal, halfway), 0.0), fShininess);
-    return ambient + diffuse + specular;
+    return ambient + (diffuse + specular) * visibility;
+}
+
+// 1 where the sun reaches the fragment, 0 where it is shadowed, nothing is shadowed past the last cascade
+float sun_visibility(float depth) {
+    for (int i = 0; i < CASCADES; i++) {
+        if (depth < uCascadeEnds[i]) {
+            vec4 coord = uShadowMatrices[i] * vec4(vPosition, 1.0);
+            return texture(uShadowMap, vec4(coord.xy, float(i), coord.z));
+        }
+    }
+    return 1.0;
 }
 
 vec3 calc_spot_light(SpotLight light, vec3 mat_ambient, vec3 mat_diffuse, vec3 mat_specular, vec3 normal, vec3 view_dir) {
@@ -102,10 +147,32 @@ vec3 calc_point_light( PointLight light, vec3 mat_ambient, vec3 mat_diffuse, vec
     vec3 reflected = reflect(light_direction, fNormal);
     vec3 specular = light.specular * mat_specular * pow(max(dot(normal, halfway), 0.0), fShininess);
     float distance = distance(light.position, vPosition);
-    float attenuation = 1.0 / (1.0 + 0.1 * distance);
+    // windowed so the light reaches exactly zero at its radius, past which it is not binned
+    float window = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    float attenuation = 1.0 / (1.0 + 0.1 * distance) * window * window;
     return (ambient + diffuse + specular) * attenuation;
 }
 
+PointLight fetch_point_light(int index) {
+    PointLight light;
+    vec4 position = texelFetch(uLightData, index * 4);
+    light.position = position.xyz;
+    light.radius = position.w;
+    light.diffuse = texelFetch(uLightData, index * 4 + 1).rgb;
+    light.ambient = texelFetch(uLightData, index * 4 + 2).rgb;
+    light.specular = texelFetch(uLightData, index * 4 + 3).rgb;
+    return light;
+}
+
+// the cluster this fragment lies in: its screen tile, and its depth slice
+int find_cluster(float depth) {
+    depth = max(depth, 1e-4);
+    int slice = int(clamp(log(depth) * uClusterDepth.x + uClusterDepth.y, 0.0, uClusterDepth.z - 1.0));
+    ivec2 tiles = ivec2(uClusterTiles.zw);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy / uClusterTiles.xy), tiles - 1);
+    return (slice * tiles.y + tile.y) * tiles.x + tile.x;
+}
+
 void main() {
     fView = normalize(vView);
     vec3 normal = normalize(vNormal);
@@ -115,7 +182,14 @@ void main() {
 
     fShininess = uMat.phongExp;
 
-    fNormal = mix(normalize(vNormal), normalize(mat3(uModel) * (texture(uNormalMap, vTexCoord).xyz * 2.0 - 1.0)), uNormalMapFactor);
+#ifdef NORMAL_MAP
+    // z is rebuilt from x and y, which is all a BC5 normal map keeps - see texture_cache
+    vec2 normal_xy = texture(uNormalMap, vTexCoord).xy * 2.0 - 1.0;
+    vec3 tangent_normal = vec3(normal_xy, sqrt(max(1.0 - dot(normal_xy, normal_xy), 0.0)));
+    fNormal = normalize(vNormalMatrix * tangent_normal);
+#else
+    fNormal = normalize(vNormal);
+#endif
 
 
     vec3 mat_ambient = uMat.ambient;
@@ -125,34 +199,35 @@ void main() {
     vec2 diffuseTexCoord = vTexCoord;
 
 
-    vec4 mat_diffuse = mix(uMat.diffuse, texture(uDiffuseMap, diffuseTexCoord), uDiffuseMapFactor);
+#ifdef DIFFUSE_MAP
+    vec4 mat_diffuse = texture(uDiffuseMap, diffuseTexCoord);
+#else
+    vec4 mat_diffuse = uMat.diffuse;
+#endif
+    mat_diffuse *= vTint;
+#ifdef CUBE_MAP
     // calculate texture direction for cubemap
     vec3 vTexDir = reflect(-fView, fNormal);
     mat_diffuse.rgb = mix(mat_diffuse, texture(uCubeMap, vTexDir), uCubeMapFactor).rgb;
+#endif
     // TODO Part F: mix mat_diffuse with a reflection map using uReflectionMapFactor
     mat_diffuse.rgb = sRGB_to_linear(mat_diffuse.rgb);
 
     // use specular map if given otherwise the material's specular coefficient
-    vec3 mat_specular = mix(uMat.specular, texture(uSpecularMap, vTexCoord).rgb, uSpecularMapFactor);
+#ifdef SPECULAR_MAP
+    vec3 mat_specular = texture(uSpecularMap, vTexCoord).rgb;
+#else
+    vec3 mat_specular = uMat.specular;
+#endif
     mat_specular = sRGB_to_linear(mat_specular);
 
-    DirLight sun = uSun;
-    sun.ambient = sRGB_to_linear(sun.ambient);
-    sun.diffuse = sRGB_to_linear(sun.diffuse);
-    sun.specular = sRGB_to_linear(sun.specular);
-
-    SpotLight spot = uSpot;
-    spot.ambient = sRGB_to_linear(spot.ambient);
-    spot.diffuse = sRGB_to_linear(spot.diffuse);
-    spot.specular = sRGB_to_linear(spot.specular);
-    
-    vec3 shade = calc_dir_light(sun, mat_ambient, mat_diffuse.rgb, mat_specular, normal, view_dir) + calc_spot_light(spot, mat_ambient, mat_diffuse.rgb, mat_specular, normal, view_dir) * 0.01;
-    
-    for (int i = 0; i < 5; i++) {
-        PointLight point = uPoint[i];
-        point.ambient = sRGB_to_linear(point.ambient);
-        point.diffuse = sRGB_to_linear(point.diffuse);
-        point.specular = sRGB_to_linear(point.specular);
+    float depth = dot(vPosition - uCameraPos, uViewDir);
+    vec3 shade = calc_dir_light(uSun, mat_ambient, mat_diffuse.rgb, mat_specular, normal, view_dir, sun_visibility(depth)) + calc_spot_light(uSpot, mat_ambient, mat_diffuse.rgb, mat_specular, normal, view_dir) * 0.01;
+
+    // only the point lights binned into this fragment's cluster can reach it
+    uvec2 cluster = texelFetch(uClusterGrid, find_cluster(depth)).xy;
+    for (uint i = 0u; i < cluster.y; i++) {
+        PointLight point = fetch_point_light(int(texelFetch(uLightIndices, int(cluster.x + i)).r));
         shade += calc_point_light(point, mat_ambient, mat_diffuse.rgb, mat_specular, normal, view_dir) * 0.01;
     }
     shade = linear_to_sRGB(shade);
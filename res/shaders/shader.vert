@@ -1,36 +1,74 @@
 #version 330 core
 
+// compiled once per material feature set, each feature a #define - see renderer::feature_t:
+// DIFFUSE_MAP, SPECULAR_MAP, NORMAL_MAP, CUBE_MAP, HEIGHT_MAP, WATER
+
 layout (location = 0) in vec4 aPos;
 layout (location = 2) in vec2 aTexCoord;
 layout (location = 3) in vec3 aNormal;
+// per-instance attributes, identity and white for plain draws - see mesh::INSTANCE_*_ATTRIB
+layout (location = 4) in mat4 aInstanceModel;
+layout (location = 8) in vec4 aInstanceTint;
 
 out vec2 vTexCoord;
 out vec3 vNormal;
 out vec3 vPosition;
 out vec3 vView;
+out vec4 vTint;
+out mat3 vNormalMatrix;
 noperspective out vec2 vScreenCoord;
 
-uniform mat4 uViewProj;
+// per-frame data, shared with shader.frag - layout mirrors renderer::camera_block_t
+layout (std140) uniform Camera {
+    mat4 uViewProj;
+    vec3 uCameraPos;
+    vec4 uClipPlane;
+    float uNow;
+    vec3 uViewDir;
+    vec4 uClusterDepth; // log-depth to slice scale and bias, slice count
+    vec4 uClusterTiles; // tile size in pixels, tile counts
+};
+
 uniform mat4 uModel;
-uniform vec3 uCameraPos;
-uniform vec4 uClipPlane;
-uniform bool uIsWaterSurface;
-uniform bool uIsWater;
-uniform float uNow;
+uniform vec4 uTexCoordTransform; // offset in xy, scale in zw - places terrain chunks in its uvs
+#ifdef HEIGHT_MAP
 uniform sampler2D uHeightMap;
+#endif
+
+// undo the mesh's vertex format, identity for float vertices - see mesh::vertex_format_t
+uniform vec3 uPositionOffset;
+uniform vec3 uPositionScale;
+uniform bool uOctahedralNormals;
 
 out float gl_ClipDistance[1];
 
+vec3 decode_normal(vec3 n) {
+    if (!uOctahedralNormals) {
+        return n;
+    }
+    // unfold the lower hemisphere from the corners of the octahedral square
+    vec3 v = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));
+    float t = max(-v.z, 0.0);
+    v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+    return normalize(v);
+}
+
 void main() {
-    vTexCoord = aTexCoord;
-    vNormal = normalize(mat3(uModel) * aNormal);
-    vec4 pos = uModel * aPos;
+    mat4 model = uModel * aInstanceModel;
+    vec4 local = vec4(uPositionOffset + aPos.xyz * uPositionScale, 1.0);
+    vTexCoord = uTexCoordTransform.xy + aTexCoord * uTexCoordTransform.zw;
+    vTint = aInstanceTint;
+    vNormalMatrix = mat3(model);
+    vNormal = normalize(vNormalMatrix * decode_normal(aNormal));
+    vec4 pos = model * local;
 
+#ifdef HEIGHT_MAP
     pos.y += texture(uHeightMap, vTexCoord).r;
+#endif
 
-    if (uIsWater || uIsWaterSurface) { // to be deleted
-        pos.y += sin(uNow) * 0.0001;// to be deleted
-    }// to be deleted
+#ifdef WATER // to be deleted
+    pos.y += sin(uNow) * 0.0001;// to be deleted
+#endif // to be deleted
 
 
     vPosition = pos.xyz;
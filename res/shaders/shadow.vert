@@ -0,0 +1,22 @@
+#version 330 core
+
+layout (location = 0) in vec4 aPos;
+layout (location = 2) in vec2 aTexCoord;
+// per-instance transform, identity for plain draws - see mesh::INSTANCE_TRANSFORM_ATTRIB
+layout (location = 4) in mat4 aInstanceModel;
+
+uniform mat4 uLightViewProj;
+uniform mat4 uModel;
+uniform vec4 uTexCoordTransform; // as in shader.vert, places terrain chunks in the height map
+uniform sampler2D uHeightMap;
+
+// undo the mesh's vertex format - see mesh::vertex_format_t
+uniform vec3 uPositionOffset;
+uniform vec3 uPositionScale;
+
+void main() {
+    vec4 local = vec4(uPositionOffset + aPos.xyz * uPositionScale, 1.0);
+    vec4 pos = uModel * aInstanceModel * local;
+    pos.y += texture(uHeightMap, uTexCoordTransform.xy + aTexCoord * uTexCoordTransform.zw).r;
+    gl_Position = uLightViewProj * pos;
+}
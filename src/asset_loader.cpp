@@ -0,0 +1,289 @@
+#include "ass3/asset_loader.hpp"
+#include "ass3/cubemap.hpp"
+#include "ass3/gl_state.hpp"
+#include "ass3/profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	// enough that mapping a PBO rarely waits on the transfer still reading from it
+	const size_t N_PBOS = 4;
+
+	void enqueue(asset_loader::loader_t& loader, std::function<void()> job) {
+		{
+			std::lock_guard<std::mutex> lock(loader.mutex);
+			loader.jobs.push_back(std::move(job));
+			++loader.pending;
+		}
+		loader.wake.notify_one();
+	}
+
+	void push_upload(asset_loader::loader_t& loader, asset_loader::upload_t upload) {
+		std::lock_guard<std::mutex> lock(loader.mutex);
+		loader.uploads.push_back(std::move(upload));
+		++loader.pending;
+	}
+
+	void worker_main(asset_loader::loader_t& loader) {
+		while (true) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(loader.mutex);
+				loader.wake.wait(lock, [&loader] { return loader.stopping || !loader.jobs.empty(); });
+				if (loader.stopping) {
+					return;
+				}
+				job = std::move(loader.jobs.front());
+				loader.jobs.pop_front();
+			}
+			job();
+			std::lock_guard<std::mutex> lock(loader.mutex);
+			--loader.pending;
+		}
+	}
+
+	// copies pixels into the next PBO in the ring and leaves it bound to GL_PIXEL_UNPACK_BUFFER,
+	// so the following glTexImage2D sources from it and returns without waiting for the copy
+	void stage_pixels(asset_loader::loader_t& loader, const texture_2d::image_t& image) {
+		auto size = image.pixels.size();
+		GLuint pbo = loader.pbos[loader.next_pbo];
+		loader.next_pbo = (loader.next_pbo + 1) % loader.pbos.size();
+
+		gl_state::bind_buffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		// orphan the old storage rather than wait for the transfer that may still be using it
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)size, nullptr, GL_STREAM_DRAW);
+		void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+		                             0,
+		                             (GLsizeiptr)size,
+		                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		std::memcpy(dst, image.pixels.data(), size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	// count an upload for a texture as arrived. False if the texture was destroyed while it
+	// loaded, its name is deleted once no upload for it is left
+	bool arrive(asset_loader::loader_t& loader, GLuint texture) {
+		bool live = loader.cancelled.count(texture) == 0;
+		auto found = loader.in_flight.find(texture);
+		if (--found->second == 0) {
+			loader.in_flight.erase(found);
+			if (!live) {
+				loader.cancelled.erase(texture);
+				texture_2d::destroy(texture);
+			}
+		}
+		return live;
+	}
+
+	size_t process(asset_loader::loader_t& loader, asset_loader::upload_t& upload) {
+		switch (upload.kind) {
+			case asset_loader::upload_t::TEXTURE_2D: {
+				if (!arrive(loader, upload.texture)) {
+					texture_cache::close(upload.compressed);
+					return 0;
+				}
+				if (!upload.compressed.levels.empty() && loader.streamer) {
+					return texture_streamer::add(
+					   *loader.streamer, upload.texture, upload.compressed, upload.params);
+				}
+				if (!upload.compressed.levels.empty()) {
+					auto bytes =
+					   texture_cache::upload(upload.texture, upload.compressed, upload.params);
+					texture_cache::close(upload.compressed);
+					return bytes;
+				}
+				const auto& image = upload.image;
+				stage_pixels(loader, image);
+				texture_2d::upload(
+				   upload.texture, image.width, image.height, image.n_channels, nullptr, upload.params);
+				gl_state::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				return image.pixels.size();
+			}
+			case asset_loader::upload_t::CUBEMAP_FACE: {
+				if (!arrive(loader, upload.texture)) {
+					return 0;
+				}
+				const auto& image = upload.image;
+				stage_pixels(loader, image);
+				cubemap::upload_face(
+				   upload.texture, upload.face, image.width, image.height, image.n_channels, nullptr);
+				gl_state::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				return image.pixels.size();
+			}
+			case asset_loader::upload_t::MODEL: {
+				size_t bytes = 0;
+				for (const auto& mesh : upload.model.meshes) {
+					bytes += mesh.vertices_size + mesh::indices_size(mesh);
+				}
+				auto load_texture = upload.load_texture;
+				if (!load_texture) {
+					load_texture = [&loader](const std::string& path) {
+						return asset_loader::load_texture_2d(loader, path);
+					};
+				}
+				auto model = model::upload(upload.model, load_texture);
+				const auto& reports = upload.model.reports;
+				loader.reports.insert(loader.reports.end(), reports.begin(), reports.end());
+				model::release(upload.model);
+				upload.on_model(std::move(model));
+				return bytes;
+			}
+		}
+		return 0;
+	}
+} // namespace
+
+namespace asset_loader {
+	void init(loader_t& loader, unsigned n_workers, size_t upload_budget) {
+		if (n_workers == 0) {
+			// leave a core for the GL thread
+			n_workers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+		}
+		loader.upload_budget = upload_budget;
+
+		loader.pbos.resize(N_PBOS);
+		glGenBuffers((GLsizei)loader.pbos.size(), loader.pbos.data());
+
+		for (unsigned i = 0; i < n_workers; ++i) {
+			loader.workers.emplace_back(worker_main, std::ref(loader));
+		}
+	}
+
+	void destroy(loader_t& loader) {
+		{
+			std::lock_guard<std::mutex> lock(loader.mutex);
+			loader.stopping = true;
+		}
+		loader.wake.notify_all();
+		for (auto& worker : loader.workers) {
+			worker.join();
+		}
+		loader.workers.clear();
+
+		for (auto& upload : loader.uploads) {
+			model::release(upload.model);
+			texture_cache::close(upload.compressed);
+		}
+		loader.uploads.clear();
+		loader.jobs.clear();
+		loader.pending = 0;
+		for (GLuint texture : loader.cancelled) {
+			texture_2d::destroy(texture);
+		}
+		loader.cancelled.clear();
+		loader.in_flight.clear();
+
+		gl_state::delete_buffers((GLsizei)loader.pbos.size(), loader.pbos.data());
+		loader.pbos.clear();
+	}
+
+	GLuint load_texture_2d(loader_t& loader,
+	                       const std::string& path,
+	                       texture_2d::params_t const& params,
+	                       glm::vec4 placeholder) {
+		GLuint tex;
+		glGenTextures(1, &tex);
+
+		// 1x1 stand-in without mipmaps, so it is complete and samples as the placeholder colour
+		unsigned char pixel[4];
+		for (int i = 0; i < 4; ++i) {
+			pixel[i] = (unsigned char)(glm::clamp(placeholder[i], 0.0f, 1.0f) * 255.0f);
+		}
+		texture_2d::upload(tex, 1, 1, 4, pixel, {params.wrap_s, params.wrap_t, GL_LINEAR, GL_LINEAR});
+		++loader.in_flight[tex];
+
+		enqueue(loader, [&loader, tex, path, params] {
+			PROFILE_ZONE("decode texture");
+			auto upload = upload_t{};
+			upload.kind = upload_t::TEXTURE_2D;
+			upload.texture = tex;
+			upload.params = params;
+			texture_cache::load(path, params.content, upload.compressed, upload.image);
+			push_upload(loader, std::move(upload));
+		});
+		return tex;
+	}
+
+	GLuint load_cubemap(loader_t& loader, const std::string& base_path, const std::string& extension) {
+		GLuint cubemap;
+		glGenTextures(1, &cubemap);
+
+		unsigned char pixel[4] = {0, 0, 0, 255};
+		for (int face = 0; face < 6; ++face) {
+			cubemap::upload_face(cubemap, face, 1, 1, 4, pixel);
+		}
+		cubemap::set_params(cubemap);
+		loader.in_flight[cubemap] += 6;
+
+		// one job per face so a single cubemap decodes on several workers
+		for (int face = 0; face < 6; ++face) {
+			enqueue(loader, [&loader, cubemap, face, path = cubemap::face_path(base_path, extension, face)] {
+				PROFILE_ZONE("decode cubemap face");
+				auto upload = upload_t{};
+				upload.kind = upload_t::CUBEMAP_FACE;
+				upload.texture = cubemap;
+				upload.face = face;
+				upload.image = texture_2d::decode(path, false);
+				push_upload(loader, std::move(upload));
+			});
+		}
+		return cubemap;
+	}
+
+	void destroy_texture(loader_t& loader, GLuint texture) {
+		if (loader.streamer) {
+			texture_streamer::remove(*loader.streamer, texture);
+		}
+		if (loader.in_flight.count(texture)) {
+			loader.cancelled.insert(texture);
+			return;
+		}
+		texture_2d::destroy(texture);
+	}
+
+	void load_model(loader_t& loader,
+	                const std::string& path,
+	                std::function<void(model::model_t)> on_ready,
+	                model::texture_loader_t load_texture) {
+		auto job = [&loader,
+		            path,
+		            on_ready = std::move(on_ready),
+		            load_texture = std::move(load_texture)] {
+			PROFILE_ZONE("parse model");
+			auto upload = upload_t{};
+			upload.kind = upload_t::MODEL;
+			upload.model = model::parse(path);
+			upload.load_texture = load_texture;
+			upload.on_model = on_ready;
+			push_upload(loader, std::move(upload));
+		};
+		enqueue(loader, std::move(job));
+	}
+
+	void update(loader_t& loader) {
+		PROFILE_GPU_ZONE("asset uploads");
+		size_t spent = 0;
+		while (true) {
+			auto upload = upload_t{};
+			{
+				std::lock_guard<std::mutex> lock(loader.mutex);
+				if (loader.uploads.empty() || (spent > 0 && spent >= loader.upload_budget)) {
+					break;
+				}
+				upload = std::move(loader.uploads.front());
+				loader.uploads.pop_front();
+			}
+
+			spent += process(loader, upload);
+
+			std::lock_guard<std::mutex> lock(loader.mutex);
+			--loader.pending;
+		}
+	}
+
+	bool idle(loader_t& loader) {
+		std::lock_guard<std::mutex> lock(loader.mutex);
+		return loader.pending == 0;
+	}
+} // namespace asset_loader
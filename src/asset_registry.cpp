@@ -0,0 +1,143 @@
+#include "ass3/asset_registry.hpp"
+
+#include <chicken3421/chicken3421.hpp>
+
+namespace {
+	const char* CUBEMAP_KEY_PREFIX = "cubemap:";
+
+	GLuint acquire(asset_registry::registry_t& registry,
+	               const std::string& key,
+	               const std::function<GLuint()>& load) {
+		auto& entry = registry.textures[key];
+		if (entry.refs++ == 0) {
+			entry.handle = load();
+			registry.texture_keys[entry.handle] = key;
+		}
+		return entry.handle;
+	}
+
+	void free_model(asset_registry::registry_t& registry, asset_registry::model_entry_t& entry) {
+		for (const auto& mesh : entry.model.meshes) {
+			mesh::destroy(mesh);
+		}
+		for (GLuint tex : entry.textures) {
+			asset_registry::release_texture(registry, tex);
+		}
+	}
+} // namespace
+
+namespace asset_registry {
+	void init(registry_t& registry, asset_loader::loader_t& loader) {
+		registry = registry_t{};
+		registry.loader = &loader;
+	}
+
+	void destroy(registry_t& registry) {
+		for (auto& [path, entry] : registry.models) {
+			if (entry.ready) {
+				for (const auto& mesh : entry.model.meshes) {
+					mesh::destroy(mesh);
+				}
+			}
+		}
+		for (auto& [key, entry] : registry.textures) {
+			asset_loader::destroy_texture(*registry.loader, entry.handle);
+		}
+		registry.models.clear();
+		registry.textures.clear();
+		registry.texture_keys.clear();
+	}
+
+	GLuint acquire_texture_2d(registry_t& registry,
+	                          const std::string& path,
+	                          texture_2d::params_t const& params,
+	                          glm::vec4 placeholder) {
+		return acquire(registry, path, [&] {
+			return asset_loader::load_texture_2d(*registry.loader, path, params, placeholder);
+		});
+	}
+
+	GLuint acquire_cubemap(registry_t& registry,
+	                       const std::string& base_path,
+	                       const std::string& extension) {
+		return acquire(registry, CUBEMAP_KEY_PREFIX + base_path + extension, [&] {
+			return asset_loader::load_cubemap(*registry.loader, base_path, extension);
+		});
+	}
+
+	void release_texture(registry_t& registry, GLuint handle) {
+		if (handle == 0) {
+			return;
+		}
+		auto key = registry.texture_keys.find(handle);
+		chicken3421::expect(key != registry.texture_keys.end(),
+		                    "asset_registry: releasing a texture it does not own");
+		auto entry = registry.textures.find(key->second);
+		if (--entry->second.refs == 0) {
+			asset_loader::destroy_texture(*registry.loader, handle);
+			registry.textures.erase(entry);
+			registry.texture_keys.erase(key);
+		}
+	}
+
+	void acquire_model(registry_t& registry,
+	                   const std::string& path,
+	                   std::function<void(model::model_t)> on_ready) {
+		auto& entry = registry.models[path];
+		if (entry.ready) {
+			++entry.refs;
+			on_ready(entry.model);
+			return;
+		}
+
+		++entry.refs;
+		entry.waiting.push_back(std::move(on_ready));
+		if (entry.loading) {
+			return;
+		}
+		entry.loading = true;
+
+		// the callbacks run from asset_loader::update, look the entry up again there
+		auto load_texture = [&registry, path](const std::string& texture_path) {
+			GLuint tex = acquire_texture_2d(registry, texture_path);
+			registry.models[path].textures.push_back(tex);
+			return tex;
+		};
+		asset_loader::load_model(
+		   *registry.loader,
+		   path,
+		   [&registry, path](model::model_t model) {
+			   auto& loaded = registry.models[path];
+			   loaded.model = std::move(model);
+			   loaded.loading = false;
+			   loaded.ready = true;
+			   if (loaded.refs == 0) {
+				   // every acquirer let go before it finished loading
+				   free_model(registry, loaded);
+				   registry.models.erase(path);
+				   return;
+			   }
+			   auto waiting = std::move(loaded.waiting);
+			   for (auto& callback : waiting) {
+				   callback(loaded.model);
+			   }
+		   },
+		   load_texture);
+	}
+
+	void release_model(registry_t& registry, const std::string& path) {
+		auto entry = registry.models.find(path);
+		chicken3421::expect(entry != registry.models.end() && entry->second.refs > 0,
+		                    "asset_registry: releasing a model it does not own: " + path);
+		if (--entry->second.refs > 0) {
+			return;
+		}
+		if (!entry->second.ready) {
+			// freed by the load callback once it lands
+			entry->second.waiting.clear();
+			return;
+		}
+		free_model(registry, entry->second);
+		registry.models.erase(entry);
+	}
+} // namespace asset_registry
@@ -0,0 +1,271 @@
+#include "ass3/benchmark.hpp"
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <chicken3421/chicken3421.hpp>
+
+#include "ass3/gl_state.hpp"
+
+namespace {
+	// the orbit path: seconds per loop, its radius and height around the origin
+	const float ORBIT_PERIOD = 10.0f;
+	const float ORBIT_RADIUS = 30.0f;
+	const float ORBIT_HEIGHT = 10.0f;
+	const int ORBIT_KEYFRAMES = 16;
+
+	std::vector<int> parse_frame_list(const std::string& list) {
+		std::vector<int> frames;
+		std::istringstream in(list);
+		std::string item;
+		while (std::getline(in, item, ',')) {
+			frames.push_back(std::stoi(item));
+		}
+		return frames;
+	}
+
+	// read back the default framebuffer, bottom row last as PPM wants it
+	void save_ppm(const std::string& path, int width, int height) {
+		auto row = (size_t)width * 3;
+		std::vector<unsigned char> pixels(row * (size_t)height);
+		gl_state::bind_framebuffer(GL_READ_FRAMEBUFFER, 0);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		chicken3421::expect(out.good(), "benchmark: could not write " + path);
+		out << "P6\n" << width << " " << height << "\n255\n";
+		for (auto y = (size_t)height; y-- > 0;) {
+			out.write((const char*)&pixels[y * row], (std::streamsize)row);
+		}
+	}
+
+	struct summary_t {
+		double avg = 0.0;
+		double p50 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+
+	summary_t summarise(std::vector<double> values) {
+		auto summary = summary_t{};
+		if (values.empty()) {
+			return summary;
+		}
+		std::sort(values.begin(), values.end());
+		for (auto value : values) {
+			summary.avg += value / (double)values.size();
+		}
+		auto rank = [&](double p) { return values[(size_t)(p * (double)(values.size() - 1) + 0.5)]; };
+		summary.p50 = rank(0.5);
+		summary.p99 = rank(0.99);
+		summary.max = values.back();
+		return summary;
+	}
+
+	void write_summary(std::ostream& out, const char* name, const summary_t& summary) {
+		out << "    \"" << name << "\": {\"avg\": " << summary.avg << ", \"p50\": " << summary.p50
+		    << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << "}";
+	}
+
+	void write_report(const benchmark::options_t& options,
+	                  const std::vector<benchmark::frame_t>& frames) {
+		std::vector<double> cpu;
+		std::vector<double> gpu;
+		for (const auto& frame : frames) {
+			cpu.push_back(frame.cpu_ms);
+			gpu.push_back(frame.gpu_ms);
+		}
+
+		std::ofstream out(options.output, std::ios::trunc);
+		chicken3421::expect(out.good(), "benchmark: could not write " + options.output);
+		auto gl_renderer = (const char*)glGetString(GL_RENDERER);
+		out << "{\n";
+		out << "  \"renderer\": \"" << (gl_renderer ? gl_renderer : "unknown") << "\",\n";
+		out << "  \"width\": " << options.width << ",\n";
+		out << "  \"height\": " << options.height << ",\n";
+		out << "  \"frames\": " << frames.size() << ",\n";
+		out << "  \"summary\": {\n";
+		write_summary(out, "cpu_ms", summarise(cpu));
+		out << ",\n";
+		write_summary(out, "gpu_ms", summarise(gpu));
+		out << "\n  },\n";
+		out << "  \"per_frame\": [\n";
+		for (auto i = size_t{0}; i < frames.size(); ++i) {
+			const auto& frame = frames[i];
+			out << "    {\"frame\": " << i << ", \"cpu_ms\": " << frame.cpu_ms
+			    << ", \"gpu_ms\": " << frame.gpu_ms << ", \"draw_calls\": " << frame.draw_calls
+			    << ", \"triangles\": " << frame.triangles << ", \"gl_calls\": " << frame.gl_calls
+			    << ", \"gl_elided\": " << frame.gl_elided << "}"
+			    << (i + 1 < frames.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+} // namespace
+
+namespace benchmark {
+	bool parse_args(int argc, char** argv, options_t& options) {
+		bool enabled = false;
+		for (int i = 1; i < argc; ++i) {
+			auto arg = std::string(argv[i]);
+			if (arg == "--benchmark") {
+				enabled = true;
+				continue;
+			}
+			chicken3421::expect(i + 1 < argc, "benchmark: " + arg + " needs a value");
+			auto value = std::string(argv[++i]);
+			if (arg == "--path") {
+				options.path = value;
+			}
+			else if (arg == "--frames") {
+				options.frames = std::stoi(value);
+			}
+			else if (arg == "--time-step") {
+				options.time_step = std::stof(value);
+			}
+			else if (arg == "--size") {
+				auto x = value.find('x');
+				chicken3421::expect(x != std::string::npos, "benchmark: --size takes WIDTHxHEIGHT");
+				options.width = std::stoi(value.substr(0, x));
+				options.height = std::stoi(value.substr(x + 1));
+			}
+			else if (arg == "--output") {
+				options.output = value;
+			}
+			else if (arg == "--dump") {
+				options.dumps = parse_frame_list(value);
+			}
+			else if (arg == "--dump-prefix") {
+				options.dump_prefix = value;
+			}
+			else if (arg == "--record") {
+				options.record = value;
+			}
+			else if (arg == "--trace") {
+				options.trace = value;
+			}
+			else if (arg == "--texture-budget") {
+				// in MiB
+				options.texture_budget = std::stoul(value) << 20;
+			}
+			else {
+				chicken3421::expect(false, "benchmark: unknown option " + arg);
+			}
+		}
+		chicken3421::expect(options.frames > 0 && options.width > 0 && options.height > 0,
+		                    "benchmark: frames and size have to be positive");
+		return enabled;
+	}
+
+	std::vector<keyframe_t> load_path(const std::string& path) {
+		std::ifstream file(path);
+		chicken3421::expect(file.good(), "benchmark: could not open camera path " + path);
+
+		std::vector<keyframe_t> keyframes;
+		std::string line;
+		while (std::getline(file, line)) {
+			if (line.empty() || line[0] == '#') {
+				continue;
+			}
+			auto keyframe = keyframe_t{};
+			auto& camera = keyframe.camera;
+			std::istringstream in(line);
+			in >> keyframe.time >> camera.pos.x >> camera.pos.y >> camera.pos.z >> camera.yaw
+			   >> camera.pitch;
+			chicken3421::expect(!in.fail(), "benchmark: bad keyframe in " + path + ": " + line);
+			keyframes.push_back(keyframe);
+		}
+		chicken3421::expect(!keyframes.empty(), "benchmark: camera path " + path + " is empty");
+		std::stable_sort(keyframes.begin(),
+		                 keyframes.end(),
+		                 [](const keyframe_t& a, const keyframe_t& b) { return a.time < b.time; });
+		return keyframes;
+	}
+
+	std::vector<keyframe_t> orbit_path() {
+		std::vector<keyframe_t> keyframes;
+		for (int i = 0; i <= ORBIT_KEYFRAMES; ++i) {
+			auto t = (float)i / ORBIT_KEYFRAMES;
+			auto angle = t * glm::two_pi<float>();
+			auto position = glm::vec3(
+			   ORBIT_RADIUS * std::sin(angle), ORBIT_HEIGHT, ORBIT_RADIUS * std::cos(angle));
+			auto keyframe = keyframe_t{t * ORBIT_PERIOD, euler_camera::make_camera(position, {})};
+			// keep the yaw continuous where atan2 wraps, so interpolation goes the short way
+			if (!keyframes.empty()) {
+				auto previous = keyframes.back().camera.yaw;
+				keyframe.camera.yaw -= 360.0f * std::round((keyframe.camera.yaw - previous) / 360.0f);
+			}
+			keyframes.push_back(keyframe);
+		}
+		return keyframes;
+	}
+
+	euler_camera::camera_t sample(const std::vector<keyframe_t>& path, float time) {
+		auto next = std::upper_bound(
+		   path.begin(), path.end(), time, [](float t, const keyframe_t& k) { return t < k.time; });
+		if (next == path.begin()) {
+			return path.front().camera;
+		}
+		if (next == path.end()) {
+			return path.back().camera;
+		}
+		const auto& a = *(next - 1);
+		const auto& b = *next;
+		auto t = (time - a.time) / (b.time - a.time);
+		auto camera = euler_camera::camera_t{};
+		camera.pos = glm::mix(a.camera.pos, b.camera.pos, t);
+		camera.yaw = glm::mix(a.camera.yaw, b.camera.yaw, t);
+		camera.pitch = glm::mix(a.camera.pitch, b.camera.pitch, t);
+		return camera;
+	}
+
+	void record(std::ostream& out, float time, const euler_camera::camera_t& camera) {
+		out << time << " " << camera.pos.x << " " << camera.pos.y << " " << camera.pos.z << " "
+		    << camera.yaw << " " << camera.pitch << "\n";
+	}
+
+	std::vector<frame_t> run(const options_t& options,
+	                         const std::vector<keyframe_t>& path,
+	                         const renderer::renderer_t& renderer,
+	                         const std::function<void(const euler_camera::camera_t&, float)>& draw_frame) {
+		// one query per frame, only read once every frame is submitted so none of them stall
+		auto n = (size_t)options.frames;
+		std::vector<GLuint> queries(n);
+		glGenQueries((GLsizei)n, queries.data());
+		std::vector<frame_t> frames(n);
+
+		for (auto i = size_t{0}; i < n; ++i) {
+			auto time = (float)i * options.time_step;
+			auto start = std::chrono::steady_clock::now();
+			glBeginQuery(GL_TIME_ELAPSED, queries[i]);
+			draw_frame(sample(path, time), time);
+			glEndQuery(GL_TIME_ELAPSED);
+			auto cpu = std::chrono::steady_clock::now() - start;
+
+			auto& frame = frames[i];
+			frame.cpu_ms = std::chrono::duration<double, std::milli>(cpu).count();
+			frame.draw_calls = renderer.stats.draw_calls;
+			frame.triangles = renderer.stats.triangles;
+			frame.gl_calls = gl_state::stats().total_issued;
+			frame.gl_elided = gl_state::stats().total_elided;
+			if (std::find(options.dumps.begin(), options.dumps.end(), (int)i) != options.dumps.end()) {
+				save_ppm(options.dump_prefix + std::to_string(i) + ".ppm", options.width, options.height);
+			}
+		}
+
+		for (auto i = size_t{0}; i < n; ++i) {
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+			frames[i].gpu_ms = (double)elapsed / 1e6;
+		}
+		glDeleteQueries((GLsizei)n, queries.data());
+
+		write_report(options, frames);
+		return frames;
+	}
+} // namespace benchmark
@@ -0,0 +1,128 @@
+#include "ass3/bounds.hpp"
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BOUNDS_SSE 1
+#endif
+
+namespace bounds {
+	bool empty(const aabb_t& box) {
+		return box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z;
+	}
+
+	aabb_t from_points(const glm::vec3* positions, size_t count) {
+		auto box = aabb_t{};
+		for (size_t i = 0; i < count; ++i) {
+			box.min = glm::min(box.min, positions[i]);
+			box.max = glm::max(box.max, positions[i]);
+		}
+		return box;
+	}
+
+	aabb_t merge(const aabb_t& a, const aabb_t& b) {
+		return aabb_t{glm::min(a.min, b.min), glm::max(a.max, b.max)};
+	}
+
+	aabb_t transform(const aabb_t& box, const glm::mat4& transform) {
+		if (empty(box)) {
+			return box;
+		}
+		// transform the centre, and the extents by the absolute linear part
+		auto center = (box.min + box.max) * 0.5f;
+		auto extent = (box.max - box.min) * 0.5f;
+		auto world_center = glm::vec3(transform * glm::vec4(center, 1.0f));
+		auto world_extent = glm::vec3(0.0f);
+		for (int col = 0; col < 3; ++col) {
+			world_extent += glm::abs(glm::vec3(transform[col])) * extent[col];
+		}
+		return aabb_t{world_center - world_extent, world_center + world_extent};
+	}
+
+	sphere_t enclosing_sphere(const aabb_t& box) {
+		if (empty(box)) {
+			return sphere_t{};
+		}
+		return sphere_t{(box.min + box.max) * 0.5f, glm::length(box.max - box.min) * 0.5f};
+	}
+
+	frustum_t make_frustum(const glm::mat4& view_proj) {
+		auto row = [&view_proj](int i) {
+			return glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]);
+		};
+		glm::vec4 planes[6] = {
+		   row(3) + row(0),
+		   row(3) - row(0),
+		   row(3) + row(1),
+		   row(3) - row(1),
+		   row(3) + row(2),
+		   row(3) - row(2),
+		};
+
+		auto frustum = frustum_t{};
+		for (int i = 0; i < 6; ++i) {
+			auto plane = planes[i] / glm::length(glm::vec3(planes[i]));
+			frustum.a[i] = plane.x;
+			frustum.b[i] = plane.y;
+			frustum.c[i] = plane.z;
+			frustum.d[i] = plane.w;
+		}
+		return frustum;
+	}
+
+	void test_spheres(const frustum_t& frustum,
+	                  const float* x,
+	                  const float* y,
+	                  const float* z,
+	                  const float* radius,
+	                  size_t count,
+	                  uint8_t* visible) {
+		size_t i = 0;
+#ifdef BOUNDS_SSE
+		for (; i + 4 <= count; i += 4) {
+			__m128 cx = _mm_loadu_ps(x + i);
+			__m128 cy = _mm_loadu_ps(y + i);
+			__m128 cz = _mm_loadu_ps(z + i);
+			__m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+			__m128 outside = _mm_setzero_ps();
+			for (int p = 0; p < 6; ++p) {
+				__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustum.a[p]), cx),
+				                                    _mm_mul_ps(_mm_set1_ps(frustum.b[p]), cy)),
+				                         _mm_add_ps(_mm_mul_ps(_mm_set1_ps(frustum.c[p]), cz),
+				                                    _mm_set1_ps(frustum.d[p])));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, neg_r));
+			}
+			int mask = _mm_movemask_ps(outside);
+			for (int k = 0; k < 4; ++k) {
+				visible[i + (size_t)k] = (mask >> k & 1) ? 0 : 1;
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; ++p) {
+				float dist = frustum.a[p] * x[i] + frustum.b[p] * y[i] + frustum.c[p] * z[i]
+				             + frustum.d[p];
+				inside = !(dist < -radius[i]);
+			}
+			visible[i] = inside ? 1 : 0;
+		}
+	}
+
+	bool test_aabb(const frustum_t& frustum, const aabb_t& box) {
+		if (empty(box)) {
+			return false;
+		}
+		for (int p = 0; p < 6; ++p) {
+			// the corner furthest along the plane normal
+			float px = frustum.a[p] >= 0 ? box.max.x : box.min.x;
+			float py = frustum.b[p] >= 0 ? box.max.y : box.min.y;
+			float pz = frustum.c[p] >= 0 ? box.max.z : box.min.z;
+			if (frustum.a[p] * px + frustum.b[p] * py + frustum.c[p] * pz + frustum.d[p] < 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+} // namespace bounds
@@ -0,0 +1,82 @@
+#include "ass3/cache_file.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+
+namespace cache_file {
+	uint64_t hash_bytes(const void* data, size_t size, uint64_t hash) {
+		auto bytes = static_cast<const unsigned char*>(data);
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	bool stat_source(const std::string& path, source_info_t& info) {
+		std::error_code ec;
+		auto size = std::filesystem::file_size(path, ec);
+		if (ec) {
+			return false;
+		}
+		auto mtime = std::filesystem::last_write_time(path, ec);
+		if (ec) {
+			return false;
+		}
+		info.size = size;
+		info.mtime = (int64_t)mtime.time_since_epoch().count();
+		return true;
+	}
+
+	bool hash_source(const std::string& path, uint64_t& hash) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			return false;
+		}
+		std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		hash = hash_bytes(bytes.data(), bytes.size());
+		return true;
+	}
+
+	bool source_unchanged(const std::string& path, const source_info_t& cached) {
+		auto current = source_info_t{};
+		if (!stat_source(path, current) || current.size != cached.size) {
+			return false;
+		}
+		if (current.mtime == cached.mtime) {
+			return true;
+		}
+		return hash_source(path, current.hash) && current.hash == cached.hash;
+	}
+
+	bool write(const std::string& path,
+	           const char* name,
+	           const std::function<void(std::ofstream&)>& write_contents) {
+		auto tmp_path = path + ".tmp";
+		{
+			std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+			if (!out) {
+				std::cerr << name << ": cannot write " << tmp_path << std::endl;
+				return false;
+			}
+			write_contents(out);
+			if (!out) {
+				std::cerr << name << ": failed writing " << tmp_path << std::endl;
+				out.close();
+				std::remove(tmp_path.c_str());
+				return false;
+			}
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tmp_path, path, ec);
+		if (ec) {
+			std::cerr << name << ": cannot replace " << path << ": " << ec.message() << std::endl;
+			std::remove(tmp_path.c_str());
+			return false;
+		}
+		return true;
+	}
+} // namespace cache_file
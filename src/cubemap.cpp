@@ -3,6 +3,7 @@
 #include <chicken3421/chicken3421.hpp>
 
 #include <ass3/cubemap.hpp>
+#include <ass3/gl_state.hpp>
 
 namespace {
 	const char* side_suffices[] = {"_right", "_left", "_top", "_bottom", "_front", "_back"};
@@ -12,24 +13,42 @@ namespace cubemap {
 	GLuint make_cubemap(const std::string& base_path, const std::string& extension) {
 		GLuint cubemap;
 		glGenTextures(1, &cubemap);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
 
-		for (auto i = size_t{0}; i < 6; ++i) {
+		for (int i = 0; i < 6; ++i) {
 			chicken3421::image_t image =
-			   chicken3421::load_image(base_path + side_suffices[i] + extension, false);
-			GLenum format = image.n_channels == 3 ? GL_RGB : GL_RGBA;
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-			             0,
-			             format,
-			             image.width,
-			             image.height,
-			             0,
-			             format,
-			             GL_UNSIGNED_BYTE,
-			             image.data);
+			   chicken3421::load_image(face_path(base_path, extension, i), false);
+			upload_face(cubemap, i, image.width, image.height, image.n_channels, image.data);
 			chicken3421::delete_image(image);
 		}
 
+		set_params(cubemap);
+		return cubemap;
+	}
+
+	std::string face_path(const std::string& base_path, const std::string& extension, int face) {
+		return base_path + side_suffices[face] + extension;
+	}
+
+	void
+	upload_face(GLuint cubemap, int face, int width, int height, int n_channels, const void* data) {
+		gl_state::bind_texture(0, GL_TEXTURE_CUBE_MAP, cubemap);
+		GLenum format = n_channels == 3 ? GL_RGB : GL_RGBA;
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum)face,
+		             0,
+		             (GLint)format,
+		             width,
+		             height,
+		             0,
+		             format,
+		             GL_UNSIGNED_BYTE,
+		             data);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+
+	void set_params(GLuint cubemap) {
+		gl_state::bind_texture(0, GL_TEXTURE_CUBE_MAP, cubemap);
+
 		// wrap options
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -37,8 +56,5 @@ namespace cubemap {
 		// mag/min options
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-		return cubemap;
 	}
 } // namespace cubemap
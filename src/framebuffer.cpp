@@ -1,5 +1,6 @@
 #include "ass3/framebuffer.hpp"
 #include "ass3/texture_2d.hpp"
+#include "ass3/gl_state.hpp"
 #include <glad/glad.h>
 #include <iostream>
 namespace framebuffer {
@@ -8,7 +9,7 @@ namespace framebuffer {
         glGenFramebuffers(1, &fbo);
 
         glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        gl_state::bind_texture(0, GL_TEXTURE_2D, texture);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -19,20 +20,20 @@ namespace framebuffer {
         glBindRenderbuffer(GL_RENDERBUFFER, rbo);
         glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
         // attach buffers
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        gl_state::bind_framebuffer(GL_FRAMEBUFFER, fbo);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
         glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo);
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
             std::cout << "Framebuffer not complete!" << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        gl_state::bind_framebuffer(GL_FRAMEBUFFER, 0);
         
         return {fbo, texture, rbo};
     }
 
     void delete_framebuffer(framebuffer_t &framebuffer) {
-        glDeleteFramebuffers(1, &framebuffer.fbo);
+        gl_state::delete_framebuffers(1, &framebuffer.fbo);
         glDeleteRenderbuffers(1, &framebuffer.rbo);
-        glDeleteTextures(1, &framebuffer.texture);
+        gl_state::delete_textures(1, &framebuffer.texture);
     }
 
 } // namespace framebuffer
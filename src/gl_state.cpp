@@ -0,0 +1,347 @@
+#include "ass3/gl_state.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+
+namespace {
+	const GLuint UNKNOWN = ~GLuint{0};
+	const GLenum UNKNOWN_ENUM = ~GLenum{0};
+
+	const GLenum BUFFER_TARGETS[] = {GL_ARRAY_BUFFER,
+	                                 GL_ELEMENT_ARRAY_BUFFER,
+	                                 GL_UNIFORM_BUFFER,
+	                                 GL_TEXTURE_BUFFER,
+	                                 GL_PIXEL_PACK_BUFFER,
+	                                 GL_PIXEL_UNPACK_BUFFER,
+	                                 GL_COPY_READ_BUFFER,
+	                                 GL_COPY_WRITE_BUFFER};
+	const size_t N_BUFFER_TARGETS = sizeof(BUFFER_TARGETS) / sizeof(BUFFER_TARGETS[0]);
+
+	const GLenum TEXTURE_TARGETS[] = {
+	   GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BUFFER, GL_TEXTURE_3D};
+	const size_t N_TEXTURE_TARGETS = sizeof(TEXTURE_TARGETS) / sizeof(TEXTURE_TARGETS[0]);
+
+	const GLenum CAPABILITIES[] = {GL_DEPTH_TEST,
+	                               GL_CULL_FACE,
+	                               GL_BLEND,
+	                               GL_POLYGON_OFFSET_FILL,
+	                               GL_CLIP_DISTANCE0,
+	                               GL_SCISSOR_TEST,
+	                               GL_STENCIL_TEST,
+	                               GL_FRAMEBUFFER_SRGB};
+	const size_t N_CAPABILITIES = sizeof(CAPABILITIES) / sizeof(CAPABILITIES[0]);
+
+	struct state_t {
+		GLuint program = UNKNOWN;
+		GLuint vao = UNKNOWN;
+		GLuint buffers[N_BUFFER_TARGETS];
+		GLuint active_unit = UNKNOWN;
+		GLuint textures[gl_state::MAX_TEXTURE_UNITS][N_TEXTURE_TARGETS];
+		GLuint draw_framebuffer = UNKNOWN;
+		GLuint read_framebuffer = UNKNOWN;
+		GLint viewport[4] = {};
+		bool viewport_known = false;
+		int8_t capabilities[N_CAPABILITIES]; // -1 unknown
+		int depth_mask = -1;
+		GLenum depth_func = UNKNOWN_ENUM;
+		GLenum front_face = UNKNOWN_ENUM;
+		GLenum cull_face = UNKNOWN_ENUM;
+		GLenum blend_src = UNKNOWN_ENUM;
+		GLenum blend_dst = UNKNOWN_ENUM;
+		GLfloat offset_factor = 0.0f;
+		GLfloat offset_units = 0.0f;
+		bool offset_known = false;
+
+		state_t() {
+			std::fill(std::begin(buffers), std::end(buffers), UNKNOWN);
+			for (auto& unit : textures) {
+				std::fill(std::begin(unit), std::end(unit), UNKNOWN);
+			}
+			std::fill(std::begin(capabilities), std::end(capabilities), int8_t{-1});
+		}
+	};
+
+	state_t state;
+	gl_state::stats_t counters;
+
+	// index of a value in a table, or its size when it is not there
+	template <size_t N>
+	size_t find(const GLenum (&table)[N], GLenum value) {
+		return (size_t)(std::find(std::begin(table), std::end(table), value) - std::begin(table));
+	}
+
+	void issue(gl_state::call_t call) {
+		++counters.issued[call];
+		++counters.total_issued;
+	}
+
+	void elide(gl_state::call_t call) {
+		++counters.elided[call];
+		++counters.total_elided;
+	}
+
+	// count the call and bring the shadow copy up to date, true if it has to reach GL
+	template <typename T>
+	bool change(T& shadow, T value, gl_state::call_t call) {
+		if (shadow == value) {
+			elide(call);
+			return false;
+		}
+		shadow = value;
+		issue(call);
+		return true;
+	}
+
+	void active_texture(GLuint unit) {
+		if (change(state.active_unit, unit, gl_state::ACTIVE_TEXTURE)) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+		}
+	}
+
+	void set_capability(GLenum capability, bool enabled) {
+		auto i = find(CAPABILITIES, capability);
+		if (i == N_CAPABILITIES) {
+			issue(gl_state::CAPABILITY);
+		}
+		else if (!change(state.capabilities[i], (int8_t)enabled, gl_state::CAPABILITY)) {
+			return;
+		}
+		if (enabled) {
+			glEnable(capability);
+		}
+		else {
+			glDisable(capability);
+		}
+	}
+
+	// a deleted name is unbound everywhere it was bound
+	void forget(GLuint& shadow, GLuint name) {
+		if (shadow == name) {
+			shadow = 0;
+		}
+	}
+} // namespace
+
+namespace gl_state {
+	void invalidate() {
+		state = state_t{};
+	}
+
+	void begin_frame() {
+		counters = stats_t{};
+	}
+
+	const stats_t& stats() {
+		return counters;
+	}
+
+	void use_program(GLuint program) {
+		if (change(state.program, program, PROGRAM)) {
+			glUseProgram(program);
+		}
+	}
+
+	void bind_vertex_array(GLuint vao) {
+		if (change(state.vao, vao, VERTEX_ARRAY)) {
+			glBindVertexArray(vao);
+			state.buffers[find(BUFFER_TARGETS, GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+		}
+	}
+
+	void bind_buffer(GLenum target, GLuint buffer) {
+		auto i = find(BUFFER_TARGETS, target);
+		if (i == N_BUFFER_TARGETS) {
+			issue(BUFFER);
+		}
+		else if (!change(state.buffers[i], buffer, BUFFER)) {
+			return;
+		}
+		glBindBuffer(target, buffer);
+	}
+
+	void bind_buffer_base(GLenum target, GLuint index, GLuint buffer) {
+		issue(BUFFER);
+		glBindBufferBase(target, index, buffer);
+		auto i = find(BUFFER_TARGETS, target);
+		if (i != N_BUFFER_TARGETS) {
+			state.buffers[i] = buffer;
+		}
+	}
+
+	void bind_texture(GLuint unit, GLenum target, GLuint texture) {
+		auto i = find(TEXTURE_TARGETS, target);
+		if (unit >= MAX_TEXTURE_UNITS || i == N_TEXTURE_TARGETS) {
+			issue(TEXTURE);
+			state.active_unit = unit;
+			glActiveTexture(GL_TEXTURE0 + unit);
+			glBindTexture(target, texture);
+			return;
+		}
+		if (change(state.textures[unit][i], texture, TEXTURE)) {
+			active_texture(unit);
+			glBindTexture(target, texture);
+		}
+	}
+
+	void bind_framebuffer(GLenum target, GLuint framebuffer) {
+		bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+		bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+		if ((!draw || state.draw_framebuffer == framebuffer)
+		    && (!read || state.read_framebuffer == framebuffer)) {
+			elide(FRAMEBUFFER);
+			return;
+		}
+		issue(FRAMEBUFFER);
+		if (draw) {
+			state.draw_framebuffer = framebuffer;
+		}
+		if (read) {
+			state.read_framebuffer = framebuffer;
+		}
+		glBindFramebuffer(target, framebuffer);
+	}
+
+	GLuint framebuffer(GLenum target) {
+		auto& shadow = target == GL_READ_FRAMEBUFFER ? state.read_framebuffer
+		                                             : state.draw_framebuffer;
+		if (shadow == UNKNOWN) {
+			GLint binding = 0;
+			glGetIntegerv(target == GL_READ_FRAMEBUFFER ? GL_READ_FRAMEBUFFER_BINDING
+			                                            : GL_DRAW_FRAMEBUFFER_BINDING,
+			              &binding);
+			shadow = (GLuint)binding;
+		}
+		return shadow;
+	}
+
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+		const GLint wanted[4] = {x, y, width, height};
+		if (state.viewport_known && std::equal(wanted, wanted + 4, state.viewport)) {
+			elide(VIEWPORT);
+			return;
+		}
+		issue(VIEWPORT);
+		std::copy(wanted, wanted + 4, state.viewport);
+		state.viewport_known = true;
+		glViewport(x, y, width, height);
+	}
+
+	void get_viewport(GLint out[4]) {
+		if (!state.viewport_known) {
+			glGetIntegerv(GL_VIEWPORT, state.viewport);
+			state.viewport_known = true;
+		}
+		std::copy(state.viewport, state.viewport + 4, out);
+	}
+
+	void enable(GLenum capability) {
+		set_capability(capability, true);
+	}
+
+	void disable(GLenum capability) {
+		set_capability(capability, false);
+	}
+
+	bool is_enabled(GLenum capability) {
+		auto i = find(CAPABILITIES, capability);
+		if (i == N_CAPABILITIES) {
+			return glIsEnabled(capability);
+		}
+		if (state.capabilities[i] < 0) {
+			state.capabilities[i] = glIsEnabled(capability) ? 1 : 0;
+		}
+		return state.capabilities[i] != 0;
+	}
+
+	void depth_mask(GLboolean mask) {
+		if (change(state.depth_mask, (int)mask, DEPTH_MASK)) {
+			glDepthMask(mask);
+		}
+	}
+
+	void depth_func(GLenum func) {
+		if (change(state.depth_func, func, DEPTH_FUNC)) {
+			glDepthFunc(func);
+		}
+	}
+
+	void front_face(GLenum mode) {
+		if (change(state.front_face, mode, FRONT_FACE)) {
+			glFrontFace(mode);
+		}
+	}
+
+	void cull_face(GLenum mode) {
+		if (change(state.cull_face, mode, CULL_FACE)) {
+			glCullFace(mode);
+		}
+	}
+
+	void blend_func(GLenum src, GLenum dst) {
+		if (state.blend_src == src && state.blend_dst == dst) {
+			elide(BLEND_FUNC);
+			return;
+		}
+		issue(BLEND_FUNC);
+		state.blend_src = src;
+		state.blend_dst = dst;
+		glBlendFunc(src, dst);
+	}
+
+	void polygon_offset(GLfloat factor, GLfloat units) {
+		if (state.offset_known && state.offset_factor == factor && state.offset_units == units) {
+			elide(POLYGON_OFFSET);
+			return;
+		}
+		issue(POLYGON_OFFSET);
+		state.offset_factor = factor;
+		state.offset_units = units;
+		state.offset_known = true;
+		glPolygonOffset(factor, units);
+	}
+
+	void delete_program(GLuint program) {
+		// the current program outlives its deletion until something else is used, so the shadowed
+		// binding still holds
+		glDeleteProgram(program);
+	}
+
+	void delete_vertex_arrays(GLsizei n, const GLuint* vaos) {
+		for (GLsizei i = 0; i < n; ++i) {
+			if (state.vao == vaos[i]) {
+				state.vao = 0;
+				state.buffers[find(BUFFER_TARGETS, GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+			}
+		}
+		glDeleteVertexArrays(n, vaos);
+	}
+
+	void delete_buffers(GLsizei n, const GLuint* buffers) {
+		for (GLsizei i = 0; i < n; ++i) {
+			for (auto& shadow : state.buffers) {
+				forget(shadow, buffers[i]);
+			}
+		}
+		glDeleteBuffers(n, buffers);
+	}
+
+	void delete_textures(GLsizei n, const GLuint* textures) {
+		for (GLsizei i = 0; i < n; ++i) {
+			for (auto& unit : state.textures) {
+				for (auto& shadow : unit) {
+					forget(shadow, textures[i]);
+				}
+			}
+		}
+		glDeleteTextures(n, textures);
+	}
+
+	void delete_framebuffers(GLsizei n, const GLuint* framebuffers) {
+		for (GLsizei i = 0; i < n; ++i) {
+			forget(state.draw_framebuffer, framebuffers[i]);
+			forget(state.read_framebuffer, framebuffers[i]);
+		}
+		glDeleteFramebuffers(n, framebuffers);
+	}
+} // namespace gl_state
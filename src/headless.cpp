@@ -0,0 +1,116 @@
+#include "ass3/headless.hpp"
+
+#include <glad/glad.h>
+
+#include <chicken3421/chicken3421.hpp>
+
+#ifdef ASS3_HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+namespace {
+	// the surfaceless platform needs no display server, other platforms are the fallback
+	EGLDisplay open_display() {
+		auto get_platform_display =
+		   (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (get_platform_display) {
+			auto display =
+			   get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+			if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) {
+				return display;
+			}
+		}
+		auto display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		chicken3421::expect(display != EGL_NO_DISPLAY, "headless: no EGL display");
+		chicken3421::expect(eglInitialize(display, nullptr, nullptr), "headless: EGL failed to start");
+		return display;
+	}
+} // namespace
+
+namespace headless {
+	context_t init(int width, int height) {
+		auto headless = context_t{};
+		headless.width = width;
+		headless.height = height;
+		EGLDisplay display = open_display();
+		headless.display = display;
+
+		const EGLint config_attribs[] = {EGL_SURFACE_TYPE,
+		                                 EGL_PBUFFER_BIT,
+		                                 EGL_RENDERABLE_TYPE,
+		                                 EGL_OPENGL_BIT,
+		                                 EGL_RED_SIZE,
+		                                 8,
+		                                 EGL_GREEN_SIZE,
+		                                 8,
+		                                 EGL_BLUE_SIZE,
+		                                 8,
+		                                 EGL_ALPHA_SIZE,
+		                                 8,
+		                                 EGL_DEPTH_SIZE,
+		                                 24,
+		                                 EGL_NONE};
+		EGLConfig config;
+		EGLint n_configs = 0;
+		chicken3421::expect(eglChooseConfig(display, config_attribs, &config, 1, &n_configs)
+		                       && n_configs > 0,
+		                    "headless: no EGL config with a pbuffer and depth");
+
+		const EGLint surface_attribs[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+		EGLSurface surface = eglCreatePbufferSurface(display, config, surface_attribs);
+		chicken3421::expect(surface != EGL_NO_SURFACE, "headless: could not create the pbuffer");
+		headless.surface = surface;
+
+		chicken3421::expect(eglBindAPI(EGL_OPENGL_API), "headless: EGL has no desktop GL");
+		const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION_KHR,
+		                                  3,
+		                                  EGL_CONTEXT_MINOR_VERSION_KHR,
+		                                  3,
+		                                  EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+		                                  EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+		                                  EGL_NONE};
+		EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+		chicken3421::expect(context != EGL_NO_CONTEXT, "headless: could not create a GL 3.3 context");
+		headless.context = context;
+
+		chicken3421::expect(eglMakeCurrent(display, surface, surface, context),
+		                    "headless: could not make the context current");
+		chicken3421::expect(gladLoadGLLoader((GLADloadproc)eglGetProcAddress),
+		                    "headless: could not load GL functions");
+		return headless;
+	}
+
+	void destroy(context_t& headless) {
+		if (headless.display) {
+			eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglDestroyContext(headless.display, headless.context);
+			eglDestroySurface(headless.display, headless.surface);
+			eglTerminate(headless.display);
+		}
+		headless = context_t{};
+	}
+
+	void* proc_address(const char* name) {
+		return (void*)eglGetProcAddress(name);
+	}
+} // namespace headless
+#else
+namespace headless {
+	context_t init(int, int) {
+		chicken3421::expect(false, "headless: built without EGL");
+		return context_t{};
+	}
+
+	void destroy(context_t& headless) {
+		headless = context_t{};
+	}
+
+	void* proc_address(const char*) {
+		return nullptr;
+	}
+} // namespace headless
+#endif
@@ -0,0 +1,272 @@
+#include "ass3/light_clusters.hpp"
+#include "ass3/gl_state.hpp"
+#include "ass3/profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include <chicken3421/chicken3421.hpp>
+
+namespace {
+	// every buffer keeps at least this much storage so its texture is never left without any
+	const size_t MIN_BUFFER_SIZE = 16;
+
+	void upload(GLuint buffer, const void* data, size_t size) {
+		// orphan the old storage instead of waiting for draws still reading it
+		gl_state::bind_buffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER,
+		             (GLsizeiptr)std::max(size, MIN_BUFFER_SIZE),
+		             nullptr,
+		             GL_STREAM_DRAW);
+		if (size > 0) {
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, (GLsizeiptr)size, data);
+		}
+	}
+
+	void make_buffer_texture(GLuint& buffer, GLuint& texture, GLenum format) {
+		glGenBuffers(1, &buffer);
+		upload(buffer, nullptr, 0);
+		glGenTextures(1, &texture);
+		gl_state::bind_texture(0, GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+	}
+
+	// first tile a range of normalised device coordinates touches and one past its last
+	void tile_range(float ndc_min, float ndc_max, int tiles, int& first, int& end) {
+		first = std::clamp((int)std::floor((ndc_min * 0.5f + 0.5f) * (float)tiles), 0, tiles);
+		end = std::clamp((int)std::floor((ndc_max * 0.5f + 0.5f) * (float)tiles) + 1, 0, tiles);
+	}
+
+	int slice_of(const light_clusters::clusters_t& clusters, float depth) {
+		auto slice = std::log(depth) * clusters.depth_scale + clusters.depth_bias;
+		return std::clamp((int)std::floor(slice), 0, light_clusters::SLICES - 1);
+	}
+
+	// the clusters touched by the view space box around a light's sphere, empty if none are
+	light_clusters::light_range_t range_of(const light_clusters::clusters_t& clusters,
+	                                       const light_clusters::light_t& light,
+	                                       const glm::mat4& view,
+	                                       const glm::mat4& projection,
+	                                       float near_plane,
+	                                       float far_plane) {
+		auto range = light_clusters::light_range_t{};
+		auto center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+		auto nearest = -center.z - light.radius;
+		auto farthest = -center.z + light.radius;
+		if (farthest < near_plane || nearest > far_plane) {
+			return range;
+		}
+		range.z0 = slice_of(clusters, std::max(nearest, near_plane));
+		range.z1 = slice_of(clusters, std::min(farthest, far_plane)) + 1;
+
+		if (nearest < near_plane) {
+			// part of the box is behind the eye and its projection wraps around, keep every tile
+			range.x1 = light_clusters::TILES_X;
+			range.y1 = light_clusters::TILES_Y;
+			return range;
+		}
+
+		auto ndc_min = glm::vec2(INFINITY);
+		auto ndc_max = glm::vec2(-INFINITY);
+		for (int corner = 0; corner < 8; ++corner) {
+			auto offset = glm::vec3((corner & 1) ? light.radius : -light.radius,
+			                        (corner & 2) ? light.radius : -light.radius,
+			                        (corner & 4) ? light.radius : -light.radius);
+			auto clip = projection * glm::vec4(center + offset, 1.0f);
+			auto ndc = glm::vec2(clip.x / clip.w, clip.y / clip.w);
+			ndc_min = glm::min(ndc_min, ndc);
+			ndc_max = glm::max(ndc_max, ndc);
+		}
+		if (ndc_max.x < -1.0f || ndc_min.x > 1.0f || ndc_max.y < -1.0f || ndc_min.y > 1.0f) {
+			range.z1 = range.z0;
+			return range;
+		}
+		tile_range(ndc_min.x, ndc_max.x, light_clusters::TILES_X, range.x0, range.x1);
+		tile_range(ndc_min.y, ndc_max.y, light_clusters::TILES_Y, range.y0, range.y1);
+		return range;
+	}
+
+	// count, then place, the lights of one depth slice's tiles
+	void bin_slice(light_clusters::clusters_t& clusters, int z) {
+		auto& slice = clusters.slices[(size_t)z];
+		const auto TILES = (size_t)(light_clusters::TILES_X * light_clusters::TILES_Y);
+		slice.counts.assign(TILES, 0);
+		slice.offsets.resize(TILES);
+
+		for (const auto& range : clusters.ranges) {
+			if (z < range.z0 || z >= range.z1) {
+				continue;
+			}
+			for (int y = range.y0; y < range.y1; ++y) {
+				for (int x = range.x0; x < range.x1; ++x) {
+					auto& count = slice.counts[(size_t)(y * light_clusters::TILES_X + x)];
+					count = std::min(count + 1, light_clusters::MAX_LIGHTS_PER_CLUSTER);
+				}
+			}
+		}
+
+		uint32_t total = 0;
+		for (auto tile = size_t{0}; tile < TILES; ++tile) {
+			slice.offsets[tile] = total;
+			total += slice.counts[tile];
+			slice.counts[tile] = 0;
+		}
+		slice.indices.resize(total);
+
+		for (auto light = size_t{0}; light < clusters.ranges.size(); ++light) {
+			const auto& range = clusters.ranges[light];
+			if (z < range.z0 || z >= range.z1) {
+				continue;
+			}
+			for (int y = range.y0; y < range.y1; ++y) {
+				for (int x = range.x0; x < range.x1; ++x) {
+					auto tile = (size_t)(y * light_clusters::TILES_X + x);
+					auto& count = slice.counts[tile];
+					if (count < light_clusters::MAX_LIGHTS_PER_CLUSTER) {
+						slice.indices[slice.offsets[tile] + count++] = (uint32_t)light;
+					}
+				}
+			}
+		}
+	}
+
+	// slices are dealt out round robin, worker i takes i, i + n, i + 2n...
+	void bin_share(light_clusters::clusters_t& clusters, size_t share, size_t shares) {
+		PROFILE_ZONE("bin lights");
+		for (auto z = share; z < (size_t)light_clusters::SLICES; z += shares) {
+			bin_slice(clusters, (int)z);
+		}
+	}
+
+	void work(light_clusters::clusters_t& clusters, size_t share, size_t shares) {
+		uint64_t seen = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(clusters.mutex);
+				clusters.wake.wait(lock,
+				                   [&] { return clusters.stopping || clusters.generation != seen; });
+				if (clusters.stopping) {
+					return;
+				}
+				seen = clusters.generation;
+			}
+
+			bin_share(clusters, share, shares);
+
+			std::lock_guard<std::mutex> lock(clusters.mutex);
+			if (--clusters.remaining == 0) {
+				clusters.done.notify_one();
+			}
+		}
+	}
+} // namespace
+
+namespace light_clusters {
+	void init(clusters_t& clusters, unsigned n_workers) {
+		if (n_workers == 0) {
+			n_workers = std::max(1u, std::thread::hardware_concurrency()) - 1;
+		}
+		clusters.slices.resize(SLICES);
+		clusters.grid.resize((size_t)CLUSTER_COUNT * 2);
+		make_buffer_texture(clusters.light_buffer, clusters.light_texture, GL_RGBA32F);
+		make_buffer_texture(clusters.grid_buffer, clusters.grid_texture, GL_RG32UI);
+		make_buffer_texture(clusters.index_buffer, clusters.index_texture, GL_R32UI);
+
+		clusters.workers.reserve(n_workers);
+		for (auto i = 0u; i < n_workers; ++i) {
+			clusters.workers.emplace_back(work, std::ref(clusters), (size_t)i, (size_t)n_workers + 1);
+		}
+	}
+
+	void destroy(clusters_t& clusters) {
+		{
+			std::lock_guard<std::mutex> lock(clusters.mutex);
+			clusters.stopping = true;
+		}
+		clusters.wake.notify_all();
+		for (auto& worker : clusters.workers) {
+			worker.join();
+		}
+		clusters.workers.clear();
+
+		const GLuint buffers[3] = {clusters.light_buffer, clusters.grid_buffer, clusters.index_buffer};
+		const GLuint textures[3] = {
+		   clusters.light_texture, clusters.grid_texture, clusters.index_texture};
+		gl_state::delete_buffers(3, buffers);
+		gl_state::delete_textures(3, textures);
+		clusters.light_buffer = clusters.grid_buffer = clusters.index_buffer = 0;
+		clusters.light_texture = clusters.grid_texture = clusters.index_texture = 0;
+	}
+
+	void build(clusters_t& clusters,
+	           const std::vector<light_t>& lights,
+	           const glm::mat4& view,
+	           const glm::mat4& projection) {
+		// the planes of a perspective matrix: P[2][2] = (f + n) / (n - f), P[3][2] = 2fn / (n - f)
+		auto near_plane = projection[3][2] / (projection[2][2] - 1.0f);
+		auto far_plane = projection[3][2] / (projection[2][2] + 1.0f);
+		chicken3421::expect(near_plane > 0.0f && far_plane > near_plane,
+		                    "light_clusters: needs a perspective projection");
+		clusters.depth_scale = (float)SLICES / std::log(far_plane / near_plane);
+		clusters.depth_bias = -std::log(near_plane) * clusters.depth_scale;
+
+		clusters.ranges.resize(lights.size());
+		clusters.light_texels.resize(lights.size() * LIGHT_TEXELS);
+		for (auto i = size_t{0}; i < lights.size(); ++i) {
+			const auto& light = lights[i];
+			clusters.ranges[i] = range_of(clusters, light, view, projection, near_plane, far_plane);
+			auto* texels = &clusters.light_texels[i * LIGHT_TEXELS];
+			texels[0] = glm::vec4(light.position, light.radius);
+			texels[1] = glm::vec4(light.diffuse, 0.0f);
+			texels[2] = glm::vec4(light.ambient, 0.0f);
+			texels[3] = glm::vec4(light.specular, 0.0f);
+		}
+
+		if (clusters.workers.empty() || lights.size() < PARALLEL_MIN_LIGHTS) {
+			bin_share(clusters, 0, 1);
+		}
+		else {
+			{
+				std::lock_guard<std::mutex> lock(clusters.mutex);
+				++clusters.generation;
+				clusters.remaining = clusters.workers.size();
+			}
+			clusters.wake.notify_all();
+			bin_share(clusters, clusters.workers.size(), clusters.workers.size() + 1);
+
+			std::unique_lock<std::mutex> lock(clusters.mutex);
+			clusters.done.wait(lock, [&] { return clusters.remaining == 0; });
+		}
+
+		// concatenate the slices, shifting their offsets into the one index list
+		const auto TILES = (size_t)(TILES_X * TILES_Y);
+		clusters.indices.clear();
+		for (auto z = size_t{0}; z < (size_t)SLICES; ++z) {
+			const auto& slice = clusters.slices[z];
+			auto base = (uint32_t)clusters.indices.size();
+			for (auto tile = size_t{0}; tile < TILES; ++tile) {
+				auto cluster = z * TILES + tile;
+				clusters.grid[cluster * 2] = base + slice.offsets[tile];
+				clusters.grid[cluster * 2 + 1] = slice.counts[tile];
+			}
+			clusters.indices.insert(clusters.indices.end(), slice.indices.begin(), slice.indices.end());
+		}
+
+		upload(clusters.light_buffer,
+		       clusters.light_texels.data(),
+		       clusters.light_texels.size() * sizeof(glm::vec4));
+		upload(clusters.grid_buffer, clusters.grid.data(), clusters.grid.size() * sizeof(uint32_t));
+		upload(clusters.index_buffer,
+		       clusters.indices.data(),
+		       clusters.indices.size() * sizeof(uint32_t));
+	}
+
+	void bind(const clusters_t& clusters, GLuint first_unit) {
+		const GLuint textures[3] = {
+		   clusters.light_texture, clusters.grid_texture, clusters.index_texture};
+		for (GLuint i = 0; i < 3; ++i) {
+			gl_state::bind_texture(first_unit + i, GL_TEXTURE_BUFFER, textures[i]);
+		}
+	}
+} // namespace light_clusters
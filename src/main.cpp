@@ -1,4 +1,7 @@
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <thread>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -13,7 +16,17 @@
 #include "ass3/euler_camera.hpp"
 #include "ass3/memes.hpp"
 #include "ass3/renderer.hpp"
-#include "ass3/framebuffer.hpp"
+#include "ass3/render_graph.hpp"
+#include "ass3/benchmark.hpp"
+#include "ass3/headless.hpp"
+#include "ass3/gl_state.hpp"
+#include "ass3/program_cache.hpp"
+#include "ass3/texture_cache.hpp"
+#include "ass3/texture_streamer.hpp"
+#include "ass3/profiler.hpp"
+#include "ass3/asset_loader.hpp"
+#include "ass3/asset_registry.hpp"
+#include "ass3/scene_graph.hpp"
 
 const char *MAIN_PATH = "res/obj/SnowTerrain/winter_house.obj";
 const char *GT3_PATH = "res/obj/SPECTER_GT3_obj/SPECTER_GT3_.obj";
@@ -26,6 +39,10 @@ const int SCR_HEIGHT = 720;
 const char* WIN_TITLE = "Ass3";
 
 namespace {
+	glm::mat4 make_projection(int width, int height) {
+		return glm::perspective(glm::radians(60.0), (double)width / (double)height, 0.1, 1000.0);
+	}
+
 	double time_delta() {
 		static double then = glfwGetTime();
 		double now = glfwGetTime();
@@ -37,90 +54,235 @@ namespace {
 
 std::pair<int, int> get_framebuffer_size(GLFWwindow *win);
 
-void update_scene(GLFWwindow* window, float dt, scene::node_t& scene) {
+void update_scene(GLFWwindow* window,
+                  float dt,
+                  scene_graph::graph_t& scene,
+                  scene_graph::node_id_t root) {
 	if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
-		scene.rotation.y += dt * 0.1;
+		scene.rotations[root].y += dt * 0.1;
+		scene_graph::mark_dirty(scene, root);
 	}
 	if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
-		scene.rotation.y -= dt * 0.1;
+		scene.rotations[root].y -= dt * 0.1;
+		scene_graph::mark_dirty(scene, root);
 	}
 }
 
-int main() {
-#ifndef __APPLE__
-	chicken3421::enable_debug_output();
-#endif
-	GLFWwindow* window = marcify(chicken3421::make_opengl_window(SCR_WIDTH, SCR_HEIGHT, WIN_TITLE));
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-	
-    int fb_width, fb_height;
-    glfwGetFramebufferSize(window, &fb_width, &fb_height);
-    framebuffer::framebuffer_t framebuffer = framebuffer::make_framebuffer(fb_width, fb_height);
-
-	auto camera = euler_camera::make_camera({0, 10, 20}, {0, 0, 0});
-	auto renderer = renderer::init(
-	   glm::perspective(glm::radians(60.0), (double)SCR_WIDTH / (double)SCR_HEIGHT, 0.1, 1000.0));
-
-	auto skybox = scene::make_skybox();
+// what mesh_optimize did to the models parsed this run, see mesh_optimize
+void report_meshes(const asset_loader::loader_t& loader) {
+	for (const auto& report : loader.reports) {
+		const auto& stats = report.optimize;
+		std::cout << "model: " << report.name << " ACMR " << stats.before.acmr << " -> "
+		          << stats.after.acmr << ", ATVR " << stats.before.atvr << " -> "
+		          << stats.after.atvr << std::endl;
+	}
+}
 
+// add the scene's nodes to an empty graph and start loading their models
+scene_graph::node_id_t populate(scene_graph::graph_t& graph, asset_registry::registry_t& registry) {
 	int width = 1000;
 	int height = 1000;
 	int depth = 8;
 
 	auto scene = scene::node_t{};
-	scene.model = model::load(MAIN_PATH);
 	scene.scale = glm::vec3(4,4,4);
 	
-	auto coin = scene::make_marccoin();
+	auto coin = scene::make_marccoin(registry);
 	coin.scale = glm::vec3(2.f, 2.f, 2.f);
 	coin.translation = glm::vec3(-6,1,-6);
 	
 	auto car = scene::node_t{};
-	car.model = model::load(GT3_PATH);
 	car.translation = glm::vec3(7, 0.2, -7);
 	car.scale = glm::vec3(2.f, 2.f, 2.f);
 	
 	auto snowman = scene::node_t{};
-	snowman.model = model::load(SNOWMAN_PATH);
 	snowman.translation = glm::vec3(-6, 0.5, 6);
 	snowman.rotation = glm::vec3(0,3,0);
 	snowman.scale = glm::vec3(2.f, 2.f, 2.f);
 
     auto reindeer = scene::node_t{};
-	reindeer.model = model::load(REINDEER_PATH);
 	reindeer.translation = glm::vec3(0, 0.2, -7);
 	reindeer.scale = glm::vec3(1.f, 1.f, 1.f);
 	
-	auto sand_volume = scene::make_sand_volume(width, height, depth / 8);
+	auto sand_volume = scene::make_sand_volume(registry, width, height, depth / 8);
 	sand_volume.translation = glm::vec3(0,-0.97f,-3.f);
 
-	scene.children.push_back(coin);
-	scene.children.push_back(reindeer);
-	scene.children.push_back(sand_volume);
-	scene.children.push_back(car);
-	scene.children.push_back(snowman);
-	
-	while (!glfwWindowShouldClose(window)) {
+	auto root = scene_graph::add(graph, scene);
+	scene_graph::add(graph, coin, root);
+	auto reindeer_id = scene_graph::add(graph, reindeer, root);
+	scene_graph::add(graph, sand_volume, root);
+	auto car_id = scene_graph::add(graph, car, root);
+	auto snowman_id = scene_graph::add(graph, snowman, root);
+
+	// node ids are stable, so the completion callbacks can hold on to them
+	auto set_model = [&graph](scene_graph::node_id_t id) {
+		return [&graph, id](model::model_t model) {
+			scene_graph::set_model(graph, id, std::move(model));
+		};
+	};
+	asset_registry::acquire_model(registry, MAIN_PATH, set_model(root));
+	asset_registry::acquire_model(registry, REINDEER_PATH, set_model(reindeer_id));
+	asset_registry::acquire_model(registry, GT3_PATH, set_model(car_id));
+	asset_registry::acquire_model(registry, SNOWMAN_PATH, set_model(snowman_id));
+	return root;
+}
+
+// replay a camera path without a window, see benchmark
+void run_benchmark(const benchmark::options_t& options,
+                   asset_loader::loader_t& loader,
+                   texture_streamer::streamer_t& streamer,
+                   renderer::renderer_t& renderer,
+                   scene_graph::graph_t& graph,
+                   render_graph::graph_t& frame,
+                   euler_camera::camera_t& camera) {
+	// every asset is in before the first timed frame
+	while (!asset_loader::idle(loader)) {
+		asset_loader::update(loader);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	renderer.projection = make_projection(options.width, options.height);
+	auto path = options.path.empty() ? benchmark::orbit_path() : benchmark::load_path(options.path);
+	auto draw_frame = [&](const euler_camera::camera_t& at, float time) {
+		PROFILE_FRAME();
+		gl_state::begin_frame();
+		camera = at;
+		renderer.time = time;
+		scene_graph::update(graph);
+		render_graph::execute(frame, options.width, options.height);
+		texture_streamer::update(streamer);
+	};
+	auto frames = benchmark::run(options, path, renderer, draw_frame);
+	std::cout << "benchmark: " << frames.size() << " frames, report in " << options.output
+	          << std::endl;
+	const auto& textures = streamer.stats;
+	std::cout << "textures: " << (textures.resident_bytes >> 20) << " MiB resident, "
+	          << (textures.loaded_bytes >> 20) << " MiB streamed in, " << textures.evictions
+	          << " evictions freeing " << (textures.evicted_bytes >> 20) << " MiB" << std::endl;
+}
+
+// the profiler's view of the run, see profiler
+void report_profile(const benchmark::options_t& options) {
+	for (const auto& zone : profiler::stats()) {
+		std::cout << "profile: " << zone.name << ": avg " << zone.avg_ms << " ms, min " << zone.min_ms
+		          << " ms, p99 " << zone.p99_ms << " ms over " << zone.samples << " samples"
+		          << std::endl;
+	}
+	if (!options.trace.empty()) {
+		profiler::write_trace(options.trace);
+	}
+}
+
+int main(int argc, char** argv) {
+	auto options = benchmark::options_t{};
+	bool headless = benchmark::parse_args(argc, argv, options);
+
+	GLFWwindow* window = nullptr;
+	auto context = headless::context_t{};
+	if (headless) {
+		context = headless::init(options.width, options.height);
+	}
+	else {
+#ifndef __APPLE__
+		chicken3421::enable_debug_output();
+#endif
+		window = marcify(chicken3421::make_opengl_window(SCR_WIDTH, SCR_HEIGHT, WIN_TITLE));
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
+
+	profiler::init();
+	program_cache::init(headless ? headless::proc_address : (GLADloadproc)glfwGetProcAddress);
+	texture_cache::init();
+	auto camera = euler_camera::make_camera({0, 10, 20}, {0, 0, 0});
+	auto renderer = renderer::init(make_projection(SCR_WIDTH, SCR_HEIGHT));
+	const auto& programs = program_cache::stats();
+	std::cout << "programs: " << programs.restored << " restored, " << programs.compiled
+	          << " compiled, " << programs.rejected << " rejected by the driver" << std::endl;
+
+	// only the small mip levels of 2D textures load up front, the renderer asks for the rest
+	auto streamer = texture_streamer::streamer_t{};
+	texture_streamer::init(streamer, options.texture_budget);
+	renderer.streamer = &streamer;
+
+	// everything below only queues work, the first frame renders while assets stream in
+	auto loader = asset_loader::loader_t{};
+	asset_loader::init(loader);
+	loader.streamer = &streamer;
+	auto registry = asset_registry::registry_t{};
+	asset_registry::init(registry, loader);
+
+	auto skybox = scene::make_skybox(registry);
+	auto graph = scene_graph::graph_t{};
+	auto root = populate(graph, registry);
+
+	// the HDR copy of the scene is only drawn once a later pass samples it, until then the graph
+	// culls it
+	auto frame = render_graph::init();
+	auto hdr_colour = render_graph::add_resource(frame, "hdr colour", GL_RGBA16F);
+	auto hdr_depth = render_graph::add_resource(frame, "hdr depth", GL_DEPTH_COMPONENT24);
+	auto draw_scene = [&] {
+		gl_state::enable(GL_CLIP_DISTANCE0);
+		renderer::render(renderer, camera, graph, skybox);
+		gl_state::disable(GL_CLIP_DISTANCE0);
+	};
+	render_graph::add_pass(frame, "hdr scene", {}, {hdr_colour, hdr_depth}, draw_scene);
+	render_graph::add_pass(frame, "scene", {}, {render_graph::BACK_BUFFER}, draw_scene);
+
+	if (headless) {
+		run_benchmark(options, loader, streamer, renderer, graph, frame, camera);
+	}
+
+	auto recording = std::ofstream{};
+	if (!headless && !options.record.empty()) {
+		recording.open(options.record, std::ios::trunc);
+		chicken3421::expect(recording.good(), "could not write " + options.record);
+	}
+
+	while (!headless && !glfwWindowShouldClose(window)) {
+		PROFILE_FRAME();
+		gl_state::begin_frame();
 		auto dt = (float)time_delta();
+		renderer.time = (float)glfwGetTime();
+		asset_loader::update(loader);
 
 		euler_camera::update_camera(camera, window, dt);
-		update_scene(window, dt, scene);
-        
-        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.fbo);
-        glEnable(GL_CLIP_DISTANCE0);
-        renderer::render(renderer, camera, scene, skybox);
-        glDisable(GL_CLIP_DISTANCE0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        
-        
-		glEnable(GL_CLIP_DISTANCE0);
-		renderer::render(renderer, camera, scene, skybox);
-		glDisable(GL_CLIP_DISTANCE0);
-
-		glfwSwapBuffers(window);
+		if (recording.is_open()) {
+			benchmark::record(recording, renderer.time, camera);
+		}
+		update_scene(window, dt, graph, root);
+		scene_graph::update(graph);
+
+		int fb_width, fb_height;
+		glfwGetFramebufferSize(window, &fb_width, &fb_height);
+		if (fb_width > 0 && fb_height > 0) {
+			renderer.projection = make_projection(fb_width, fb_height);
+		}
+		render_graph::execute(frame, fb_width, fb_height);
+		texture_streamer::update(streamer);
+
+		{
+			PROFILE_ZONE("swap buffers");
+			glfwSwapBuffers(window);
+		}
 		glfwPollEvents();
 	}
 
-	glfwTerminate();
+	// the last frames' zones are still queued
+	profiler::begin_frame();
+	report_profile(options);
+	report_meshes(loader);
+
+	render_graph::destroy(frame);
+	asset_registry::destroy(registry);
+	asset_loader::destroy(loader);
+	texture_streamer::destroy(streamer);
+	renderer::destroy(renderer);
+	profiler::destroy();
+	if (headless) {
+		headless::destroy(context);
+	}
+	else {
+		glfwTerminate();
+	}
 	return EXIT_SUCCESS;
 }
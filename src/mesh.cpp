@@ -1,130 +1,516 @@
 #include "ass3/mesh.hpp"
+#include "ass3/gl_state.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 
 namespace mesh {
 
-	// helper function - assumes ebo and vbo are already bound
-	void init_data(const mesh_template_t& mesh_template, GLenum usage) {
-		if (!mesh_template.indices.empty()) {
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, // target
-			             (GLsizeiptr)(mesh_template.indices.size() * sizeof(GLuint)), // num bytes in
-			                                                                          // the data
-			             &mesh_template.indices[0], // pointer to the actual data
-			             usage);
+	// helper function - assumes the vao and vbo are already bound. The runs start at base
+	void init_attribs(size_t vertex_count,
+	                  bool has_colors,
+	                  bool has_tex_coords,
+	                  bool has_normals,
+	                  size_t base = 0) {
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)base);
+
+		GLuint attrib_index = 1;
+		size_t offset = base + vertex_count * sizeof(glm::vec3);
+
+		if (has_colors) {
+			glEnableVertexAttribArray(attrib_index);
+			glVertexAttribPointer(attrib_index, 3, GL_FLOAT, GL_FALSE, 0, (void*)offset);
+			offset += vertex_count * sizeof(glm::vec3);
 		}
+		++attrib_index;
 
-		size_t positions_size = mesh_template.positions.size() * sizeof(glm::vec3);
-		size_t colors_size = mesh_template.colors.size() * sizeof(glm::vec3);
-		size_t tex_coords_size = mesh_template.tex_coords.size() * sizeof(glm::vec2);
-		size_t normals_size = mesh_template.normals.size() * sizeof(glm::vec3);
-		size_t data_size = positions_size + colors_size + tex_coords_size + normals_size;
+		if (has_tex_coords) {
+			glEnableVertexAttribArray(attrib_index);
+			glVertexAttribPointer(attrib_index, 2, GL_FLOAT, GL_FALSE, 0, (void*)offset);
+			offset += vertex_count * sizeof(glm::vec2);
+		}
+		++attrib_index;
 
-		// create buffer and fill with our line data
-		glBufferData(GL_ARRAY_BUFFER, data_size, nullptr, usage);
+		if (has_normals) {
+			glEnableVertexAttribArray(attrib_index);
+			glVertexAttribPointer(attrib_index, 3, GL_FLOAT, GL_FALSE, 0, (void*)offset);
+			offset += vertex_count * sizeof(glm::vec3);
+		}
+		++attrib_index;
+	}
 
-		size_t offset = 0;
-		glBufferSubData(GL_ARRAY_BUFFER, offset, positions_size, &mesh_template.positions[0].x);
-		offset += positions_size;
-		if (colors_size) {
-			glBufferSubData(GL_ARRAY_BUFFER, offset, colors_size, &mesh_template.colors[0].x);
-			offset += colors_size;
+	// the attributes of one mesh, each null when missing
+	struct vertex_streams_t {
+		const glm::vec3* positions = nullptr;
+		const glm::vec3* colors = nullptr;
+		const glm::vec2* tex_coords = nullptr;
+		const glm::vec3* normals = nullptr;
+		size_t count = 0;
+	};
+
+	// byte offsets of each attribute inside one interleaved vertex
+	struct compact_layout_t {
+		GLsizei stride = 0;
+		size_t colors = 0;
+		size_t tex_coords = 0;
+		size_t normals = 0;
+	};
+
+	compact_layout_t compact_layout(const mesh_data_t& data) {
+		auto layout = compact_layout_t{};
+		size_t offset =
+		   data.format == QUANTIZED_VERTICES ? 4 * sizeof(GLushort) : sizeof(glm::vec3);
+		if (data.has_colors) {
+			layout.colors = offset;
+			offset += sizeof(uint32_t);
 		}
-		if (tex_coords_size) {
-			glBufferSubData(GL_ARRAY_BUFFER, offset, tex_coords_size, &mesh_template.tex_coords[0].x);
-			offset += tex_coords_size;
+		if (data.has_tex_coords) {
+			layout.tex_coords = offset;
+			offset += sizeof(uint32_t);
 		}
-		if (normals_size) {
-			glBufferSubData(GL_ARRAY_BUFFER, offset, normals_size, &mesh_template.normals[0].x);
-			offset += normals_size;
+		if (data.has_normals) {
+			layout.normals = offset;
+			offset += sizeof(uint32_t);
+		}
+		layout.stride = (GLsizei)offset;
+		return layout;
+	}
+
+	// helper function - octahedral mapping of a unit vector onto the [-1, 1] square, the lower
+	// hemisphere folded over the diagonals
+	glm::vec2 encode_octahedral(glm::vec3 n) {
+		float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if (sum <= 0.0f) {
+			return glm::vec2(0.0f);
 		}
+		n /= sum;
+		if (n.z >= 0.0f) {
+			return glm::vec2(n.x, n.y);
+		}
+		return glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+		                 (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
 	}
 
-	mesh_t init(const mesh_template_t& mesh_template, GLenum usage) {
+	// helper function - interleave the streams in a compact format. data.bounds must be set, a
+	// quantized mesh gets the dequantization that maps them back
+	std::vector<uint8_t> pack_compact(mesh_data_t& data, const vertex_streams_t& streams) {
+		bool quantized = data.format == QUANTIZED_VERTICES;
+		if (quantized && !bounds::empty(data.bounds)) {
+			data.position_offset = data.bounds.min;
+			// flat axes still need a scale to divide by, their positions are all at the offset
+			data.position_scale = glm::max(data.bounds.max - data.bounds.min, glm::vec3(1e-20f));
+		}
+
+		auto layout = compact_layout(data);
+		std::vector<uint8_t> bytes(streams.count * (size_t)layout.stride);
+		for (size_t v = 0; v < streams.count; ++v) {
+			uint8_t* vertex = &bytes[v * (size_t)layout.stride];
+			if (quantized) {
+				auto q = (streams.positions[v] - data.position_offset) / data.position_scale;
+				// w is stored as 1 so the position needs no extra handling in the shader
+				uint32_t words[2] = {glm::packUnorm2x16(glm::vec2(q.x, q.y)),
+				                     glm::packUnorm2x16(glm::vec2(q.z, 1.0f))};
+				std::memcpy(vertex, words, sizeof(words));
+			}
+			else {
+				std::memcpy(vertex, &streams.positions[v], sizeof(glm::vec3));
+			}
+			if (streams.colors) {
+				uint32_t color = glm::packUnorm4x8(glm::vec4(streams.colors[v], 1.0f));
+				std::memcpy(vertex + layout.colors, &color, sizeof(color));
+			}
+			if (streams.tex_coords) {
+				uint32_t tex_coord = glm::packHalf2x16(streams.tex_coords[v]);
+				std::memcpy(vertex + layout.tex_coords, &tex_coord, sizeof(tex_coord));
+			}
+			if (streams.normals) {
+				uint32_t normal = glm::packSnorm2x16(encode_octahedral(streams.normals[v]));
+				std::memcpy(vertex + layout.normals, &normal, sizeof(normal));
+			}
+		}
+		return bytes;
+	}
+
+	// helper function - the FLOAT_VERTICES layout, every attribute as its own run
+	std::vector<uint8_t> pack_float(const vertex_streams_t& streams) {
+		std::vector<uint8_t> bytes;
+		auto append = [&bytes](const void* run, size_t size) {
+			auto begin = static_cast<const uint8_t*>(run);
+			bytes.insert(bytes.end(), begin, begin + size);
+		};
+		append(streams.positions, streams.count * sizeof(glm::vec3));
+		if (streams.colors) {
+			append(streams.colors, streams.count * sizeof(glm::vec3));
+		}
+		if (streams.tex_coords) {
+			append(streams.tex_coords, streams.count * sizeof(glm::vec2));
+		}
+		if (streams.normals) {
+			append(streams.normals, streams.count * sizeof(glm::vec3));
+		}
+		return bytes;
+	}
+
+	// helper function - assumes the vao and vbo are already bound
+	void init_compact_attribs(const mesh_data_t& data) {
+		auto layout = compact_layout(data);
+		glEnableVertexAttribArray(0);
+		if (data.format == QUANTIZED_VERTICES) {
+			glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, layout.stride, nullptr);
+		}
+		else {
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, layout.stride, nullptr);
+		}
+		if (data.has_colors) {
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(
+			   1, 4, GL_UNSIGNED_BYTE, GL_TRUE, layout.stride, (void*)layout.colors);
+		}
+		if (data.has_tex_coords) {
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(
+			   2, 2, GL_HALF_FLOAT, GL_FALSE, layout.stride, (void*)layout.tex_coords);
+		}
+		if (data.has_normals) {
+			// decoded in shader.vert
+			glEnableVertexAttribArray(3);
+			glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, layout.stride, (void*)layout.normals);
+		}
+	}
+
+	// helper function - indices drop to 16 bits when every vertex can be addressed with them
+	std::vector<uint8_t> narrow_indices(const std::vector<GLuint>& indices,
+	                                    size_t vertex_count,
+	                                    GLenum& index_type) {
+		if (vertex_count > (size_t)UINT16_MAX + 1) {
+			index_type = GL_UNSIGNED_INT;
+			auto begin = reinterpret_cast<const uint8_t*>(indices.data());
+			return std::vector<uint8_t>(begin, begin + indices.size() * sizeof(GLuint));
+		}
+		index_type = GL_UNSIGNED_SHORT;
+		std::vector<uint8_t> bytes(indices.size() * sizeof(GLushort));
+		for (auto i = size_t{0}; i < indices.size(); ++i) {
+			auto index = (GLushort)indices[i];
+			std::memcpy(&bytes[i * sizeof(GLushort)], &index, sizeof(index));
+		}
+		return bytes;
+	}
+
+	// helper function - byte offset of an index in the mesh's index buffer
+	void* index_offset(const mesh_t& mesh, GLsizei first) {
+		size_t size = mesh.index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		return (void*)((size_t)first * size);
+	}
+
+	// helper function - level 0 covers every index unless levels are given
+	void init_lods(mesh_t& mesh, GLsizei total_count, const lod_t* lods, size_t lod_count) {
+		mesh.lods[0] = lod_t{0, total_count, 0.0f};
+		mesh.lod_count = 1;
+		for (size_t i = 0; i < lod_count && i < (size_t)MAX_LODS; ++i) {
+			mesh.lods[i] = lods[i];
+			mesh.lod_count = (int)i + 1;
+		}
+		mesh.indices_count = mesh.lods[0].count;
+	}
+
+	// helper function - texture coordinate units per model space unit over a range of triangles,
+	// the square root of their total uv area over their total model space area
+	float uv_density(const vertex_streams_t& streams,
+	                 const GLuint* indices,
+	                 size_t first,
+	                 size_t count) {
+		if (!streams.tex_coords) {
+			return 0.0f;
+		}
+		const auto* positions = streams.positions;
+		const auto* tex_coords = streams.tex_coords;
+		double model_area = 0.0;
+		double uv_area = 0.0;
+		auto vertex = [&](size_t i) { return indices ? indices[i] : (GLuint)i; };
+		for (auto i = first; i + 2 < first + count; i += 3) {
+			GLuint a = vertex(i);
+			GLuint b = vertex(i + 1);
+			GLuint c = vertex(i + 2);
+			model_area += (double)glm::length(
+			   glm::cross(positions[b] - positions[a], positions[c] - positions[a]));
+			auto ab = tex_coords[b] - tex_coords[a];
+			auto ac = tex_coords[c] - tex_coords[a];
+			uv_area += (double)std::abs(ab.x * ac.y - ab.y * ac.x);
+		}
+		return model_area > 0.0 ? (float)std::sqrt(uv_area / model_area) : 0.0f;
+	}
+
+	const lod_t& select_lod(const mesh_t& mesh, int lod) {
+		return mesh.lods[std::clamp(lod, 0, mesh.lod_count - 1)];
+	}
+
+	// helper function - point a template's attributes at its vectors, each null when empty
+	vertex_streams_t streams_of(const mesh_template_t& mesh_template) {
+		auto streams = vertex_streams_t{};
+		streams.positions = mesh_template.positions.data();
+		streams.colors = mesh_template.colors.empty() ? nullptr : mesh_template.colors.data();
+		streams.tex_coords =
+		   mesh_template.tex_coords.empty() ? nullptr : mesh_template.tex_coords.data();
+		streams.normals = mesh_template.normals.empty() ? nullptr : mesh_template.normals.data();
+		streams.count = mesh_template.positions.size();
+		return streams;
+	}
+
+	mesh_data_t pack(const mesh_template_t& mesh_template,
+	                 vertex_format_t format,
+	                 std::vector<uint8_t>& vertices,
+	                 std::vector<uint8_t>& indices) {
+		auto streams = streams_of(mesh_template);
+		auto data = mesh_data_t{};
+		data.format = format;
+		data.vertex_count = streams.count;
+		data.has_colors = streams.colors != nullptr;
+		data.has_tex_coords = streams.tex_coords != nullptr;
+		data.has_normals = streams.normals != nullptr;
+		data.bounds = bounds::from_points(streams.positions, streams.count);
+		vertices = format == FLOAT_VERTICES ? pack_float(streams) : pack_compact(data, streams);
+		data.vertices = vertices.data();
+		data.vertices_size = vertices.size();
+
+		indices = narrow_indices(mesh_template.indices, streams.count, data.index_type);
+		data.indices = indices.data();
+		data.indices_count = mesh_template.indices.size();
+		data.lods = mesh_template.lods.data();
+		data.lod_count = mesh_template.lods.size();
+
+		// level 0 is the first range of the indices, or all of them without levels
+		bool has_indices = !mesh_template.indices.empty();
+		auto first = size_t{0};
+		auto count = has_indices ? mesh_template.indices.size() : streams.count;
+		if (!mesh_template.lods.empty()) {
+			first = (size_t)mesh_template.lods[0].first;
+			count = (size_t)mesh_template.lods[0].count;
+		}
+		data.uv_density =
+		   uv_density(streams, has_indices ? mesh_template.indices.data() : nullptr, first, count);
+		return data;
+	}
+
+	size_t indices_size(const mesh_data_t& mesh_data) {
+		auto size = mesh_data.index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		return mesh_data.indices_count * size;
+	}
+
+	mesh_t init(const mesh_template_t& mesh_template, GLenum usage, vertex_format_t format) {
+		std::vector<uint8_t> vertices;
+		std::vector<uint8_t> indices;
+		return init(pack(mesh_template, format, vertices, indices), usage);
+	}
+
+	mesh_t init(const mesh_data_t& mesh_data, GLenum usage) {
 		mesh_t mesh;
+		mesh.format = mesh_data.format;
+		mesh.bounds = mesh_data.bounds;
+		mesh.position_offset = mesh_data.position_offset;
+		mesh.position_scale = mesh_data.position_scale;
+		mesh.uv_density = mesh_data.uv_density;
 
 		glGenVertexArrays(1, &mesh.vao);
-		glBindVertexArray(mesh.vao);
+		gl_state::bind_vertex_array(mesh.vao);
 
-		bool has_indices = !mesh_template.indices.empty();
-		mesh.indices_count =
-		   (GLsizei)(has_indices ? mesh_template.indices.size() : mesh_template.positions.size());
+		bool has_indices = mesh_data.indices_count != 0;
+		init_lods(mesh,
+		          (GLsizei)(has_indices ? mesh_data.indices_count : mesh_data.vertex_count),
+		          mesh_data.lods,
+		          mesh_data.lod_count);
 		if (has_indices) {
 			glGenBuffers(1, &mesh.ebo);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+			gl_state::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+			mesh.index_type = mesh_data.index_type;
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+			             (GLsizeiptr)indices_size(mesh_data),
+			             mesh_data.indices,
+			             usage);
 		}
 
 		glGenBuffers(1, &mesh.vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+		gl_state::bind_buffer(GL_ARRAY_BUFFER, mesh.vbo);
+		glBufferData(
+		   GL_ARRAY_BUFFER, (GLsizeiptr)mesh_data.vertices_size, mesh_data.vertices, usage);
+		if (mesh_data.format == FLOAT_VERTICES) {
+			init_attribs(mesh_data.vertex_count,
+			             mesh_data.has_colors,
+			             mesh_data.has_tex_coords,
+			             mesh_data.has_normals);
+		}
+		else {
+			init_compact_attribs(mesh_data);
+		}
 
-		init_data(mesh_template, usage);
+		gl_state::bind_vertex_array(0);
+		return mesh;
+	}
 
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+	void draw(const mesh_t& mesh, GLenum draw_mode) {
+		gl_state::bind_vertex_array(mesh.vao);
+		draw_bound(mesh, draw_mode);
+	}
 
-		GLuint attrib_index = 1;
-		size_t offset = mesh_template.positions.size() * sizeof(glm::vec3);
+	void draw_bound(const mesh_t& mesh, GLenum draw_mode, int lod) {
+		draw_range(mesh, select_lod(mesh, lod), draw_mode);
+	}
 
-		if (!mesh_template.colors.empty()) {
-			glEnableVertexAttribArray(attrib_index);
-			glVertexAttribPointer(attrib_index, 3, GL_FLOAT, GL_FALSE, 0, (void*)offset);
-			offset += mesh_template.colors.size() * sizeof(glm::vec3);
+	void draw_range(const mesh_t& mesh, const lod_t& range, GLenum draw_mode) {
+		if (mesh.ebo) {
+			glDrawElements(draw_mode, range.count, mesh.index_type, index_offset(mesh, range.first));
 		}
-		++attrib_index;
-
-		if (!mesh_template.tex_coords.empty()) {
-			glEnableVertexAttribArray(attrib_index);
-			glVertexAttribPointer(attrib_index, 2, GL_FLOAT, GL_FALSE, 0, (void*)offset);
-			offset += mesh_template.tex_coords.size() * sizeof(glm::vec2);
+		else {
+			glDrawArrays(draw_mode, range.first, range.count);
 		}
-		++attrib_index;
+	}
 
-		if (!mesh_template.normals.empty()) {
-			glEnableVertexAttribArray(attrib_index);
-			glVertexAttribPointer(attrib_index, 3, GL_FLOAT, GL_FALSE, 0, (void*)offset);
-			offset += mesh_template.normals.size() * sizeof(glm::vec3);
+	instances_t init_instances(const std::vector<glm::mat4>& transforms,
+	                           const std::vector<glm::vec4>& tints,
+	                           GLenum usage) {
+		auto instances = instances_t{};
+		instances.count = (GLsizei)transforms.size();
+		instances.has_tints = !tints.empty();
+		instances.transforms = transforms;
+
+		size_t transforms_size = transforms.size() * sizeof(glm::mat4);
+		size_t tints_size = tints.size() * sizeof(glm::vec4);
+		glGenBuffers(1, &instances.vbo);
+		gl_state::bind_buffer(GL_ARRAY_BUFFER, instances.vbo);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(transforms_size + tints_size), nullptr, usage);
+		if (transforms_size) {
+			glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)transforms_size, transforms.data());
 		}
-		++attrib_index;
+		if (tints_size) {
+			glBufferSubData(
+			   GL_ARRAY_BUFFER, (GLintptr)transforms_size, (GLsizeiptr)tints_size, tints.data());
+		}
+		return instances;
+	}
 
-		glBindVertexArray(0);
-		return mesh;
+	void destroy(const instances_t& instances) {
+		gl_state::delete_buffers(1, &instances.vbo);
 	}
 
-	void draw(const mesh_t& mesh, GLenum draw_mode) {
-		glBindVertexArray(mesh.vao);
+	void draw_instanced(const mesh_t& mesh,
+	                    const instances_t& instances,
+	                    GLenum draw_mode,
+	                    int lod) {
+		gl_state::bind_vertex_array(mesh.vao);
+		gl_state::bind_buffer(GL_ARRAY_BUFFER, instances.vbo);
+		for (GLuint col = 0; col < 4; ++col) {
+			glEnableVertexAttribArray(INSTANCE_TRANSFORM_ATTRIB + col);
+			glVertexAttribPointer(INSTANCE_TRANSFORM_ATTRIB + col,
+			                      4,
+			                      GL_FLOAT,
+			                      GL_FALSE,
+			                      sizeof(glm::mat4),
+			                      (void*)(col * sizeof(glm::vec4)));
+			glVertexAttribDivisor(INSTANCE_TRANSFORM_ATTRIB + col, 1);
+		}
+		if (instances.has_tints) {
+			glEnableVertexAttribArray(INSTANCE_TINT_ATTRIB);
+			glVertexAttribPointer(INSTANCE_TINT_ATTRIB,
+			                      4,
+			                      GL_FLOAT,
+			                      GL_FALSE,
+			                      0,
+			                      (void*)((size_t)instances.count * sizeof(glm::mat4)));
+			glVertexAttribDivisor(INSTANCE_TINT_ATTRIB, 1);
+		}
+
+		const auto& level = select_lod(mesh, lod);
 		if (mesh.ebo) {
-			glDrawElements(draw_mode, mesh.indices_count, GL_UNSIGNED_INT, nullptr);
+			glDrawElementsInstanced(draw_mode,
+			                        level.count,
+			                        mesh.index_type,
+			                        index_offset(mesh, level.first),
+			                        instances.count);
 		}
 		else {
-			glDrawArrays(draw_mode, 0, mesh.indices_count);
+			glDrawArraysInstanced(draw_mode, level.first, level.count, instances.count);
+		}
+
+		// disabled arrays read the generic attribute values instead, see renderer::init
+		for (GLuint attrib = INSTANCE_TRANSFORM_ATTRIB; attrib <= INSTANCE_TINT_ATTRIB; ++attrib) {
+			glVertexAttribDivisor(attrib, 0);
+			glDisableVertexAttribArray(attrib);
 		}
-		glBindVertexArray(0);
 	}
 
-	void dynamic_draw(mesh_t& mesh, const mesh_template_t& mesh_template, GLenum draw_mode) {
-		glBindVertexArray(mesh.vao);
-		glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+	void dynamic_draw(mesh_t& mesh,
+	                  const mesh_template_t& mesh_template,
+	                  stream_buffer::stream_buffer_t& stream,
+	                  GLenum draw_mode) {
+		auto vertex_count = mesh_template.positions.size();
+		size_t positions_size = vertex_count * sizeof(glm::vec3);
+		size_t colors_size = mesh_template.colors.size() * sizeof(glm::vec3);
+		size_t tex_coords_size = mesh_template.tex_coords.size() * sizeof(glm::vec2);
+		size_t normals_size = mesh_template.normals.size() * sizeof(glm::vec3);
+		size_t vertices_size = positions_size + colors_size + tex_coords_size + normals_size;
+		size_t indices_size = mesh_template.indices.size() * sizeof(GLuint);
+
+		// the same runs as pack_float, then the indices, all in one mapping
+		size_t base = 0;
+		auto data =
+		   static_cast<uint8_t*>(stream_buffer::map(stream, vertices_size + indices_size, base));
+		size_t offset = 0;
+		std::memcpy(data + offset, mesh_template.positions.data(), positions_size);
+		offset += positions_size;
+		if (colors_size) {
+			std::memcpy(data + offset, mesh_template.colors.data(), colors_size);
+			offset += colors_size;
+		}
+		if (tex_coords_size) {
+			std::memcpy(data + offset, mesh_template.tex_coords.data(), tex_coords_size);
+			offset += tex_coords_size;
+		}
+		if (normals_size) {
+			std::memcpy(data + offset, mesh_template.normals.data(), normals_size);
+			offset += normals_size;
+		}
+		if (indices_size) {
+			std::memcpy(data + offset, mesh_template.indices.data(), indices_size);
+		}
+		stream_buffer::unmap(stream);
 
-		init_data(mesh_template, GL_DYNAMIC_DRAW);
+		// the data moves every frame, so the vao is re-pointed at it every draw
+		gl_state::bind_vertex_array(mesh.vao);
+		gl_state::bind_buffer(GL_ARRAY_BUFFER, stream.buffer);
+		init_attribs(vertex_count,
+		             colors_size != 0,
+		             tex_coords_size != 0,
+		             normals_size != 0,
+		             base);
+		mesh.format = FLOAT_VERTICES;
+		mesh.position_offset = glm::vec3(0.0f);
+		mesh.position_scale = glm::vec3(1.0f);
+		mesh.bounds = bounds::from_points(mesh_template.positions.data(), vertex_count);
 
-		bool has_indices = !mesh_template.indices.empty();
-		mesh.indices_count =
-		   (GLsizei)(has_indices ? mesh_template.indices.size() : mesh_template.positions.size());
+		bool has_indices = indices_size != 0;
+		init_lods(mesh,
+		          (GLsizei)(has_indices ? mesh_template.indices.size() : vertex_count),
+		          mesh_template.lods.data(),
+		          mesh_template.lods.size());
 
-		if (mesh.ebo) {
-			glDrawElements(draw_mode, mesh.indices_count, GL_UNSIGNED_INT, nullptr);
+		if (has_indices) {
+			gl_state::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, stream.buffer);
+			mesh.index_type = GL_UNSIGNED_INT;
+			glDrawElements(
+			   draw_mode, mesh.indices_count, GL_UNSIGNED_INT, (void*)(base + vertices_size));
 		}
 		else {
 			glDrawArrays(draw_mode, 0, mesh.indices_count);
 		}
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	}
 
 	void destroy(const mesh_t& mesh) {
-		glDeleteVertexArrays(1, &mesh.vao);
-		glDeleteBuffers(1, &mesh.vbo);
+		gl_state::delete_vertex_arrays(1, &mesh.vao);
+		gl_state::delete_buffers(1, &mesh.vbo);
+		if (mesh.ebo) {
+			gl_state::delete_buffers(1, &mesh.ebo);
+		}
 	}
 } // namespace mesh
@@ -0,0 +1,299 @@
+#include "ass3/mesh_cache.hpp"
+#include "ass3/cache_file.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+	const char* CACHE_EXTENSION = ".meshcache";
+	const uint32_t CACHE_MAGIC = 0x434d3341; // "A3MC"
+	const uint32_t CACHE_VERSION = 6; // 6: uv density stored per mesh
+
+	const uint32_t HAS_COLORS = 1u << 0;
+	const uint32_t HAS_TEX_COORDS = 1u << 1;
+	const uint32_t HAS_NORMALS = 1u << 2;
+
+	struct header_t {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t n_sources;
+		uint32_t n_materials;
+		uint32_t n_meshes;
+		uint32_t reserved;
+	};
+
+	struct mesh_header_t {
+		int32_t material_id;
+		uint32_t flags;
+		uint32_t lod_count;
+		uint32_t format; // mesh::vertex_format_t
+		uint32_t index_type;
+		float uv_density;
+		uint64_t vertex_count;
+		uint64_t vertices_size;
+		uint64_t indices_count;
+		glm::vec3 bounds_min;
+		glm::vec3 bounds_max;
+		glm::vec3 position_offset;
+		glm::vec3 position_scale;
+	};
+
+	size_t align8(size_t n) {
+		return (n + 7) & ~size_t{7};
+	}
+
+	// bounds-checked cursor over the mapped file
+	struct reader_t {
+		const char* begin;
+		const char* cur;
+		const char* end;
+		bool ok = true;
+
+		const char* take(size_t n) {
+			if (!ok || (size_t)(end - cur) < n) {
+				ok = false;
+				return nullptr;
+			}
+			const char* p = cur;
+			cur += n;
+			return p;
+		}
+
+		template <typename T>
+		bool read(T& value) {
+			const char* p = take(sizeof(T));
+			if (p) {
+				std::memcpy(&value, p, sizeof(T));
+			}
+			return ok;
+		}
+
+		bool read_string(std::string& value) {
+			uint32_t len = 0;
+			read(len);
+			const char* p = take(len);
+			if (p) {
+				value.assign(p, len);
+			}
+			return ok;
+		}
+
+		void align() {
+			take(align8((size_t)(cur - begin)) - (size_t)(cur - begin));
+		}
+	};
+
+	// writer mirroring reader_t, keeping every block 8-byte aligned so the mapped bytes can be
+	// handed to GL directly
+	struct writer_t {
+		std::ofstream& out;
+		size_t offset = 0;
+
+		void write(const void* data, size_t n) {
+			out.write((const char*)data, (std::streamsize)n);
+			offset += n;
+		}
+
+		template <typename T>
+		void write(const T& value) {
+			write(&value, sizeof(T));
+		}
+
+		void write_string(const std::string& value) {
+			write((uint32_t)value.size());
+			write(value.data(), value.size());
+		}
+
+		void align() {
+			static const char zeros[8] = {};
+			write(zeros, align8(offset) - offset);
+		}
+	};
+
+	std::string cache_path(const std::string& source_path) {
+		return source_path + CACHE_EXTENSION;
+	}
+
+	bool parse(reader_t& reader, mesh_cache::cache_t& cache) {
+		auto header = header_t{};
+		if (!reader.read(header) || header.magic != CACHE_MAGIC || header.version != CACHE_VERSION) {
+			return false;
+		}
+
+		for (uint32_t i = 0; i < header.n_sources; ++i) {
+			std::string path;
+			auto info = cache_file::source_info_t{};
+			reader.read_string(path);
+			reader.align();
+			if (!reader.read(info) || !cache_file::source_unchanged(path, info)) {
+				return false;
+			}
+		}
+
+		for (uint32_t i = 0; i < header.n_materials; ++i) {
+			auto mat = mesh_cache::material_desc_t{};
+			reader.read(mat.diffuse);
+			reader.read(mat.specular);
+			reader.read_string(mat.diffuse_texname);
+			reader.read_string(mat.specular_texname);
+			reader.align();
+			cache.materials.push_back(mat);
+		}
+
+		for (uint32_t i = 0; i < header.n_meshes; ++i) {
+			auto mesh_header = mesh_header_t{};
+			if (!reader.read(mesh_header)) {
+				return false;
+			}
+			bool known_format = mesh_header.format <= mesh::QUANTIZED_VERTICES;
+			bool known_index_type = mesh_header.index_type == GL_UNSIGNED_SHORT ||
+			                        mesh_header.index_type == GL_UNSIGNED_INT;
+			if (!known_format || !known_index_type) {
+				return false;
+			}
+			auto mesh = mesh_cache::cached_mesh_t{};
+			mesh.material_id = mesh_header.material_id;
+			mesh.data.format = (mesh::vertex_format_t)mesh_header.format;
+			mesh.data.index_type = (GLenum)mesh_header.index_type;
+			mesh.data.bounds = bounds::aabb_t{mesh_header.bounds_min, mesh_header.bounds_max};
+			mesh.data.position_offset = mesh_header.position_offset;
+			mesh.data.position_scale = mesh_header.position_scale;
+			mesh.data.uv_density = mesh_header.uv_density;
+			mesh.data.vertex_count = (size_t)mesh_header.vertex_count;
+			mesh.data.vertices_size = (size_t)mesh_header.vertices_size;
+			mesh.data.indices_count = (size_t)mesh_header.indices_count;
+			mesh.data.has_colors = mesh_header.flags & HAS_COLORS;
+			mesh.data.has_tex_coords = mesh_header.flags & HAS_TEX_COORDS;
+			mesh.data.has_normals = mesh_header.flags & HAS_NORMALS;
+			mesh.data.lod_count = mesh_header.lod_count;
+			mesh.data.lods =
+			   (const mesh::lod_t*)reader.take(mesh.data.lod_count * sizeof(mesh::lod_t));
+			reader.align();
+			mesh.data.vertices = reader.take(mesh.data.vertices_size);
+			reader.align();
+			mesh.data.indices = reader.take(mesh::indices_size(mesh.data));
+			reader.align();
+			cache.meshes.push_back(mesh);
+		}
+		return reader.ok;
+	}
+
+} // namespace
+
+namespace mesh_cache {
+	bool open(const std::string& source_path, cache_t& cache) {
+		cache = cache_t{};
+
+		int fd = ::open(cache_path(source_path).c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st {};
+		if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+			::close(fd);
+			return false;
+		}
+		void* mapping = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (mapping == MAP_FAILED) {
+			return false;
+		}
+
+		cache.mapping = mapping;
+		cache.mapping_size = (size_t)st.st_size;
+
+		const char* bytes = (const char*)mapping;
+		auto reader = reader_t{bytes, bytes, bytes + cache.mapping_size};
+		if (!parse(reader, cache)) {
+			close(cache);
+			return false;
+		}
+		return true;
+	}
+
+	void close(cache_t& cache) {
+		if (cache.mapping) {
+			munmap(cache.mapping, cache.mapping_size);
+		}
+		cache = cache_t{};
+	}
+
+	void write(const std::string& source_path,
+	           const std::vector<std::string>& dependencies,
+	           const std::vector<mesh::mesh_data_t>& meshes,
+	           const std::vector<int>& material_ids,
+	           const std::vector<material_desc_t>& materials) {
+		std::vector<std::string> sources = {source_path};
+		sources.insert(sources.end(), dependencies.begin(), dependencies.end());
+
+		std::vector<cache_file::source_info_t> infos;
+		for (const auto& source : sources) {
+			auto info = cache_file::source_info_t{};
+			if (!cache_file::stat_source(source, info) ||
+			    !cache_file::hash_source(source, info.hash)) {
+				std::cerr << "mesh_cache: not caching " << source_path << ", cannot read " << source
+				          << std::endl;
+				return;
+			}
+			infos.push_back(info);
+		}
+
+		cache_file::write(cache_path(source_path), "mesh_cache", [&](std::ofstream& out) {
+			auto writer = writer_t{out};
+
+			writer.write(header_t{CACHE_MAGIC,
+			                      CACHE_VERSION,
+			                      (uint32_t)sources.size(),
+			                      (uint32_t)materials.size(),
+			                      (uint32_t)meshes.size(),
+			                      0});
+
+			for (auto i = size_t{0}; i < sources.size(); ++i) {
+				writer.write_string(sources[i]);
+				writer.align();
+				writer.write(infos[i]);
+			}
+
+			for (const auto& mat : materials) {
+				writer.write(mat.diffuse);
+				writer.write(mat.specular);
+				writer.write_string(mat.diffuse_texname);
+				writer.write_string(mat.specular_texname);
+				writer.align();
+			}
+
+			for (auto i = size_t{0}; i < meshes.size(); ++i) {
+				const auto& mesh = meshes[i];
+				uint32_t flags = (mesh.has_colors ? HAS_COLORS : 0u) |
+				                 (mesh.has_tex_coords ? HAS_TEX_COORDS : 0u) |
+				                 (mesh.has_normals ? HAS_NORMALS : 0u);
+				writer.write(mesh_header_t{material_ids[i],
+				                           flags,
+				                           (uint32_t)mesh.lod_count,
+				                           (uint32_t)mesh.format,
+				                           (uint32_t)mesh.index_type,
+				                           mesh.uv_density,
+				                           mesh.vertex_count,
+				                           mesh.vertices_size,
+				                           mesh.indices_count,
+				                           mesh.bounds.min,
+				                           mesh.bounds.max,
+				                           mesh.position_offset,
+				                           mesh.position_scale});
+				writer.write(mesh.lods, mesh.lod_count * sizeof(mesh::lod_t));
+				writer.align();
+				writer.write(mesh.vertices, mesh.vertices_size);
+				writer.align();
+				writer.write(mesh.indices, mesh::indices_size(mesh));
+				writer.align();
+			}
+		});
+	}
+} // namespace mesh_cache
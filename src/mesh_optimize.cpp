@@ -0,0 +1,371 @@
+#include "ass3/mesh_optimize.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+	// Forsyth's scoring, tuned for the LRU cache simulated while reordering
+	const size_t CACHE_SIZE = 32;
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	const GLuint UNUSED = ~GLuint{0};
+
+	// vertices in the cache score by how recently they were used, and every vertex by how few
+	// triangles it has left, so lone leftovers get finished instead of stranded
+	float vertex_score(int cache_position, uint32_t live_triangles) {
+		if (live_triangles == 0) {
+			return -1.0f;
+		}
+		float score = 0.0f;
+		if (cache_position >= 0 && cache_position < 3) {
+			score = LAST_TRIANGLE_SCORE;
+		}
+		else if (cache_position >= 3) {
+			float scale = 1.0f / (float)(CACHE_SIZE - 3);
+			score = std::pow(1.0f - (float)(cache_position - 3) * scale, CACHE_DECAY_POWER);
+		}
+		return score + VALENCE_BOOST_SCALE * std::pow((float)live_triangles, -VALENCE_BOOST_POWER);
+	}
+
+	// vertex -> triangles, as offsets into one array. counts shrink as triangles are emitted
+	struct adjacency_t {
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> counts;
+		std::vector<uint32_t> triangles;
+	};
+
+	adjacency_t make_adjacency(const GLuint* indices, size_t index_count, size_t vertex_count) {
+		auto adjacency = adjacency_t{};
+		adjacency.counts.assign(vertex_count, 0);
+		for (size_t i = 0; i < index_count; ++i) {
+			++adjacency.counts[indices[i]];
+		}
+		adjacency.offsets.assign(vertex_count, 0);
+		uint32_t offset = 0;
+		for (size_t v = 0; v < vertex_count; ++v) {
+			adjacency.offsets[v] = offset;
+			offset += adjacency.counts[v];
+		}
+		adjacency.triangles.resize(index_count);
+		auto fill = adjacency.offsets;
+		for (size_t i = 0; i < index_count; ++i) {
+			adjacency.triangles[fill[indices[i]]++] = (uint32_t)(i / 3);
+		}
+		return adjacency;
+	}
+
+	// FIFO post-transform cache, a vertex is cached while fewer than size misses came after it
+	struct fifo_cache_t {
+		std::vector<uint32_t> stamps;
+		uint32_t time;
+		uint32_t size;
+	};
+
+	fifo_cache_t make_fifo_cache(size_t vertex_count, size_t size) {
+		return fifo_cache_t{std::vector<uint32_t>(vertex_count, 0), (uint32_t)size + 1, (uint32_t)size};
+	}
+
+	void reset(fifo_cache_t& cache) {
+		cache.time += cache.size + 1;
+	}
+
+	uint32_t add_triangle(fifo_cache_t& cache, const GLuint* triangle) {
+		uint32_t misses = 0;
+		for (int k = 0; k < 3; ++k) {
+			auto& stamp = cache.stamps[triangle[k]];
+			if (cache.time - stamp > cache.size) {
+				stamp = cache.time++;
+				++misses;
+			}
+		}
+		return misses;
+	}
+
+	void optimize_vertex_cache(GLuint* indices, size_t index_count, size_t vertex_count) {
+		size_t n_tris = index_count / 3;
+		if (n_tris == 0) {
+			return;
+		}
+		auto adjacency = make_adjacency(indices, index_count, vertex_count);
+
+		std::vector<int> cache_positions(vertex_count, -1);
+		std::vector<float> vertex_scores(vertex_count);
+		for (size_t v = 0; v < vertex_count; ++v) {
+			vertex_scores[v] = vertex_score(-1, adjacency.counts[v]);
+		}
+
+		auto triangle_score = [&](size_t t) {
+			const GLuint* tri = &indices[t * 3];
+			return vertex_scores[tri[0]] + vertex_scores[tri[1]] + vertex_scores[tri[2]];
+		};
+		std::vector<uint8_t> emitted(n_tris, 0);
+		size_t best = 0;
+		for (size_t t = 1; t < n_tris; ++t) {
+			if (triangle_score(t) > triangle_score(best)) {
+				best = t;
+			}
+		}
+
+		std::vector<GLuint> result;
+		result.reserve(index_count);
+		std::vector<GLuint> cache;
+		std::vector<GLuint> next_cache;
+		size_t cursor = 0; // earliest triangle that might not be emitted yet
+
+		while (result.size() < index_count) {
+			if (best == SIZE_MAX) {
+				// nothing left next to the cache, restart from the input order
+				while (emitted[cursor]) {
+					++cursor;
+				}
+				best = cursor;
+			}
+
+			const GLuint* tri = &indices[best * 3];
+			result.insert(result.end(), tri, tri + 3);
+			emitted[best] = 1;
+			for (int k = 0; k < 3; ++k) {
+				auto v = tri[k];
+				auto begin = adjacency.triangles.begin() + adjacency.offsets[v];
+				auto end = begin + adjacency.counts[v];
+				std::iter_swap(std::find(begin, end, (uint32_t)best), end - 1);
+				--adjacency.counts[v];
+			}
+
+			// the emitted triangle moves to the front, the rest keep their order
+			next_cache.assign(tri, tri + 3);
+			for (auto v : cache) {
+				if (v != tri[0] && v != tri[1] && v != tri[2]) {
+					next_cache.push_back(v);
+				}
+			}
+			for (size_t i = 0; i < next_cache.size(); ++i) {
+				auto v = next_cache[i];
+				cache_positions[v] = i < CACHE_SIZE ? (int)i : -1;
+				vertex_scores[v] = vertex_score(cache_positions[v], adjacency.counts[v]);
+			}
+
+			// only triangles around the cache changed score, the next one is picked from them
+			best = SIZE_MAX;
+			float best_score = -1.0f;
+			for (size_t i = 0; i < next_cache.size(); ++i) {
+				auto v = next_cache[i];
+				auto begin = adjacency.offsets[v];
+				for (auto j = begin; j < begin + adjacency.counts[v]; ++j) {
+					auto t = adjacency.triangles[j];
+					float score = triangle_score(t);
+					if (i < CACHE_SIZE && score > best_score) {
+						best_score = score;
+						best = t;
+					}
+				}
+			}
+			next_cache.resize(std::min(next_cache.size(), CACHE_SIZE));
+			std::swap(cache, next_cache);
+		}
+		std::copy(result.begin(), result.end(), indices);
+	}
+
+	struct cluster_t {
+		size_t first; // in triangles
+		size_t count;
+		float sort_key;
+	};
+
+	void optimize_overdraw(GLuint* indices,
+	                       size_t index_count,
+	                       const glm::vec3* positions,
+	                       size_t vertex_count) {
+		size_t n_tris = index_count / 3;
+		if (n_tris == 0) {
+			return;
+		}
+
+		// hard boundaries: triangles that miss on all three vertices start over anyway
+		auto cache = make_fifo_cache(vertex_count, mesh_optimize::STATS_CACHE_SIZE);
+		std::vector<uint32_t> misses(n_tris);
+		std::vector<size_t> hard;
+		for (size_t t = 0; t < n_tris; ++t) {
+			misses[t] = add_triangle(cache, &indices[t * 3]);
+			if (t == 0 || misses[t] == 3) {
+				hard.push_back(t);
+			}
+		}
+		hard.push_back(n_tris);
+
+		// soft boundaries: cut a run once it has done about as well as the whole hard cluster
+		std::vector<cluster_t> clusters;
+		for (size_t h = 0; h + 1 < hard.size(); ++h) {
+			size_t begin = hard[h];
+			size_t end = hard[h + 1];
+			uint32_t cluster_misses = 0;
+			for (auto t = begin; t < end; ++t) {
+				cluster_misses += misses[t];
+			}
+			float threshold =
+			   (float)cluster_misses / (float)(end - begin) * mesh_optimize::OVERDRAW_THRESHOLD;
+
+			reset(cache);
+			uint32_t run_misses = 0;
+			size_t run_begin = begin;
+			for (auto t = begin; t < end; ++t) {
+				run_misses += add_triangle(cache, &indices[t * 3]);
+				if (t + 1 == end || (float)run_misses <= threshold * (float)(t + 1 - run_begin)) {
+					clusters.push_back(cluster_t{run_begin, t + 1 - run_begin, 0.0f});
+					reset(cache);
+					run_misses = 0;
+					run_begin = t + 1;
+				}
+			}
+		}
+
+		// clusters further out along their own facing are more likely to hide the others
+		auto triangle_centroid = [&](size_t t, glm::vec3& normal) {
+			const GLuint* tri = &indices[t * 3];
+			auto a = positions[tri[0]];
+			auto b = positions[tri[1]];
+			auto c = positions[tri[2]];
+			normal = glm::cross(b - a, c - a); // twice the area in length
+			return (a + b + c) / 3.0f;
+		};
+		auto mesh_centroid = glm::vec3(0.0f);
+		float mesh_area = 0.0f;
+		for (size_t t = 0; t < n_tris; ++t) {
+			glm::vec3 normal;
+			auto centroid = triangle_centroid(t, normal);
+			float area = glm::length(normal);
+			mesh_centroid += centroid * area;
+			mesh_area += area;
+		}
+		mesh_centroid = mesh_area > 0.0f ? mesh_centroid / mesh_area : mesh_centroid;
+
+		for (auto& cluster : clusters) {
+			auto centroid = glm::vec3(0.0f);
+			auto normal = glm::vec3(0.0f);
+			float area = 0.0f;
+			for (auto t = cluster.first; t < cluster.first + cluster.count; ++t) {
+				glm::vec3 triangle_normal;
+				auto triangle = triangle_centroid(t, triangle_normal);
+				float triangle_area = glm::length(triangle_normal);
+				centroid += triangle * triangle_area;
+				normal += triangle_normal;
+				area += triangle_area;
+			}
+			float normal_length = glm::length(normal);
+			if (area > 0.0f && normal_length > 0.0f) {
+				cluster.sort_key = glm::dot(centroid / area - mesh_centroid, normal / normal_length);
+			}
+		}
+		std::stable_sort(clusters.begin(), clusters.end(), [](const auto& a, const auto& b) {
+			return a.sort_key > b.sort_key;
+		});
+
+		std::vector<GLuint> result;
+		result.reserve(index_count);
+		for (const auto& cluster : clusters) {
+			result.insert(result.end(),
+			              indices + cluster.first * 3,
+			              indices + (cluster.first + cluster.count) * 3);
+		}
+		std::copy(result.begin(), result.end(), indices);
+	}
+
+	template <typename T>
+	void permute(std::vector<T>& stream, const std::vector<GLuint>& remap) {
+		if (stream.size() != remap.size()) {
+			return;
+		}
+		std::vector<T> permuted(stream.size());
+		for (size_t v = 0; v < stream.size(); ++v) {
+			permuted[remap[v]] = stream[v];
+		}
+		stream = std::move(permuted);
+	}
+
+	// renumber vertices in order of first use, unused ones go last
+	void optimize_vertex_fetch(mesh::mesh_template_t& mesh_template) {
+		auto vertex_count = mesh_template.positions.size();
+		std::vector<GLuint> remap(vertex_count, UNUSED);
+		GLuint next = 0;
+		for (auto v : mesh_template.indices) {
+			if (remap[v] == UNUSED) {
+				remap[v] = next++;
+			}
+		}
+		for (auto& slot : remap) {
+			if (slot == UNUSED) {
+				slot = next++;
+			}
+		}
+
+		for (auto& v : mesh_template.indices) {
+			v = remap[v];
+		}
+		permute(mesh_template.positions, remap);
+		permute(mesh_template.colors, remap);
+		permute(mesh_template.tex_coords, remap);
+		permute(mesh_template.normals, remap);
+	}
+} // namespace
+
+namespace mesh_optimize {
+	stats_t analyze(const std::vector<GLuint>& indices,
+	                size_t first,
+	                size_t count,
+	                size_t vertex_count) {
+		auto stats = stats_t{};
+		size_t n_tris = count / 3;
+		if (n_tris == 0) {
+			return stats;
+		}
+		auto cache = make_fifo_cache(vertex_count, STATS_CACHE_SIZE);
+		std::vector<uint8_t> used(vertex_count, 0);
+		size_t misses = 0;
+		size_t used_count = 0;
+		for (size_t t = 0; t < n_tris; ++t) {
+			const GLuint* tri = &indices[first + t * 3];
+			misses += add_triangle(cache, tri);
+			for (int k = 0; k < 3; ++k) {
+				if (!used[tri[k]]) {
+					++used_count;
+				}
+				used[tri[k]] = 1;
+			}
+		}
+		stats.acmr = (float)misses / (float)n_tris;
+		stats.atvr = (float)misses / (float)used_count;
+		return stats;
+	}
+
+	report_t optimize(mesh::mesh_template_t& mesh_template) {
+		if (!mesh_template.lods.empty()) {
+			return optimize(mesh_template, mesh_template.lods);
+		}
+		auto whole = mesh::lod_t{0, (GLsizei)mesh_template.indices.size(), 0.0f};
+		return optimize(mesh_template, std::vector<mesh::lod_t>{whole});
+	}
+
+	report_t optimize(mesh::mesh_template_t& mesh_template, const std::vector<mesh::lod_t>& ranges) {
+		auto report = report_t{};
+		auto& indices = mesh_template.indices;
+		auto vertex_count = mesh_template.positions.size();
+		if (indices.empty() || ranges.empty()) {
+			return report;
+		}
+
+		auto level0 = ranges[0];
+		report.before = analyze(indices, (size_t)level0.first, (size_t)level0.count, vertex_count);
+		for (const auto& range : ranges) {
+			GLuint* first = indices.data() + (size_t)range.first;
+			optimize_vertex_cache(first, (size_t)range.count, vertex_count);
+			optimize_overdraw(first, (size_t)range.count, mesh_template.positions.data(), vertex_count);
+		}
+		optimize_vertex_fetch(mesh_template);
+		report.after = analyze(indices, (size_t)level0.first, (size_t)level0.count, vertex_count);
+		return report;
+	}
+} // namespace mesh_optimize
@@ -1,44 +1,144 @@
 #include "ass3/model.hpp"
+#include "ass3/mesh_cache.hpp"
+#include "ass3/mesh_optimize.hpp"
+#include "ass3/obj_parser.hpp"
+#include "ass3/simplify.hpp"
 #include "ass3/texture_2d.hpp"
 
-#include <tiny_obj_loader.h>
-#include <chicken3421/chicken3421.hpp>
+#include <unordered_map>
 
 namespace model {
+	// every level aims for half the triangles of the one before it
+	const float LOD_MAX_ERROR = 0.05f; // as a fraction of the mesh's extent
+	const float LOD_MIN_REDUCTION = 0.85f; // a level must keep fewer than this share of the last
+	const size_t LOD_MIN_INDICES = 3 * 64; // meshes this small only get level 0
+
+	// loaded meshes are only ever drawn, never read back or updated
+	const mesh::vertex_format_t MODEL_VERTEX_FORMAT = mesh::QUANTIZED_VERTICES;
+
+	struct index_hash {
+		size_t operator()(const obj_parser::index_t& index) const {
+			// multiplicative mix of the three indices - cheap enough to keep welding near parse speed
+			auto key = (uint64_t)(uint32_t)index.vertex_index;
+			key = key * 0x9e3779b97f4a7c15ull ^ (uint64_t)(uint32_t)index.texcoord_index;
+			key = key * 0x9e3779b97f4a7c15ull ^ (uint64_t)(uint32_t)index.normal_index;
+			return (size_t)(key ^ (key >> 29));
+		}
+	};
+
+	struct index_equal {
+		bool operator()(const obj_parser::index_t& a, const obj_parser::index_t& b) const {
+			return a.vertex_index == b.vertex_index && a.texcoord_index == b.texcoord_index &&
+			       a.normal_index == b.normal_index;
+		}
+	};
+
+	// append simplified levels to the template's index buffer, each derived from the one before
+	void generate_lods(mesh::mesh_template_t& mesh_template) {
+		auto base_count = mesh_template.indices.size();
+		if (base_count < LOD_MIN_INDICES) {
+			return;
+		}
+
+		mesh_template.lods.push_back(mesh::lod_t{0, (GLsizei)base_count, 0.0f});
+		std::vector<GLuint> previous(mesh_template.indices);
+		float error = 0.0f;
+		for (int level = 1; level < mesh::MAX_LODS; ++level) {
+			float level_error = 0.0f;
+			auto target = (base_count >> level) / 3 * 3;
+			auto next = simplify::simplify(mesh_template.positions.data(),
+			                               mesh_template.positions.size(),
+			                               previous,
+			                               target,
+			                               LOD_MAX_ERROR,
+			                               &level_error);
+			if ((float)next.size() > (float)previous.size() * LOD_MIN_REDUCTION) {
+				break;
+			}
+			error += level_error;
+			mesh_template.lods.push_back(
+			   mesh::lod_t{(GLsizei)mesh_template.indices.size(), (GLsizei)next.size(), error});
+			mesh_template.indices.insert(mesh_template.indices.end(), next.begin(), next.end());
+			previous = std::move(next);
+		}
+		if (mesh_template.lods.size() == 1) {
+			mesh_template.lods.clear();
+		}
+	}
+
+	material_t make_material(const mesh_cache::material_desc_t& desc,
+	                         const std::string& search_path,
+	                         const texture_loader_t& load_texture) {
+		auto mat = material_t{};
+		mat.diffuse = desc.diffuse;
+		mat.diffuse_map =
+		   desc.diffuse_texname.empty() ? 0 : load_texture(search_path + desc.diffuse_texname);
+		mat.specular = desc.specular;
+		mat.specular_map =
+		   desc.specular_texname.empty() ? 0 : load_texture(search_path + desc.specular_texname);
+		return mat;
+	}
+
 	model_t load(const std::string& path) {
-		tinyobj::ObjReader reader;
-		tinyobj::ObjReaderConfig config{};
-		config.triangulate = true;
-		config.mtl_search_path = path.substr(0, path.find_last_of('/') + 1);
-
-		bool did_load = reader.ParseFromFile(path, config);
-		chicken3421::expect(did_load && reader.Error().empty() && reader.Warning().empty(),
-		                    reader.Error() + reader.Warning());
-
-		auto& attrib = reader.GetAttrib();
-		auto& shapes = reader.GetShapes();
-		auto& materials = reader.GetMaterials();
-		auto model = model_t{};
+		auto data = parse(path);
+		auto model = upload(data, [](const std::string& texture_path) {
+			return texture_2d::init(texture_path);
+		});
+		release(data);
+		return model;
+	}
+
+	model_data_t parse(const std::string& path) {
+		auto data = model_data_t{};
+		data.search_path = path.substr(0, path.find_last_of('/') + 1);
+
+		if (mesh_cache::open(path, data.cache)) {
+			bool current = true;
+			for (const auto& mesh : data.cache.meshes) {
+				current = current && mesh.data.format == MODEL_VERTEX_FORMAT;
+			}
+			if (current) {
+				data.materials = data.cache.materials;
+				for (const auto& mesh : data.cache.meshes) {
+					data.meshes.push_back(mesh.data);
+					data.material_ids.push_back(mesh.material_id);
+				}
+				return data;
+			}
+			// packed for another vertex format, rebuilt below
+			mesh_cache::close(data.cache);
+		}
+
+		auto obj = obj_parser::parse(path, data.search_path);
+		auto& attrib = obj.attrib;
+		auto& shapes = obj.shapes;
+		auto& materials = obj.materials;
 
-		std::vector<material_t> mats;
 		// initialise the materials
 		for (const auto& m : materials) {
-			auto mat = material_t{};
-			mat.diffuse = glm::vec4{m.diffuse[0], m.diffuse[1], m.diffuse[2], 1.0f};
-			mat.diffuse_map = m.diffuse_texname.empty()
-			                     ? 0
-			                     : texture_2d::init(config.mtl_search_path + m.diffuse_texname);
-			mat.specular = glm::vec3{m.specular[0], m.specular[1], m.specular[2]};
-			mat.specular_map = m.specular_texname.empty()
-			                      ? 0
-			                      : texture_2d::init(config.mtl_search_path + m.diffuse_texname);
-			mats.push_back(mat);
+			auto desc = mesh_cache::material_desc_t{};
+			desc.diffuse = glm::vec4{m.diffuse[0], m.diffuse[1], m.diffuse[2], 1.0f};
+			desc.diffuse_texname = m.diffuse_texname;
+			desc.specular = glm::vec3{m.specular[0], m.specular[1], m.specular[2]};
+			desc.specular_texname = m.specular_texname.empty() ? "" : m.diffuse_texname;
+			data.materials.push_back(desc);
 		}
 
-		// initialise the static meshes
+		// build the static mesh templates
 		for (const auto& shape : shapes) {
 			mesh::mesh_template_t mesh_template;
+			// weld corners that share the same position/texcoord/normal triple into one vertex
+			std::unordered_map<obj_parser::index_t, GLuint, index_hash, index_equal> welded;
+			welded.reserve(shape.mesh.indices.size());
+			mesh_template.indices.reserve(shape.mesh.indices.size());
 			for (const auto& index : shape.mesh.indices) {
+				auto next = (GLuint)mesh_template.positions.size();
+				auto [it, inserted] = welded.try_emplace(index, next);
+				mesh_template.indices.push_back(it->second);
+				if (!inserted) {
+					continue;
+				}
+
 				const float* pos = &attrib.vertices[3 * index.vertex_index];
 				mesh_template.positions.emplace_back(pos[0], pos[1], pos[2]);
 				if (!attrib.texcoords.empty()) {
@@ -50,12 +150,45 @@ namespace model {
 					mesh_template.normals.emplace_back(norm[0], norm[1], norm[2]);
 				}
 			}
-			model.meshes.push_back(mesh::init(mesh_template));
-			model.materials.push_back(mats[shape.mesh.material_ids[0]]);
+			generate_lods(mesh_template);
+			auto report = mesh_optimize::optimize(mesh_template);
+			data.reports.push_back(mesh_report_t{path + " [" + shape.name + "]", report});
+			// the packed buffers move with data, so the pointers into them stay valid
+			auto& packed = data.packed.emplace_back();
+			auto mesh_data =
+			   mesh::pack(mesh_template, MODEL_VERTEX_FORMAT, packed.vertices, packed.indices);
+			packed.lods = std::move(mesh_template.lods);
+			mesh_data.lods = packed.lods.data();
+			data.meshes.push_back(mesh_data);
+			data.material_ids.push_back(shape.mesh.material_ids[0]);
+		}
+
+		mesh_cache::write(path, obj.mtl_libs, data.meshes, data.material_ids, data.materials);
+		return data;
+	}
+
+	model_t upload(const model_data_t& data, const texture_loader_t& load_texture) {
+		auto model = model_t{};
+
+		std::vector<material_t> mats;
+		for (const auto& desc : data.materials) {
+			mats.push_back(make_material(desc, data.search_path, load_texture));
+		}
+
+		for (auto i = size_t{0}; i < data.material_ids.size(); ++i) {
+			model.meshes.push_back(mesh::init(data.meshes[i]));
+			// faces without a material get the default one
+			auto material_id = data.material_ids[i];
+			model.materials.push_back(material_id < 0 ? material_t{} : mats[(size_t)material_id]);
 		}
 		return model;
 	}
 
+	void release(model_data_t& data) {
+		mesh_cache::close(data.cache);
+		data = model_data_t{};
+	}
+
 	void destroy(const model_t& model) {
 		for (auto const& mesh : model.meshes) {
 			mesh::destroy(mesh);
@@ -0,0 +1,622 @@
+#include "ass3/obj_parser.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <chicken3421/chicken3421.hpp>
+
+namespace {
+	// chunks smaller than this aren't worth a thread
+	const size_t MIN_CHUNK_SIZE = size_t{1} << 16;
+
+	const unsigned char LOCAL_VERTEX = 1u << 0;
+	const unsigned char LOCAL_NORMAL = 1u << 1;
+	const unsigned char LOCAL_TEXCOORD = 1u << 2;
+
+	// a face corner as written in the file. Positive OBJ indices are already global; negative
+	// (relative) ones can only be resolved once the pool sizes of earlier chunks are known, so
+	// they are kept relative to the start of the chunk and flagged in local_mask
+	struct raw_index_t {
+		int vertex_index = -1;
+		int normal_index = -1;
+		int texcoord_index = -1;
+		unsigned char local_mask = 0;
+	};
+
+	// a run of faces belonging to one shape. Only the first segment of a chunk may continue a
+	// shape opened in an earlier chunk
+	struct segment_t {
+		bool starts_shape = false;
+		std::string name;
+		std::vector<raw_index_t> corners;
+		std::vector<int> material_slots; // per triangle, into chunk_t::material_names, -1 inherits
+		std::vector<obj_parser::index_t> indices; // resolved corners
+		std::vector<int> material_ids; // resolved materials
+	};
+
+	struct chunk_t {
+		const char* begin = nullptr;
+		const char* end = nullptr;
+		std::vector<float> vertices;
+		std::vector<float> normals;
+		std::vector<float> texcoords;
+		std::vector<segment_t> segments;
+		std::vector<std::string> material_names; // usemtl statements in order
+		std::vector<std::string> mtl_libs;
+		std::vector<raw_index_t> face; // corners of the face being parsed, reused between faces
+
+		// filled in between the parse and fix-up passes
+		int vertex_base = 0;
+		int normal_base = 0;
+		int texcoord_base = 0;
+		int inherited_material = -1;
+	};
+
+	// one run_parallel() call. Its indices are claimed by whichever threads get to it first
+	struct batch_t {
+		std::function<void(size_t)> fn;
+		size_t count = 0;
+		std::atomic<size_t> next{0};
+		size_t done = 0; // guarded by mutex
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+
+	// threads shared by every parse, started on first use. Parses running on several asset loader
+	// workers at once queue their chunks here rather than each starting threads of their own
+	struct pool_t {
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<std::shared_ptr<batch_t>> jobs; // guarded by mutex
+		bool stopping = false; // guarded by mutex
+
+		~pool_t() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			wake.notify_all();
+			for (auto& worker : workers) {
+				worker.join();
+			}
+		}
+	};
+
+	// run the indices of a batch nobody has claimed yet
+	void work(batch_t& batch) {
+		size_t ran = 0;
+		for (auto i = batch.next++; i < batch.count; i = batch.next++) {
+			batch.fn(i);
+			++ran;
+		}
+		if (ran == 0) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(batch.mutex);
+		batch.done += ran;
+		if (batch.done == batch.count) {
+			batch.finished.notify_all();
+		}
+	}
+
+	void pool_main(pool_t& pool) {
+		while (true) {
+			std::shared_ptr<batch_t> batch;
+			{
+				std::unique_lock<std::mutex> lock(pool.mutex);
+				pool.wake.wait(lock, [&pool] { return pool.stopping || !pool.jobs.empty(); });
+				if (pool.stopping) {
+					return;
+				}
+				batch = std::move(pool.jobs.front());
+				pool.jobs.pop_front();
+			}
+			work(*batch);
+		}
+	}
+
+	pool_t& shared_pool() {
+		static pool_t pool;
+		static std::once_flag started;
+		std::call_once(started, [] {
+			// the calling thread works too
+			auto n_workers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+			for (unsigned i = 0; i < n_workers; ++i) {
+				pool.workers.emplace_back(pool_main, std::ref(pool));
+			}
+		});
+		return pool;
+	}
+
+	// runs fn(0) .. fn(count - 1) on the shared pool and the calling thread. The caller works
+	// through its own batch as well, so it never waits on a pool busy with other parses
+	void run_parallel(size_t count, std::function<void(size_t)> fn) {
+		auto batch = std::make_shared<batch_t>();
+		batch->fn = std::move(fn);
+		batch->count = count;
+		if (count > 1) {
+			auto& pool = shared_pool();
+			{
+				std::lock_guard<std::mutex> lock(pool.mutex);
+				for (auto i = size_t{1}; i < count; ++i) {
+					pool.jobs.push_back(batch);
+				}
+			}
+			pool.wake.notify_all();
+		}
+		work(*batch);
+		std::unique_lock<std::mutex> lock(batch->mutex);
+		batch->finished.wait(lock, [&batch] { return batch->done == batch->count; });
+	}
+
+	bool is_space(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	const char* skip_space(const char* p, const char* end) {
+		while (p < end && is_space(*p)) {
+			++p;
+		}
+		return p;
+	}
+
+	// strtof is locale dependent and dominated by its own overhead on OBJ-sized numbers
+	const char* parse_float(const char* p, const char* end, float& out) {
+		p = skip_space(p, end);
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			++p;
+		}
+		double value = 0.0;
+		while (p < end && *p >= '0' && *p <= '9') {
+			value = value * 10.0 + (*p++ - '0');
+		}
+		if (p < end && *p == '.') {
+			++p;
+			double scale = 0.1;
+			while (p < end && *p >= '0' && *p <= '9') {
+				value += (*p++ - '0') * scale;
+				scale *= 0.1;
+			}
+		}
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			++p;
+			bool negative_exp = false;
+			if (p < end && (*p == '-' || *p == '+')) {
+				negative_exp = *p == '-';
+				++p;
+			}
+			int exponent = 0;
+			while (p < end && *p >= '0' && *p <= '9') {
+				exponent = exponent * 10 + (*p++ - '0');
+			}
+			double base = negative_exp ? 0.1 : 10.0;
+			while (exponent-- > 0) {
+				value *= base;
+			}
+		}
+		out = (float)(negative ? -value : value);
+		return p;
+	}
+
+	const char* parse_int(const char* p, const char* end, int& out, bool& found) {
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			++p;
+		}
+		found = false;
+		int value = 0;
+		while (p < end && *p >= '0' && *p <= '9') {
+			value = value * 10 + (*p++ - '0');
+			found = true;
+		}
+		out = negative ? -value : value;
+		return p;
+	}
+
+	// converts a 1-based (or negative, relative) OBJ index, returns true if it is chunk-local
+	bool resolve_obj_index(int value, int local_count, int& out) {
+		if (value > 0) {
+			out = value - 1;
+			return false;
+		}
+		out = local_count + value;
+		return true;
+	}
+
+	std::string rest_of_line(const char* p, const char* end) {
+		p = skip_space(p, end);
+		const char* last = end;
+		while (last > p && is_space(last[-1])) {
+			--last;
+		}
+		return std::string(p, last);
+	}
+
+	bool keyword(const char* p, const char* end, const char* word, const char*& after) {
+		size_t len = std::strlen(word);
+		if ((size_t)(end - p) < len || std::memcmp(p, word, len) != 0) {
+			return false;
+		}
+		if (p + len < end && !is_space(p[len])) {
+			return false;
+		}
+		after = p + len;
+		return true;
+	}
+
+	void parse_face(chunk_t& chunk,
+	                segment_t& segment,
+	                int material_slot,
+	                const char* p,
+	                const char* end) {
+		auto n_vertices = (int)(chunk.vertices.size() / 3);
+		auto n_normals = (int)(chunk.normals.size() / 3);
+		auto n_texcoords = (int)(chunk.texcoords.size() / 2);
+
+		auto& corners = chunk.face;
+		corners.clear();
+		while (true) {
+			p = skip_space(p, end);
+			if (p >= end) {
+				break;
+			}
+			auto corner = raw_index_t{};
+			int value;
+			bool found;
+			p = parse_int(p, end, value, found);
+			chicken3421::expect(found, "obj_parser: malformed face");
+			if (resolve_obj_index(value, n_vertices, corner.vertex_index)) {
+				corner.local_mask |= LOCAL_VERTEX;
+			}
+			if (p < end && *p == '/') {
+				p = parse_int(p + 1, end, value, found);
+				if (found && resolve_obj_index(value, n_texcoords, corner.texcoord_index)) {
+					corner.local_mask |= LOCAL_TEXCOORD;
+				}
+				if (p < end && *p == '/') {
+					p = parse_int(p + 1, end, value, found);
+					if (found && resolve_obj_index(value, n_normals, corner.normal_index)) {
+						corner.local_mask |= LOCAL_NORMAL;
+					}
+				}
+			}
+			while (p < end && !is_space(*p)) {
+				++p;
+			}
+			corners.push_back(corner);
+		}
+
+		// fan triangulation, same as tinyobj for convex polygons
+		for (auto i = size_t{1}; i + 1 < corners.size(); ++i) {
+			segment.corners.push_back(corners[0]);
+			segment.corners.push_back(corners[i]);
+			segment.corners.push_back(corners[i + 1]);
+			segment.material_slots.push_back(material_slot);
+		}
+	}
+
+	void parse_chunk(chunk_t& chunk) {
+		int material_slot = -1;
+		chunk.segments.emplace_back();
+
+		const char* line = chunk.begin;
+		while (line < chunk.end) {
+			const char* eol = (const char*)std::memchr(line, '\n', (size_t)(chunk.end - line));
+			if (!eol) {
+				eol = chunk.end;
+			}
+			const char* p = skip_space(line, eol);
+			const char* after = nullptr;
+			float x, y, z;
+
+			if (keyword(p, eol, "v", after)) {
+				after = parse_float(after, eol, x);
+				after = parse_float(after, eol, y);
+				parse_float(after, eol, z);
+				chunk.vertices.insert(chunk.vertices.end(), {x, y, z});
+			}
+			else if (keyword(p, eol, "vn", after)) {
+				after = parse_float(after, eol, x);
+				after = parse_float(after, eol, y);
+				parse_float(after, eol, z);
+				chunk.normals.insert(chunk.normals.end(), {x, y, z});
+			}
+			else if (keyword(p, eol, "vt", after)) {
+				after = parse_float(after, eol, x);
+				parse_float(after, eol, y);
+				chunk.texcoords.insert(chunk.texcoords.end(), {x, y});
+			}
+			else if (keyword(p, eol, "f", after)) {
+				parse_face(chunk, chunk.segments.back(), material_slot, after, eol);
+			}
+			else if (keyword(p, eol, "o", after) || keyword(p, eol, "g", after)) {
+				auto segment = segment_t{};
+				segment.starts_shape = true;
+				segment.name = rest_of_line(after, eol);
+				chunk.segments.push_back(std::move(segment));
+			}
+			else if (keyword(p, eol, "usemtl", after)) {
+				material_slot = (int)chunk.material_names.size();
+				chunk.material_names.push_back(rest_of_line(after, eol));
+			}
+			else if (keyword(p, eol, "mtllib", after)) {
+				chunk.mtl_libs.push_back(rest_of_line(after, eol));
+			}
+			line = eol + 1;
+		}
+	}
+
+	void resolve_chunk(chunk_t& chunk, const std::vector<int>& slot_materials) {
+		for (auto& segment : chunk.segments) {
+			segment.indices.resize(segment.corners.size());
+			for (auto i = size_t{0}; i < segment.corners.size(); ++i) {
+				const auto& corner = segment.corners[i];
+				auto& index = segment.indices[i];
+				index.vertex_index =
+				   corner.vertex_index + (corner.local_mask & LOCAL_VERTEX ? chunk.vertex_base : 0);
+				index.normal_index =
+				   corner.normal_index + (corner.local_mask & LOCAL_NORMAL ? chunk.normal_base : 0);
+				index.texcoord_index = corner.texcoord_index +
+				                       (corner.local_mask & LOCAL_TEXCOORD ? chunk.texcoord_base : 0);
+			}
+			segment.corners = {};
+
+			segment.material_ids.resize(segment.material_slots.size());
+			for (auto i = size_t{0}; i < segment.material_slots.size(); ++i) {
+				int slot = segment.material_slots[i];
+				segment.material_ids[i] = slot < 0 ? chunk.inherited_material : slot_materials[(size_t)slot];
+			}
+			segment.material_slots = {};
+		}
+	}
+
+	std::string read_file(const std::string& path) {
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		chicken3421::expect((bool)file, "obj_parser: could not open " + path);
+		auto size = (size_t)file.tellg();
+		std::string bytes(size, '\0');
+		file.seekg(0);
+		file.read(&bytes[0], (std::streamsize)size);
+		return bytes;
+	}
+
+	// texture statements may carry options (e.g. "map_Bump -bm 0.5 normal.png") before the name
+	std::string parse_texname(const char* p, const char* end) {
+		static const std::unordered_map<std::string, int> option_args = {
+		   {"-blendu", 1}, {"-blendv", 1}, {"-boost", 1}, {"-mm", 2}, {"-o", 3}, {"-s", 3},
+		   {"-t", 3}, {"-texres", 1}, {"-clamp", 1}, {"-bm", 1}, {"-imfchan", 1}, {"-type", 1},
+		};
+		while (true) {
+			p = skip_space(p, end);
+			if (p >= end || *p != '-') {
+				break;
+			}
+			const char* token_end = p;
+			while (token_end < end && !is_space(*token_end)) {
+				++token_end;
+			}
+			auto option = option_args.find(std::string(p, token_end));
+			if (option == option_args.end()) {
+				break;
+			}
+			p = token_end;
+			for (int i = 0; i < option->second; ++i) {
+				const char* arg = skip_space(p, end);
+				const char* arg_end = arg;
+				while (arg_end < end && !is_space(*arg_end)) {
+					++arg_end;
+				}
+				// -o/-s/-t take 1 to 3 numbers
+				bool numeric = arg < arg_end &&
+				               ((*arg >= '0' && *arg <= '9') || *arg == '-' || *arg == '.' || *arg == '+');
+				if (i > 0 && !numeric) {
+					break;
+				}
+				p = arg_end;
+			}
+		}
+		return rest_of_line(p, end);
+	}
+} // namespace
+
+namespace obj_parser {
+	std::vector<material_t> parse_mtl(const std::string& path) {
+		std::vector<material_t> materials;
+		std::string bytes = read_file(path);
+		const char* line = bytes.data();
+		const char* end = bytes.data() + bytes.size();
+		while (line < end) {
+			const char* eol = (const char*)std::memchr(line, '\n', (size_t)(end - line));
+			if (!eol) {
+				eol = end;
+			}
+			const char* p = skip_space(line, eol);
+			const char* after = nullptr;
+			line = eol + 1;
+
+			if (keyword(p, eol, "newmtl", after)) {
+				materials.emplace_back();
+				materials.back().name = rest_of_line(after, eol);
+				continue;
+			}
+			if (materials.empty()) {
+				continue;
+			}
+
+			auto& mat = materials.back();
+			float value;
+			if (keyword(p, eol, "Ka", after)) {
+				for (float& c : mat.ambient) {
+					after = parse_float(after, eol, c);
+				}
+			}
+			else if (keyword(p, eol, "Kd", after)) {
+				for (float& c : mat.diffuse) {
+					after = parse_float(after, eol, c);
+				}
+			}
+			else if (keyword(p, eol, "Ks", after)) {
+				for (float& c : mat.specular) {
+					after = parse_float(after, eol, c);
+				}
+			}
+			else if (keyword(p, eol, "Ns", after)) {
+				parse_float(after, eol, mat.shininess);
+			}
+			else if (keyword(p, eol, "d", after)) {
+				parse_float(after, eol, mat.dissolve);
+			}
+			else if (keyword(p, eol, "Tr", after)) {
+				parse_float(after, eol, value);
+				mat.dissolve = 1.0f - value;
+			}
+			else if (keyword(p, eol, "map_Ka", after)) {
+				mat.ambient_texname = parse_texname(after, eol);
+			}
+			else if (keyword(p, eol, "map_Kd", after)) {
+				mat.diffuse_texname = parse_texname(after, eol);
+			}
+			else if (keyword(p, eol, "map_Ks", after)) {
+				mat.specular_texname = parse_texname(after, eol);
+			}
+			else if (keyword(p, eol, "map_Ns", after)) {
+				mat.specular_highlight_texname = parse_texname(after, eol);
+			}
+			else if (keyword(p, eol, "map_Bump", after) || keyword(p, eol, "map_bump", after) ||
+			         keyword(p, eol, "bump", after)) {
+				mat.bump_texname = parse_texname(after, eol);
+			}
+		}
+		return materials;
+	}
+
+	obj_t parse(const std::string& path, const std::string& mtl_search_path, unsigned n_threads) {
+		std::string bytes = read_file(path);
+
+		if (n_threads == 0) {
+			n_threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		size_t n_chunks = std::clamp(bytes.size() / MIN_CHUNK_SIZE, size_t{1}, (size_t)n_threads);
+
+		// split on line boundaries
+		std::vector<chunk_t> chunks(n_chunks);
+		const char* begin = bytes.data();
+		const char* end = bytes.data() + bytes.size();
+		const char* cursor = begin;
+		for (auto i = size_t{0}; i < n_chunks; ++i) {
+			const char* split = i + 1 == n_chunks ? end : begin + bytes.size() * (i + 1) / n_chunks;
+			split = std::max(split, cursor);
+			const char* eol = (const char*)std::memchr(split, '\n', (size_t)(end - split));
+			chunks[i].begin = cursor;
+			chunks[i].end = eol ? eol + 1 : end;
+			cursor = chunks[i].end;
+		}
+
+		run_parallel(n_chunks, [&chunks](size_t i) { parse_chunk(chunks[i]); });
+
+		auto obj = obj_t{};
+
+		// materials are few and usually declared once at the top, no point parallelising
+		for (const auto& chunk : chunks) {
+			for (const auto& lib : chunk.mtl_libs) {
+				auto lib_path = mtl_search_path + lib;
+				auto lib_materials = parse_mtl(lib_path);
+				obj.materials.insert(obj.materials.end(), lib_materials.begin(), lib_materials.end());
+				obj.mtl_libs.push_back(lib_path);
+			}
+		}
+		std::unordered_map<std::string, int> material_lookup;
+		for (auto i = size_t{0}; i < obj.materials.size(); ++i) {
+			material_lookup.emplace(obj.materials[i].name, (int)i);
+		}
+
+		// prefix sums of the pool sizes give each chunk its global base index
+		std::vector<std::vector<int>> slot_materials(n_chunks);
+		int vertex_base = 0, normal_base = 0, texcoord_base = 0, current_material = -1;
+		for (auto i = size_t{0}; i < n_chunks; ++i) {
+			auto& chunk = chunks[i];
+			chunk.vertex_base = vertex_base;
+			chunk.normal_base = normal_base;
+			chunk.texcoord_base = texcoord_base;
+			chunk.inherited_material = current_material;
+			vertex_base += (int)(chunk.vertices.size() / 3);
+			normal_base += (int)(chunk.normals.size() / 3);
+			texcoord_base += (int)(chunk.texcoords.size() / 2);
+
+			for (const auto& name : chunk.material_names) {
+				auto found = material_lookup.find(name);
+				current_material = found == material_lookup.end() ? -1 : found->second;
+				slot_materials[i].push_back(current_material);
+			}
+		}
+
+		obj.attrib.vertices.resize((size_t)vertex_base * 3);
+		obj.attrib.normals.resize((size_t)normal_base * 3);
+		obj.attrib.texcoords.resize((size_t)texcoord_base * 2);
+
+		run_parallel(n_chunks, [&](size_t i) {
+			auto& chunk = chunks[i];
+			resolve_chunk(chunk, slot_materials[i]);
+			std::copy(chunk.vertices.begin(),
+			          chunk.vertices.end(),
+			          obj.attrib.vertices.begin() + chunk.vertex_base * 3);
+			std::copy(chunk.normals.begin(),
+			          chunk.normals.end(),
+			          obj.attrib.normals.begin() + chunk.normal_base * 3);
+			std::copy(chunk.texcoords.begin(),
+			          chunk.texcoords.end(),
+			          obj.attrib.texcoords.begin() + chunk.texcoord_base * 2);
+		});
+
+		// stitch segments into shapes, a shape may span several chunks
+		obj.shapes.emplace_back();
+		for (auto& chunk : chunks) {
+			for (auto& segment : chunk.segments) {
+				if (segment.starts_shape) {
+					obj.shapes.emplace_back();
+					obj.shapes.back().name = segment.name;
+				}
+				auto& mesh = obj.shapes.back().mesh;
+				mesh.indices.insert(mesh.indices.end(), segment.indices.begin(), segment.indices.end());
+				mesh.material_ids.insert(
+				   mesh.material_ids.end(), segment.material_ids.begin(), segment.material_ids.end());
+			}
+		}
+		obj.shapes.erase(std::remove_if(obj.shapes.begin(),
+		                                obj.shapes.end(),
+		                                [](const shape_t& shape) { return shape.mesh.indices.empty(); }),
+		                 obj.shapes.end());
+		for (auto& shape : obj.shapes) {
+			shape.mesh.num_face_vertices.assign(shape.mesh.material_ids.size(), 3);
+		}
+
+		// every index must land inside the merged pools. A file with normals or texcoords needs them
+		// on every corner, the mesh templates read one per vertex
+		auto in_pool = [](int index, int pool_size) {
+			return pool_size == 0 ? index < 0 : index >= 0 && index < pool_size;
+		};
+		for (const auto& shape : obj.shapes) {
+			for (const auto& index : shape.mesh.indices) {
+				chicken3421::expect(index.vertex_index >= 0 && index.vertex_index < vertex_base &&
+				                       in_pool(index.normal_index, normal_base) &&
+				                       in_pool(index.texcoord_index, texcoord_base),
+				                    "obj_parser: index out of range in " + path);
+			}
+		}
+
+		return obj;
+	}
+} // namespace obj_parser
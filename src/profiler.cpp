@@ -0,0 +1,232 @@
+#include "ass3/profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <chicken3421/chicken3421.hpp>
+
+namespace {
+	// the GPU's track in the trace, CPU threads are numbered from 1 as they first record
+	const uint32_t GPU_THREAD = 0;
+
+	struct event_t {
+		const char* name = nullptr;
+		uint64_t begin = 0; // ns, see now()
+		uint64_t end = 0;
+	};
+
+	// single producer (the owning thread), single consumer (the GL thread in begin_frame())
+	struct thread_ring_t {
+		uint32_t thread = 0;
+		event_t events[profiler::THREAD_EVENTS];
+		std::atomic<size_t> head{0}; // written by the owner
+		std::atomic<size_t> tail{0}; // written by the consumer
+	};
+
+	struct trace_event_t {
+		const char* name;
+		uint32_t thread;
+		uint64_t begin;
+		uint64_t end;
+	};
+
+	// a ring slot of GPU zones, a begin and end timestamp query each
+	struct gpu_frame_t {
+		GLuint queries[profiler::MAX_GPU_ZONES * 2] = {};
+		const char* names[profiler::MAX_GPU_ZONES] = {};
+		int count = 0;
+		uint64_t cpu_base = 0; // the same moment on both clocks, maps GPU times onto the CPU's
+		GLint64 gpu_base = 0;
+	};
+
+	struct window_t {
+		std::vector<double> samples; // ms, a ring once full
+		size_t next = 0;
+	};
+
+	std::mutex rings_mutex; // guards rings, taken once per thread and by the consumer
+	std::vector<std::unique_ptr<thread_ring_t>> rings;
+	thread_local thread_ring_t* this_ring = nullptr;
+
+	// GL thread only
+	gpu_frame_t gpu_frames[profiler::GPU_FRAMES];
+	int gpu_frame = 0;
+	bool gpu_ready = false;
+	std::deque<trace_event_t> trace;
+	std::map<std::string, window_t> windows;
+
+	uint64_t now() {
+		static const auto epoch = std::chrono::steady_clock::now();
+		auto elapsed = std::chrono::steady_clock::now() - epoch;
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+	}
+
+	thread_ring_t& ring() {
+		if (!this_ring) {
+			std::lock_guard<std::mutex> lock(rings_mutex);
+			rings.push_back(std::make_unique<thread_ring_t>());
+			this_ring = rings.back().get();
+			this_ring->thread = (uint32_t)rings.size();
+		}
+		return *this_ring;
+	}
+
+	void add(const char* name, uint32_t thread, uint64_t begin, uint64_t end) {
+		if (trace.size() == profiler::MAX_TRACE_EVENTS) {
+			trace.pop_front();
+		}
+		trace.push_back({name, thread, begin, end});
+
+		auto& window = windows[thread == GPU_THREAD ? "gpu " + std::string(name) : name];
+		auto ms = (double)(end - begin) / 1e6;
+		if (window.samples.size() < profiler::STATS_WINDOW) {
+			window.samples.push_back(ms);
+		}
+		else {
+			window.samples[window.next] = ms;
+			window.next = (window.next + 1) % profiler::STATS_WINDOW;
+		}
+	}
+
+	// read back the slot about to be reused, skipping zones the GPU has not finished
+	void read_gpu_frame(gpu_frame_t& frame) {
+		for (int i = 0; i < frame.count; ++i) {
+			GLint available = 0;
+			glGetQueryObjectiv(frame.queries[i * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				continue;
+			}
+			GLuint64 begin = 0;
+			GLuint64 end = 0;
+			glGetQueryObjectui64v(frame.queries[i * 2], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame.queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+			auto offset = (int64_t)begin - (int64_t)frame.gpu_base;
+			auto cpu_begin = (uint64_t)std::max<int64_t>((int64_t)frame.cpu_base + offset, 0);
+			add(frame.names[i], GPU_THREAD, cpu_begin, cpu_begin + (end - begin));
+		}
+		frame.count = 0;
+	}
+
+	void drain_rings() {
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		for (auto& thread_ring : rings) {
+			auto tail = thread_ring->tail.load(std::memory_order_relaxed);
+			auto head = thread_ring->head.load(std::memory_order_acquire);
+			for (; tail != head; ++tail) {
+				const auto& event = thread_ring->events[tail % profiler::THREAD_EVENTS];
+				add(event.name, thread_ring->thread, event.begin, event.end);
+			}
+			thread_ring->tail.store(tail, std::memory_order_release);
+		}
+	}
+} // namespace
+
+namespace profiler {
+	cpu_zone_t::cpu_zone_t(const char* zone_name) : name(zone_name), begin(now()) {}
+
+	cpu_zone_t::~cpu_zone_t() {
+		auto end = now();
+		auto& thread_ring = ring();
+		auto head = thread_ring.head.load(std::memory_order_relaxed);
+		if (head - thread_ring.tail.load(std::memory_order_acquire) == THREAD_EVENTS) {
+			return; // full until the next drain
+		}
+		thread_ring.events[head % THREAD_EVENTS] = {name, begin, end};
+		thread_ring.head.store(head + 1, std::memory_order_release);
+	}
+
+	gpu_zone_t::gpu_zone_t(const char* zone_name) : slot(-1) {
+		auto& frame = gpu_frames[gpu_frame];
+		if (!gpu_ready || frame.count == MAX_GPU_ZONES) {
+			return;
+		}
+		slot = frame.count++;
+		frame.names[slot] = zone_name;
+		glQueryCounter(frame.queries[slot * 2], GL_TIMESTAMP);
+	}
+
+	gpu_zone_t::~gpu_zone_t() {
+		if (slot >= 0) {
+			glQueryCounter(gpu_frames[gpu_frame].queries[slot * 2 + 1], GL_TIMESTAMP);
+		}
+	}
+
+	void init() {
+		for (auto& frame : gpu_frames) {
+			glGenQueries(MAX_GPU_ZONES * 2, frame.queries);
+			frame.count = 0;
+		}
+		gpu_frame = 0;
+		gpu_ready = true;
+		glGetInteger64v(GL_TIMESTAMP, &gpu_frames[0].gpu_base);
+		gpu_frames[0].cpu_base = now();
+	}
+
+	void destroy() {
+		for (auto& frame : gpu_frames) {
+			glDeleteQueries(MAX_GPU_ZONES * 2, frame.queries);
+			frame = gpu_frame_t{};
+		}
+		gpu_ready = false;
+	}
+
+	void begin_frame() {
+		if (gpu_ready) {
+			gpu_frame = (gpu_frame + 1) % GPU_FRAMES;
+			auto& frame = gpu_frames[gpu_frame];
+			read_gpu_frame(frame);
+			glGetInteger64v(GL_TIMESTAMP, &frame.gpu_base);
+			frame.cpu_base = now();
+		}
+		drain_rings();
+	}
+
+	std::vector<zone_stats_t> stats() {
+		std::vector<zone_stats_t> result;
+		for (const auto& [name, window] : windows) {
+			auto zone = zone_stats_t{};
+			zone.name = name;
+			zone.samples = window.samples.size();
+			auto sorted = window.samples;
+			std::sort(sorted.begin(), sorted.end());
+			zone.min_ms = sorted.front();
+			for (auto ms : sorted) {
+				zone.avg_ms += ms / (double)sorted.size();
+			}
+			zone.p99_ms = sorted[(size_t)(0.99 * (double)(sorted.size() - 1) + 0.5)];
+			result.push_back(zone);
+		}
+		return result;
+	}
+
+	void write_trace(const std::string& path) {
+		std::ofstream out(path, std::ios::trunc);
+		chicken3421::expect(out.good(), "profiler: could not write " + path);
+
+		// timestamps and durations are in microseconds
+		out << "{\"traceEvents\": [\n";
+		out << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": " << GPU_THREAD
+		    << ", \"args\": {\"name\": \"GPU\"}}";
+		{
+			std::lock_guard<std::mutex> lock(rings_mutex);
+			for (const auto& thread_ring : rings) {
+				out << ",\n{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": "
+				    << thread_ring->thread << ", \"args\": {\"name\": \"thread "
+				    << thread_ring->thread << "\"}}";
+			}
+		}
+		for (const auto& event : trace) {
+			out << ",\n{\"ph\": \"X\", \"name\": \"" << event.name << "\", \"cat\": \""
+			    << (event.thread == GPU_THREAD ? "gpu" : "cpu") << "\", \"pid\": 1, \"tid\": "
+			    << event.thread << ", \"ts\": " << (double)event.begin / 1e3
+			    << ", \"dur\": " << (double)(event.end - event.begin) / 1e3 << "}";
+		}
+		out << "\n]}\n";
+	}
+} // namespace profiler
@@ -0,0 +1,254 @@
+#include "ass3/program_cache.hpp"
+#include "ass3/cache_file.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include <chicken3421/chicken3421.hpp>
+
+const char* PROGRAM_CACHE_DIR = "res/shaders/cache";
+
+// GL 4.1 / ARB_get_program_binary
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+namespace {
+	const char* CACHE_EXTENSION = ".programcache";
+	const uint32_t CACHE_MAGIC = 0x42503341; // "A3PB"
+	const uint32_t CACHE_VERSION = 1;
+
+	struct header_t {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key; // repeated from the file name, guards against renamed files
+		uint32_t format; // the driver's binary format
+		uint32_t size; // of the binary that follows
+	};
+
+	using get_program_binary_t = void(APIENTRYP)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+	using program_binary_t = void(APIENTRYP)(GLuint, GLenum, const void*, GLsizei);
+	using program_parameteri_t = void(APIENTRYP)(GLuint, GLenum, GLint);
+
+	get_program_binary_t get_program_binary = nullptr;
+	program_binary_t program_binary = nullptr;
+	program_parameteri_t program_parameteri = nullptr;
+	bool enabled = false;
+	std::string driver; // vendor, renderer and version, part of every key
+	program_cache::stats_t counters;
+
+	std::string read_source(const std::string& path) {
+		std::ifstream file(path, std::ios::binary);
+		chicken3421::expect(file.good(), "program_cache: could not open " + path);
+		return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	}
+
+	// the defines go after the #version line, which has to come first. A #line directive keeps the
+	// line numbers in compile errors those of the file
+	std::string with_defines(const std::string& source, const std::string& defines) {
+		if (defines.empty()) {
+			return source;
+		}
+		auto version = source.find("#version");
+		if (version == std::string::npos) {
+			return defines + source;
+		}
+		auto line_end = source.find('\n', version);
+		if (line_end == std::string::npos) {
+			return source + "\n" + defines;
+		}
+		auto lines = std::count(source.begin(), source.begin() + (std::ptrdiff_t)line_end, '\n');
+		auto next_line = "#line " + std::to_string(lines + 2) + "\n";
+		return source.substr(0, line_end + 1) + defines + next_line + source.substr(line_end + 1);
+	}
+
+	std::string gl_string(GLenum name) {
+		auto value = (const char*)glGetString(name);
+		return value ? value : "";
+	}
+
+	// core in 4.1, an extension before
+	bool has_program_binary() {
+		GLint major = 0;
+		GLint minor = 0;
+		glGetIntegerv(GL_MAJOR_VERSION, &major);
+		glGetIntegerv(GL_MINOR_VERSION, &minor);
+		if (major > 4 || (major == 4 && minor >= 1)) {
+			return true;
+		}
+		GLint n_extensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &n_extensions);
+		for (GLint i = 0; i < n_extensions; ++i) {
+			auto name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+			if (name && std::string(name) == "GL_ARB_get_program_binary") {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::string cache_path(uint64_t key) {
+		char name[17];
+		std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+		return std::string(PROGRAM_CACHE_DIR) + "/" + name + CACHE_EXTENSION;
+	}
+
+	GLuint compile(const std::string& path, const std::string& source, GLenum type) {
+		GLuint shader = glCreateShader(type);
+		auto text = source.c_str();
+		glShaderSource(shader, 1, &text, nullptr);
+		glCompileShader(shader);
+
+		GLint ok = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+		if (!ok) {
+			GLint length = 0;
+			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+			std::string log((size_t)std::max(length, 1), '\0');
+			glGetShaderInfoLog(shader, length, nullptr, &log[0]);
+			chicken3421::expect(false, "program_cache: " + path + " failed to compile:\n" + log);
+		}
+		return shader;
+	}
+
+	GLuint link(const std::string& vs_path,
+	            const std::string& vs_source,
+	            const std::string& fs_path,
+	            const std::string& fs_source) {
+		GLuint vs = compile(vs_path, vs_source, GL_VERTEX_SHADER);
+		GLuint fs = compile(fs_path, fs_source, GL_FRAGMENT_SHADER);
+		GLuint program = glCreateProgram();
+		glAttachShader(program, vs);
+		glAttachShader(program, fs);
+		if (enabled) {
+			program_parameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+		glLinkProgram(program);
+		glDetachShader(program, vs);
+		glDetachShader(program, fs);
+		glDeleteShader(vs);
+		glDeleteShader(fs);
+
+		GLint ok = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &ok);
+		if (!ok) {
+			GLint length = 0;
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+			std::string log((size_t)std::max(length, 1), '\0');
+			glGetProgramInfoLog(program, length, nullptr, &log[0]);
+			chicken3421::expect(
+			   false, "program_cache: " + vs_path + " and " + fs_path + " failed to link:\n" + log);
+		}
+		return program;
+	}
+
+	// a program from the cache file, or 0 if there is none or the driver refuses it
+	GLuint restore(uint64_t key) {
+		std::ifstream file(cache_path(key), std::ios::binary);
+		if (!file) {
+			return 0;
+		}
+		auto header = header_t{};
+		file.read((char*)&header, sizeof(header));
+		if (!file || header.magic != CACHE_MAGIC || header.version != CACHE_VERSION
+		    || header.key != key) {
+			return 0;
+		}
+		std::vector<char> binary(header.size);
+		file.read(binary.data(), (std::streamsize)binary.size());
+		if (!file) {
+			return 0;
+		}
+
+		GLuint program = glCreateProgram();
+		program_binary(program, header.format, binary.data(), (GLsizei)binary.size());
+		GLint ok = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &ok);
+		if (!ok) {
+			glDeleteProgram(program);
+			++counters.rejected;
+			return 0;
+		}
+		return program;
+	}
+
+	void save(uint64_t key, GLuint program) {
+		GLint size = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+		if (size <= 0) {
+			return;
+		}
+		std::vector<char> binary((size_t)size);
+		GLenum format = 0;
+		get_program_binary(program, size, nullptr, &format, binary.data());
+
+		std::error_code ec;
+		std::filesystem::create_directories(PROGRAM_CACHE_DIR, ec);
+		cache_file::write(cache_path(key), "program_cache", [&](std::ofstream& out) {
+			auto header = header_t{CACHE_MAGIC, CACHE_VERSION, key, format, (uint32_t)size};
+			out.write((const char*)&header, sizeof(header));
+			out.write(binary.data(), (std::streamsize)binary.size());
+		});
+	}
+} // namespace
+
+namespace program_cache {
+	void init(GLADloadproc load) {
+		counters = stats_t{};
+		enabled = false;
+		driver = gl_string(GL_VENDOR) + "\n" + gl_string(GL_RENDERER) + "\n" + gl_string(GL_VERSION);
+		// loaders hand out pointers for names the context does not support, so ask the context
+		if (!has_program_binary()) {
+			return;
+		}
+		get_program_binary = (get_program_binary_t)load("glGetProgramBinary");
+		program_binary = (program_binary_t)load("glProgramBinary");
+		program_parameteri = (program_parameteri_t)load("glProgramParameteri");
+
+		// a driver may support the functions and still offer no format
+		GLint formats = 0;
+		if (get_program_binary && program_binary && program_parameteri) {
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		}
+		enabled = formats > 0;
+	}
+
+	GLuint load(const std::string& vs_path,
+	            const std::string& fs_path,
+	            const std::string& defines) {
+		auto vs_source = with_defines(read_source(vs_path), defines);
+		auto fs_source = with_defines(read_source(fs_path), defines);
+		// the separators keep the boundary between the parts in the hash
+		auto key_bytes = driver + '\0' + vs_source + '\0' + fs_source;
+		auto key = cache_file::hash_bytes(key_bytes.data(), key_bytes.size());
+
+		if (enabled) {
+			if (GLuint program = restore(key)) {
+				++counters.restored;
+				return program;
+			}
+		}
+		GLuint program = link(vs_path, vs_source, fs_path, fs_source);
+		++counters.compiled;
+		if (enabled) {
+			save(key, program);
+		}
+		return program;
+	}
+
+	const stats_t& stats() {
+		return counters;
+	}
+} // namespace program_cache
@@ -0,0 +1,251 @@
+#include "ass3/render_graph.hpp"
+#include "ass3/gl_state.hpp"
+
+#include <chicken3421/chicken3421.hpp>
+
+namespace {
+	const size_t NO_TEXTURE = ~size_t{0};
+
+	bool is_depth_stencil(GLenum format) {
+		return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+	}
+
+	bool is_depth(GLenum format) {
+		return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24
+		       || format == GL_DEPTH_COMPONENT32F || is_depth_stencil(format);
+	}
+
+	GLuint make_texture(GLenum format, int width, int height) {
+		GLenum layout = GL_RGBA;
+		GLenum type = GL_FLOAT;
+		if (is_depth_stencil(format)) {
+			layout = GL_DEPTH_STENCIL;
+			type = format == GL_DEPTH24_STENCIL8 ? GL_UNSIGNED_INT_24_8
+			                                     : GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+		}
+		else if (is_depth(format)) {
+			layout = GL_DEPTH_COMPONENT;
+		}
+
+		GLuint texture;
+		glGenTextures(1, &texture);
+		gl_state::bind_texture(0, GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, (GLint)format, width, height, 0, layout, type, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		return texture;
+	}
+
+	void release(render_graph::graph_t& graph) {
+		for (auto& pooled : graph.pool) {
+			gl_state::delete_textures(1, &pooled.texture);
+		}
+		graph.pool.clear();
+		for (auto& pass : graph.passes) {
+			if (pass.fbo) {
+				gl_state::delete_framebuffers(1, &pass.fbo);
+				pass.fbo = 0;
+			}
+			pass.live = false;
+		}
+		for (auto& resource : graph.resources) {
+			resource.texture = 0;
+		}
+		graph.compiled = false;
+	}
+
+	// a pass is live if something downstream reads what it writes, the back buffer always is
+	void cull(render_graph::graph_t& graph) {
+		std::vector<uint8_t> needed(graph.resources.size(), 0);
+		needed[render_graph::BACK_BUFFER] = 1;
+		for (auto p = graph.passes.size(); p-- > 0;) {
+			auto& pass = graph.passes[p];
+			for (auto resource : pass.writes) {
+				pass.live = pass.live || needed[resource];
+			}
+			if (!pass.live) {
+				++graph.stats.culled_passes;
+				continue;
+			}
+			for (auto resource : pass.reads) {
+				needed[resource] = 1;
+			}
+		}
+	}
+
+	// hand out pool textures in pass order, a texture goes back to the pool after the last live
+	// pass that uses its attachment
+	void allocate(render_graph::graph_t& graph) {
+		auto n = graph.resources.size();
+		std::vector<size_t> last_use(n, 0);
+		for (auto p = size_t{0}; p < graph.passes.size(); ++p) {
+			const auto& pass = graph.passes[p];
+			if (!pass.live) {
+				continue;
+			}
+			for (auto resource : pass.reads) {
+				last_use[resource] = p;
+			}
+			for (auto resource : pass.writes) {
+				last_use[resource] = p;
+			}
+		}
+
+		std::vector<size_t> assigned(n, NO_TEXTURE);
+		std::vector<uint8_t> busy;
+		for (auto p = size_t{0}; p < graph.passes.size(); ++p) {
+			auto& pass = graph.passes[p];
+			if (!pass.live) {
+				continue;
+			}
+			for (auto resource : pass.reads) {
+				chicken3421::expect(assigned[resource] != NO_TEXTURE,
+				                    "render_graph: " + pass.name + " reads "
+				                       + graph.resources[resource].name + " before any pass writes it");
+			}
+			for (auto resource : pass.writes) {
+				if (resource == render_graph::BACK_BUFFER || assigned[resource] != NO_TEXTURE) {
+					continue;
+				}
+				auto format = graph.resources[resource].format;
+				auto& slot = assigned[resource];
+				for (auto i = size_t{0}; i < graph.pool.size() && slot == NO_TEXTURE; ++i) {
+					if (!busy[i] && graph.pool[i].format == format) {
+						slot = i;
+					}
+				}
+				if (slot == NO_TEXTURE) {
+					slot = graph.pool.size();
+					graph.pool.push_back({make_texture(format, graph.width, graph.height), format});
+					busy.push_back(0);
+				}
+				busy[slot] = 1;
+				graph.resources[resource].texture = graph.pool[slot].texture;
+				++graph.stats.attachments;
+			}
+			for (auto resource = size_t{1}; resource < n; ++resource) {
+				if (assigned[resource] != NO_TEXTURE && last_use[resource] == p) {
+					busy[assigned[resource]] = 0;
+				}
+			}
+		}
+		graph.stats.textures = graph.pool.size();
+	}
+
+	void make_framebuffer(render_graph::graph_t& graph, render_graph::pass_t& pass) {
+		bool back_buffer = false;
+		for (auto resource : pass.writes) {
+			back_buffer = back_buffer || resource == render_graph::BACK_BUFFER;
+		}
+		if (back_buffer) {
+			chicken3421::expect(pass.writes.size() == 1,
+			                    "render_graph: " + pass.name + " writes the back buffer and more");
+			return;
+		}
+
+		glGenFramebuffers(1, &pass.fbo);
+		gl_state::bind_framebuffer(GL_FRAMEBUFFER, pass.fbo);
+		std::vector<GLenum> draw_buffers;
+		for (auto resource : pass.writes) {
+			const auto& target = graph.resources[resource];
+			GLenum attachment = GL_COLOR_ATTACHMENT0 + (GLenum)draw_buffers.size();
+			if (is_depth_stencil(target.format)) {
+				attachment = GL_DEPTH_STENCIL_ATTACHMENT;
+			}
+			else if (is_depth(target.format)) {
+				attachment = GL_DEPTH_ATTACHMENT;
+			}
+			else {
+				draw_buffers.push_back(attachment);
+			}
+			glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, target.texture, 0);
+		}
+		if (draw_buffers.empty()) {
+			glDrawBuffer(GL_NONE);
+		}
+		else {
+			glDrawBuffers((GLsizei)draw_buffers.size(), draw_buffers.data());
+		}
+		chicken3421::expect(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE,
+		                    "render_graph: framebuffer of " + pass.name + " is incomplete");
+		gl_state::bind_framebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void compile(render_graph::graph_t& graph) {
+		release(graph);
+		graph.stats = render_graph::stats_t{};
+		cull(graph);
+		allocate(graph);
+		for (auto& pass : graph.passes) {
+			if (pass.live) {
+				make_framebuffer(graph, pass);
+			}
+		}
+		graph.compiled = true;
+	}
+} // namespace
+
+namespace render_graph {
+	graph_t init() {
+		auto graph = graph_t{};
+		graph.resources.push_back({"back buffer", GL_NONE, 0});
+		return graph;
+	}
+
+	void destroy(graph_t& graph) {
+		release(graph);
+		graph = graph_t{};
+	}
+
+	resource_id_t add_resource(graph_t& graph, const std::string& name, GLenum format) {
+		graph.resources.push_back({name, format, 0});
+		graph.compiled = false;
+		return (resource_id_t)(graph.resources.size() - 1);
+	}
+
+	void add_pass(graph_t& graph,
+	              const std::string& name,
+	              std::vector<resource_id_t> reads,
+	              std::vector<resource_id_t> writes,
+	              std::function<void()> execute) {
+		auto pass = pass_t{};
+		pass.name = name;
+		pass.reads = std::move(reads);
+		pass.writes = std::move(writes);
+		pass.execute = std::move(execute);
+		for (auto resource : pass.reads) {
+			chicken3421::expect(resource < graph.resources.size(), "render_graph: unknown resource");
+		}
+		for (auto resource : pass.writes) {
+			chicken3421::expect(resource < graph.resources.size(), "render_graph: unknown resource");
+		}
+		graph.passes.push_back(std::move(pass));
+		graph.compiled = false;
+	}
+
+	void execute(graph_t& graph, int width, int height) {
+		if (width <= 0 || height <= 0) {
+			return; // minimised
+		}
+		if (!graph.compiled || width != graph.width || height != graph.height) {
+			graph.width = width;
+			graph.height = height;
+			compile(graph);
+		}
+		for (const auto& pass : graph.passes) {
+			if (!pass.live) {
+				continue;
+			}
+			gl_state::bind_framebuffer(GL_FRAMEBUFFER, pass.fbo);
+			gl_state::viewport(0, 0, width, height);
+			pass.execute();
+		}
+		gl_state::bind_framebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	GLuint texture(const graph_t& graph, resource_id_t resource) {
+		return graph.resources[resource].texture;
+	}
+} // namespace render_graph
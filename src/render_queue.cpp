@@ -0,0 +1,120 @@
+#include "ass3/render_queue.hpp"
+
+#include <algorithm>
+
+namespace {
+	const int RADIX_BITS = 8;
+	const int RADIX_PASSES = 64 / RADIX_BITS;
+	const size_t RADIX_BUCKETS = size_t{1} << RADIX_BITS;
+
+	// ids restart once a table outgrows this, so they never drift far past their key field
+	const size_t MAX_INTERNED = size_t{1} << 16;
+
+	template <typename Map, typename Key>
+	uint32_t intern(Map& ids, const Key& key) {
+		return ids.try_emplace(key, (uint32_t)ids.size()).first->second;
+	}
+
+	uint64_t field(uint32_t id, int bits) {
+		return (uint64_t)id & ((uint64_t{1} << bits) - 1);
+	}
+
+	render_queue::texture_set_t texture_set(const model::material_t& material) {
+		return render_queue::texture_set_t{{material.diffuse_map,
+		                                    material.specular_map,
+		                                    material.cube_map,
+		                                    material.normal_map,
+		                                    material.height_map}};
+	}
+
+	render_queue::material_state_t material_state(const model::material_t& material) {
+		auto state = render_queue::material_state_t{};
+		auto values = state.values;
+		*values++ = material.ambient.x;
+		*values++ = material.ambient.y;
+		*values++ = material.ambient.z;
+		*values++ = material.diffuse.x;
+		*values++ = material.diffuse.y;
+		*values++ = material.diffuse.z;
+		*values++ = material.diffuse.w;
+		*values++ = material.specular.x;
+		*values++ = material.specular.y;
+		*values++ = material.specular.z;
+		*values++ = material.phong_exp;
+		*values++ = material.cube_map_factor;
+		return state;
+	}
+} // namespace
+
+namespace render_queue {
+	void clear(queue_t& queue) {
+		queue.packets.clear();
+		// only safe between frames - packets already queued hold material ids
+		if (queue.material_ids.size() > MAX_INTERNED) {
+			queue.material_ids.clear();
+		}
+		if (queue.texture_ids.size() > MAX_INTERNED) {
+			queue.texture_ids.clear();
+		}
+	}
+
+	void push(queue_t& queue, packet_t packet, float view_depth, bool translucent) {
+		auto program = intern(queue.program_ids, packet.program);
+		auto textures = intern(queue.texture_ids, texture_set(*packet.material));
+		packet.material_id = intern(queue.material_ids, material_state(*packet.material));
+
+		auto max_depth = (uint64_t{1} << DEPTH_BITS) - 1;
+		auto depth =
+		   (uint64_t)(std::clamp(view_depth / MAX_SORT_DEPTH, 0.0f, 1.0f) * (float)max_depth);
+
+		auto state = field(program, PROGRAM_BITS) << (TEXTURES_BITS + MATERIAL_BITS)
+		             | field(textures, TEXTURES_BITS) << MATERIAL_BITS
+		             | field(packet.material_id, MATERIAL_BITS);
+		auto state_bits = PROGRAM_BITS + TEXTURES_BITS + MATERIAL_BITS;
+		auto unused_bits = 63 - state_bits - DEPTH_BITS;
+		if (translucent) {
+			packet.key = uint64_t{1} << 63 | (max_depth - depth) << (state_bits + unused_bits)
+			             | state << unused_bits;
+		}
+		else {
+			packet.key = state << (DEPTH_BITS + unused_bits) | depth << unused_bits;
+		}
+		queue.packets.push_back(packet);
+	}
+
+	void sort(queue_t& queue) {
+		auto n = queue.packets.size();
+		queue.order.resize(n);
+		queue.scratch.resize(n);
+
+		// one read pass builds the histograms of every digit
+		size_t counts[RADIX_PASSES][RADIX_BUCKETS] = {};
+		for (size_t i = 0; i < n; ++i) {
+			auto key = queue.packets[i].key;
+			queue.order[i] = sort_item_t{key, (uint32_t)i};
+			for (int pass = 0; pass < RADIX_PASSES; ++pass) {
+				++counts[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)];
+			}
+		}
+
+		for (int pass = 0; pass < RADIX_PASSES && n > 1; ++pass) {
+			auto shift = pass * RADIX_BITS;
+			auto& count = counts[pass];
+			if (count[(queue.order[0].key >> shift) & (RADIX_BUCKETS - 1)] == n) {
+				// every key has the same digit here, the pass would not move anything
+				continue;
+			}
+
+			size_t offset = 0;
+			for (auto& bucket : count) {
+				auto size = bucket;
+				bucket = offset;
+				offset += size;
+			}
+			for (const auto& item : queue.order) {
+				queue.scratch[count[(item.key >> shift) & (RADIX_BUCKETS - 1)]++] = item;
+			}
+			queue.order.swap(queue.scratch);
+		}
+	}
+} // namespace render_queue
@@ -2,6 +2,12 @@
 #include "ass3/texture_2d.hpp"
 #include "ass3/euler_camera.hpp"
 #include "ass3/mesh.hpp"
+#include "ass3/gl_state.hpp"
+#include "ass3/program_cache.hpp"
+#include "ass3/profiler.hpp"
+#include "ass3/texture_streamer.hpp"
+
+#include <algorithm>
 
 #include "chicken3421/chicken3421.hpp"
 
@@ -12,218 +18,614 @@ const char* SKYBOX_VERT_PATH = "res/shaders/skybox.vert";
 const char* SKYBOX_FRAG_PATH = "res/shaders/skybox.frag";
 
 namespace renderer {
-	int locate(const std::string& name) {
-		GLint program;
-		glGetIntegerv(GL_CURRENT_PROGRAM, &program);
-		int loc = glGetUniformLocation(program, name.c_str());
-		chicken3421::expect(loc != -1, "uniform not found: " + name);
-		return loc;
+	// the #define of each feature_t bit, in bit order
+	const char* FEATURE_DEFINES[N_FEATURES] = {
+	   "DIFFUSE_MAP", "SPECULAR_MAP", "NORMAL_MAP", "CUBE_MAP", "HEIGHT_MAP", "WATER"};
+
+	// look up a reflected uniform, only for uniforms that are set rarely (e.g. samplers at init)
+	GLint locate(const program_t& program, const std::string& name) {
+		auto it = program.uniforms.find(name);
+		chicken3421::expect(it != program.uniforms.end(), "uniform not found: " + name);
+		return it->second;
+	}
+
+	// look up a uniform a variant may have compiled out, -1 turns glUniform* into a no-op
+	GLint find_uniform(const program_t& program, const std::string& name) {
+		auto it = program.uniforms.find(name);
+		return it == program.uniforms.end() ? -1 : it->second;
 	}
 
-	void set_uniform(const std::string& name, float value) {
-		glUniform1f(locate(name), value);
+	void set_uniform(GLint loc, float value) {
+		glUniform1f(loc, value);
 	}
 
-	void set_uniform(const std::string& name, int value) {
-		glUniform1i(locate(name), value);
+	void set_uniform(GLint loc, int value) {
+		glUniform1i(loc, value);
 	}
 
-	void set_uniform(const std::string& name, glm::vec4 value) {
-		glUniform4fv(locate(name), 1, glm::value_ptr(value));
+	void set_uniform(GLint loc, glm::vec4 value) {
+		glUniform4fv(loc, 1, glm::value_ptr(value));
 	}
 
-	void set_uniform(const std::string& name, glm::vec3 value) {
-		glUniform3fv(locate(name), 1, glm::value_ptr(value));
+	void set_uniform(GLint loc, glm::vec3 value) {
+		glUniform3fv(loc, 1, glm::value_ptr(value));
 	}
 
-	void set_uniform(const std::string& name, const glm::mat4& value) {
-		glUniformMatrix4fv(locate(name), 1, GL_FALSE, glm::value_ptr(value));
+	void set_uniform(GLint loc, const glm::mat4& value) {
+		glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(value));
 	}
 
-	GLuint load_program(const std::string& vs_path, const std::string& fs_path) {
-		GLuint vs = chicken3421::make_shader(vs_path, GL_VERTEX_SHADER);
-		GLuint fs = chicken3421::make_shader(fs_path, GL_FRAGMENT_SHADER);
-		GLuint handle = chicken3421::make_program(vs, fs);
-		chicken3421::delete_shader(vs);
-		chicken3421::delete_shader(fs);
+	// fill the location table with every active uniform outside a uniform block
+	void reflect_uniforms(program_t& program) {
+		GLint count = 0;
+		GLint max_length = 0;
+		glGetProgramiv(program.handle, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(program.handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+
+		std::vector<GLchar> buffer((size_t)max_length + 1);
+		for (GLint i = 0; i < count; ++i) {
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(
+			   program.handle, (GLuint)i, (GLsizei)buffer.size(), &length, &size, &type, buffer.data());
+			auto name = std::string(buffer.data(), (size_t)length);
+			GLint loc = glGetUniformLocation(program.handle, name.c_str());
+			if (loc == -1) {
+				// block members have no location
+				continue;
+			}
+			program.uniforms[name] = loc;
+			// arrays are reported as "name[0]", make the bare name resolve too
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+				program.uniforms[name.substr(0, name.size() - 3)] = loc;
+			}
+		}
+	}
+
+	void bind_block(const program_t& program, const char* name, GLuint binding, size_t size) {
+		GLuint index = glGetUniformBlockIndex(program.handle, name);
+		if (index == GL_INVALID_INDEX) {
+			return;
+		}
+		GLint data_size = 0;
+		glGetActiveUniformBlockiv(program.handle, index, GL_UNIFORM_BLOCK_DATA_SIZE, &data_size);
+		chicken3421::expect((size_t)data_size <= size,
+		                    std::string("uniform block layout does not match its C++ mirror: ") + name);
+		glUniformBlockBinding(program.handle, index, binding);
+	}
+
+	// constants the shaders share with the C++ side, defined in every program
+	std::string shared_defines() {
+		return "#define CASCADES " + std::to_string(shadows::CASCADES) + "\n";
+	}
+
+	program_t load_program(const std::string& vs_path,
+	                       const std::string& fs_path,
+	                       const std::string& defines = "") {
+		auto program = program_t{};
+		program.handle = program_cache::load(vs_path, fs_path, shared_defines() + defines);
+		reflect_uniforms(program);
+		bind_block(program, "Camera", CAMERA_BLOCK_BINDING, sizeof(camera_block_t));
+		bind_block(program, "Lights", LIGHTS_BLOCK_BINDING, sizeof(lights_block_t));
+		bind_block(program, "MaterialBlock", MATERIAL_BLOCK_BINDING, sizeof(material_block_t));
+		return program;
+	}
+
+	GLuint make_ubo(size_t size, GLuint binding) {
+		GLuint ubo;
+		glGenBuffers(1, &ubo);
+		gl_state::bind_buffer(GL_UNIFORM_BUFFER, ubo);
+		glBufferData(GL_UNIFORM_BUFFER, (GLsizeiptr)size, nullptr, GL_DYNAMIC_DRAW);
+		gl_state::bind_buffer_base(GL_UNIFORM_BUFFER, binding, ubo);
+		return ubo;
+	}
+
+	// whole-block upload, one call per block per update
+	template <typename T>
+	void write_ubo(GLuint ubo, const T& block) {
+		gl_state::bind_buffer(GL_UNIFORM_BUFFER, ubo);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &block);
+	}
 
-		return handle;
+	// the material's maps on units 0 to 4, as the main program's samplers expect them
+	void bind_material_textures(const model::material_t& material) {
+		gl_state::bind_texture(0, GL_TEXTURE_2D, material.diffuse_map);
+		gl_state::bind_texture(1, GL_TEXTURE_2D, material.specular_map);
+		gl_state::bind_texture(2, GL_TEXTURE_CUBE_MAP, material.cube_map);
+		gl_state::bind_texture(3, GL_TEXTURE_2D, material.normal_map);
+		gl_state::bind_texture(4, GL_TEXTURE_2D, material.height_map);
+	}
+
+	light_block_t make_light_block(glm::vec3 position,
+	                               glm::vec3 diffuse,
+	                               glm::vec3 ambient,
+	                               glm::vec3 specular) {
+		auto block = light_block_t{};
+		block.position = position;
+		block.diffuse = diffuse;
+		block.ambient = ambient;
+		block.specular = specular;
+		return block;
+	}
+
+	// per-mesh uniforms that undo its vertex format
+	void set_vertex_format(const variant_t& variant, const mesh::mesh_t& mesh) {
+		set_uniform(variant.position_offset_loc, mesh.position_offset);
+		set_uniform(variant.position_scale_loc, mesh.position_scale);
+		set_uniform(variant.octahedral_normals_loc, mesh.format != mesh::FLOAT_VERTICES ? 1 : 0);
+	}
+
+	// largest scale a transform applies along any of its axes
+	float max_scale(const glm::mat4& transform) {
+		return std::max({glm::length(glm::vec3(transform[0])),
+		                 glm::length(glm::vec3(transform[1])),
+		                 glm::length(glm::vec3(transform[2]))});
+	}
+
+	// tell the texture streamer how finely a material's maps are sampled on a surface
+	// uv_density - texture coordinate units per world unit on the surface
+	// distance - from the camera to the nearest point of the surface
+	// pixel_size - world units a pixel spans one unit in front of the camera
+	void request_mips(renderer_t& renderer,
+	                  const model::material_t& material,
+	                  float uv_density,
+	                  float distance,
+	                  float pixel_size) {
+		if (!renderer.streamer || uv_density <= 0.0f) {
+			return;
+		}
+		// nothing is drawn nearer than the near plane
+		const auto& projection = renderer.projection;
+		auto near_plane = projection[3][2] / (projection[2][2] - 1.0f);
+		auto uv_per_pixel = uv_density * std::max(distance, near_plane) * pixel_size;
+		GLuint maps[] = {
+		   material.diffuse_map, material.specular_map, material.normal_map, material.height_map};
+		for (GLuint map : maps) {
+			texture_streamer::request(*renderer.streamer, map, uv_per_pixel);
+		}
+	}
+
+	// the features a material's draws need, water comes from the node rather than the material
+	uint32_t material_features(const model::material_t& material, uint8_t flags) {
+		auto features = uint32_t{0};
+		features |= material.diffuse_map ? FEATURE_DIFFUSE_MAP : 0u;
+		features |= material.specular_map ? FEATURE_SPECULAR_MAP : 0u;
+		features |= material.normal_map ? FEATURE_NORMAL_MAP : 0u;
+		features |= material.cube_map ? FEATURE_CUBE_MAP : 0u;
+		features |= material.height_map ? FEATURE_HEIGHT_MAP : 0u;
+		features |= (flags & render_queue::FLAG_WATER) ? FEATURE_WATER : 0u;
+		return features;
+	}
+
+	// the main program for a feature set, compiled (or restored from the program cache) and set up
+	// the first time it is asked for. Leaves the program in use when it had to set it up
+	const variant_t& get_variant(renderer_t& renderer, uint32_t features) {
+		auto& variant = renderer.variants[features];
+		if (variant.program.handle) {
+			return variant;
+		}
+		std::string defines;
+		for (uint32_t i = 0; i < N_FEATURES; ++i) {
+			if (features & (1u << i)) {
+				defines += std::string("#define ") + FEATURE_DEFINES[i] + "\n";
+			}
+		}
+		variant.program = load_program(VERT_PATH, FRAG_PATH, defines);
+		const auto& program = variant.program;
+		variant.model_loc = locate(program, "uModel");
+		variant.tex_coord_transform_loc = find_uniform(program, "uTexCoordTransform");
+		variant.position_offset_loc = locate(program, "uPositionOffset");
+		variant.position_scale_loc = locate(program, "uPositionScale");
+		variant.octahedral_normals_loc = locate(program, "uOctahedralNormals");
+
+		// sampler units never change, set them once. The maps are only there with their feature
+		gl_state::use_program(program.handle);
+		set_uniform(find_uniform(program, "uDiffuseMap"), 0);
+		set_uniform(find_uniform(program, "uSpecularMap"), 1);
+		set_uniform(find_uniform(program, "uCubeMap"), 2);
+		set_uniform(find_uniform(program, "uNormalMap"), 3);
+		set_uniform(find_uniform(program, "uHeightMap"), 4);
+		set_uniform(find_uniform(program, "hdrBuffer"), 0);
+		set_uniform(locate(program, "uLightData"), (int)CLUSTER_TEXTURE_UNIT);
+		set_uniform(locate(program, "uClusterGrid"), (int)CLUSTER_TEXTURE_UNIT + 1);
+		set_uniform(locate(program, "uLightIndices"), (int)CLUSTER_TEXTURE_UNIT + 2);
+		set_uniform(locate(program, "uShadowMap"), (int)SHADOW_TEXTURE_UNIT);
+		set_uniform(variant.tex_coord_transform_loc, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+		set_vertex_format(variant, mesh::mesh_t{});
+		return variant;
 	}
 
 	renderer_t init(const glm::mat4& projection) {
-		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_CULL_FACE);
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		gl_state::enable(GL_DEPTH_TEST);
+		gl_state::enable(GL_CULL_FACE);
+		gl_state::enable(GL_BLEND);
+		gl_state::blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 		auto renderer = renderer_t{};
 		renderer.projection = projection;
 
-		// make the render program
-		renderer.program = load_program(VERT_PATH, FRAG_PATH);
+		// make the render programs. Main program variants are built as draws need them, the bare
+		// one now so broken shaders show up at startup
+		get_variant(renderer, 0);
 		renderer.skybox_program = load_program(SKYBOX_VERT_PATH, SKYBOX_FRAG_PATH);
+		renderer.skybox_view_proj_loc = locate(renderer.skybox_program, "uViewProj");
+
+		renderer.camera_ubo = make_ubo(sizeof(camera_block_t), CAMERA_BLOCK_BINDING);
+		renderer.lights_ubo = make_ubo(sizeof(lights_block_t), LIGHTS_BLOCK_BINDING);
+		renderer.material_ubo = make_ubo(sizeof(material_block_t), MATERIAL_BLOCK_BINDING);
+		renderer.stream = stream_buffer::init(STREAM_CAPACITY);
+		renderer.shadows = shadows::init();
+		renderer.clusters = std::make_unique<light_clusters::clusters_t>();
+		light_clusters::init(*renderer.clusters);
+
+		// plain draws leave the instance attributes disabled, so they read these generic values: an
+		// identity transform and a white tint
+		for (GLuint col = 0; col < 4; ++col) {
+			auto column = glm::vec4(0.0f);
+			column[(int)col] = 1.0f;
+			glVertexAttrib4fv(mesh::INSTANCE_TRANSFORM_ATTRIB + col, glm::value_ptr(column));
+		}
+		glVertexAttrib4f(mesh::INSTANCE_TINT_ATTRIB, 1.0f, 1.0f, 1.0f, 1.0f);
+
+		gl_state::use_program(renderer.skybox_program.handle);
+		set_uniform(locate(renderer.skybox_program, "uCubeMap"), 0);
 
 		return renderer;
 	}
 
-	void draw_skybox(const model::model_t& model, const renderer_t& renderer, const glm::mat4& view) {
-		glUseProgram(renderer.skybox_program);
-		glFrontFace(GL_CW);
-		glDepthMask(GL_FALSE);
+	void destroy(renderer_t& renderer) {
+		light_clusters::destroy(*renderer.clusters);
+		renderer.clusters.reset();
+		shadows::destroy(renderer.shadows);
+		stream_buffer::destroy(renderer.stream);
+		gl_state::delete_buffers(1, &renderer.camera_ubo);
+		gl_state::delete_buffers(1, &renderer.lights_ubo);
+		gl_state::delete_buffers(1, &renderer.material_ubo);
+		for (auto& variant : renderer.variants) {
+			if (variant.program.handle) {
+				gl_state::delete_program(variant.program.handle);
+				variant = variant_t{};
+			}
+		}
+		gl_state::delete_program(renderer.skybox_program.handle);
+	}
 
-		set_uniform("uCubeMap", 0);
-		set_uniform("uViewProj", renderer.projection * glm::mat4(glm::mat3(view)));
+	glm::vec3 sRGB_to_linear(glm::vec3 colour) {
+		return glm::pow(colour, glm::vec3(2.2f));
+	}
+
+	// bin the point lights for this view and fill in the camera block's cluster lookup
+	void cluster_lights(renderer_t& renderer, const glm::mat4& view, camera_block_t& camera_block) {
+		PROFILE_ZONE("cluster lights");
+		renderer.cluster_lights.clear();
+		for (const auto& light : renderer.point_lights) {
+			renderer.cluster_lights.push_back({light.position,
+			                                   light.radius,
+			                                   sRGB_to_linear(light.diffuse),
+			                                   sRGB_to_linear(light.ambient),
+			                                   sRGB_to_linear(light.specular)});
+		}
+		auto& clusters = *renderer.clusters;
+		light_clusters::build(clusters, renderer.cluster_lights, view, renderer.projection);
+		light_clusters::bind(clusters, CLUSTER_TEXTURE_UNIT);
+
+		GLint viewport[4];
+		gl_state::get_viewport(viewport);
+		camera_block.view_dir = glm::vec3(-view[0][2], -view[1][2], -view[2][2]);
+		camera_block.cluster_depth =
+		   glm::vec4(clusters.depth_scale, clusters.depth_bias, light_clusters::SLICES, 0.0f);
+		camera_block.cluster_tiles = glm::vec4((float)viewport[2] / light_clusters::TILES_X,
+		                                       (float)viewport[3] / light_clusters::TILES_Y,
+		                                       light_clusters::TILES_X,
+		                                       light_clusters::TILES_Y);
+	}
+
+	void count_draw(renderer_t& renderer, const mesh::mesh_t& mesh, int lod, size_t instances) {
+		++renderer.stats.draw_calls;
+		renderer.stats.triangles += (size_t)mesh::select_lod(mesh, lod).count / 3 * instances;
+	}
+
+	// bring the sun's shadow maps up to date, leaving the target framebuffer as it was
+	void draw_shadows(renderer_t& renderer, const scene_graph::graph_t& scene, const glm::mat4& view) {
+		PROFILE_GPU_ZONE("shadows");
+		// from the state shadow, so none of these wait on the driver
+		auto framebuffer = gl_state::framebuffer(GL_DRAW_FRAMEBUFFER);
+		GLint viewport[4];
+		gl_state::get_viewport(viewport);
+		// the shadow program writes no clip distance
+		bool clipping = gl_state::is_enabled(GL_CLIP_DISTANCE0);
+		gl_state::disable(GL_CLIP_DISTANCE0);
+
+		shadows::update(renderer.shadows, scene, renderer.sun_light_dir, view, renderer.projection);
+		const auto& shadow_stats = renderer.shadows.stats;
+		renderer.stats.draw_calls += shadow_stats.static_casters + shadow_stats.dynamic_casters;
+
+		if (clipping) {
+			gl_state::enable(GL_CLIP_DISTANCE0);
+		}
+		gl_state::bind_framebuffer(GL_FRAMEBUFFER, framebuffer);
+		gl_state::viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		gl_state::bind_texture(SHADOW_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, renderer.shadows.maps);
+	}
+
+	void draw_skybox(const model::model_t& model, renderer_t& renderer, const glm::mat4& view) {
+		PROFILE_GPU_ZONE("skybox");
+		gl_state::use_program(renderer.skybox_program.handle);
+		gl_state::front_face(GL_CW);
+		gl_state::depth_mask(GL_FALSE);
+
+		set_uniform(renderer.skybox_view_proj_loc, renderer.projection * glm::mat4(glm::mat3(view)));
 		for (auto i = size_t{0}; i < model.meshes.size(); ++i) {
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_CUBE_MAP, model.materials[i].cube_map);
+			gl_state::bind_texture(0, GL_TEXTURE_CUBE_MAP, model.materials[i].cube_map);
 			mesh::draw(model.meshes[i]);
+			count_draw(renderer, model.meshes[i], 0, 1);
 		}
-		glFrontFace(GL_CCW);
-		glDepthMask(GL_TRUE);
-		glUseProgram(0);
+		gl_state::front_face(GL_CCW);
+		gl_state::depth_mask(GL_TRUE);
 	}
 
-	void draw(const scene::node_t& node,
-	          const renderer_t& renderer,
-	          glm::mat4 model,
-	          glm::vec2 polygon_offset = glm::vec2(0)) {
-		model *= glm::translate(glm::mat4(1.0), node.translation);
-		model *= glm::rotate(glm::mat4(1.0), node.rotation.z, glm::vec3(0, 0, 1));
-		model *= glm::rotate(glm::mat4(1.0), node.rotation.y, glm::vec3(0, 1, 0));
-		model *= glm::rotate(glm::mat4(1.0), node.rotation.x, glm::vec3(1, 0, 0));
-		model *= glm::scale(glm::mat4(1.0), node.scale);
+	material_block_t make_material_block(const model::material_t& material) {
+		auto block = material_block_t{};
+		block.ambient = material.ambient;
+		block.diffuse = material.diffuse;
+		block.specular = material.specular;
+		block.phong_exp = material.phong_exp;
+		block.cube_map_factor = material.cube_map_factor;
+		return block;
+	}
 
-		set_uniform("uModel", model);
+	// the coarsest level whose threshold the screen size is under. Thresholds on the far side of
+	// the current level are moved away from it by the hysteresis margin, so a node sitting on one
+	// does not switch every frame
+	uint8_t select_lod(float screen_size, uint8_t current) {
+		uint8_t level = 0;
+		while (level + 1 < mesh::MAX_LODS) {
+			float margin = current > level ? 1.0f + LOD_HYSTERESIS : 1.0f - LOD_HYSTERESIS;
+			if (screen_size >= LOD_SCREEN_SIZES[level] * margin) {
+				break;
+			}
+			++level;
+		}
+		return level;
+	}
 
-		if (node.invisible)
-			return;
+	// turn the visible nodes into draw packets, depth measured along the camera's view direction.
+	// Subtrees whose bounding sphere is outside the frustum are skipped whole, nodes that pass are
+	// then checked against their own box
+	void collect(const scene_graph::graph_t& scene,
+	             renderer_t& renderer,
+	             const glm::mat4& view,
+	             const bounds::frustum_t& frustum,
+	             float pixel_size) {
+		PROFILE_ZONE("collect");
+		auto n = scene_graph::size(scene);
+		renderer.subtree_visible.resize(n);
+		renderer.node_lods.resize(n, 0);
+		bounds::test_spheres(frustum,
+		                     scene.subtree_x.data(),
+		                     scene.subtree_y.data(),
+		                     scene.subtree_z.data(),
+		                     scene.subtree_radius.data(),
+		                     n,
+		                     renderer.subtree_visible.data());
+
+		for (auto id = size_t{0}; id < n; ++id) {
+			if (!renderer.subtree_visible[id]) {
+				renderer.stats.culled_meshes += scene.subtree_meshes[id];
+				id = scene.subtree_ends[id] - 1; // continue after the last descendant
+				continue;
+			}
+
+			const auto& node_model = scene.models[id];
+			if (scene.hidden[id] || node_model.meshes.empty()) {
+				continue;
+			}
+			if (!bounds::test_aabb(frustum, scene.world_bounds[id])) {
+				renderer.stats.culled_meshes += node_model.meshes.size();
+				continue;
+			}
+			renderer.stats.drawn_meshes += node_model.meshes.size();
+
+			auto kind = scene.kinds[id];
+			auto flags = uint8_t{0};
+			if (kind == scene::node_t::WATER || kind == scene::node_t::WATER_SURFACE) {
+				flags |= render_queue::FLAG_WATER;
+			}
+			if (kind == scene::node_t::WATER_SURFACE) {
+				flags |= render_queue::FLAG_WATER_SURFACE;
+			}
+			auto view_depth = -(view * scene.worlds[id][3]).z;
+
+			// fraction of the screen height covered by the node's bounding sphere
+			auto sphere = bounds::enclosing_sphere(scene.world_bounds[id]);
+			auto distance = glm::length(glm::vec3(view * glm::vec4(sphere.center, 1.0f)));
+			auto screen_size =
+			   distance > sphere.radius ? sphere.radius * renderer.projection[1][1] / distance : 1.0f;
+			auto lod = select_lod(screen_size, renderer.node_lods[id]);
+			renderer.node_lods[id] = lod;
+			auto world_scale = max_scale(scene.worlds[id]);
+			auto nearest = distance - sphere.radius;
+
+			// TODO Part A: do glPolygonOffset with accumulated z-fighting offset from parents
+			for (auto i = size_t{0}; i < node_model.meshes.size(); ++i) {
+				const auto& material = node_model.materials[i];
+				auto features = material_features(material, flags);
+				auto uv_density = node_model.meshes[i].uv_density / world_scale;
+				request_mips(renderer, material, uv_density, nearest, pixel_size);
+				auto packet = render_queue::packet_t{};
+				packet.program = get_variant(renderer, features).program.handle;
+				packet.variant = (uint8_t)features;
+				packet.mesh = &node_model.meshes[i];
+				packet.material = &material;
+				if (kind == scene::node_t::INSTANCED) {
+					packet.instances = &scene.instances[id];
+				}
+				packet.transform = (uint32_t)id;
+				packet.flags = flags;
+				packet.lod = lod;
+				bool translucent = (flags & render_queue::FLAG_WATER) || material.diffuse.a < 1.0f;
+				render_queue::push(renderer.queue, packet, view_depth, translucent);
+			}
+		}
+	}
+
+	// terrain goes before the queue: it is opaque and covers much of the screen, so it fills the
+	// depth buffer ahead of everything else. Chunks are picked around the camera every frame and
+	// culled one by one
+	void draw_terrain(renderer_t& renderer,
+	                  const scene_graph::graph_t& scene,
+	                  const bounds::frustum_t& frustum,
+	                  glm::vec3 camera_pos,
+	                  float pixel_size) {
+		PROFILE_GPU_ZONE("terrain");
+		for (auto t = size_t{0}; t < scene.terrain_nodes.size(); ++t) {
+			auto id = scene.terrain_nodes[t];
+			if (scene.hidden[id]) {
+				continue;
+			}
+			const auto& terrain = scene.terrains[t];
+			const auto& world = scene.worlds[id];
+			auto viewer = glm::vec3(glm::inverse(world) * glm::vec4(camera_pos, 1.0f));
+			terrain::select(terrain, viewer, renderer.terrain_chunks);
+
+			const variant_t* variant = nullptr;
+			for (const auto& chunk : renderer.terrain_chunks) {
+				auto box = bounds::transform(chunk.bounds, world);
+				box.max.y += terrain::MAX_HEIGHT;
+				if (!bounds::test_aabb(frustum, box)) {
+					++renderer.stats.culled_chunks;
+					continue;
+				}
+				++renderer.stats.drawn_chunks;
+
+				auto chunk_world = world * chunk.transform;
+				auto uv_scale = std::max(chunk.tex_coord_transform.z, chunk.tex_coord_transform.w);
+				auto uv_density = terrain.grid.uv_density * uv_scale / max_scale(chunk_world);
+				auto sphere = bounds::enclosing_sphere(box);
+				auto nearest = glm::length(sphere.center - camera_pos) - sphere.radius;
+				request_mips(renderer, terrain.material, uv_density, nearest, pixel_size);
+
+				if (!variant) {
+					variant = &get_variant(renderer, material_features(terrain.material, 0));
+					gl_state::use_program(variant->program.handle);
+					write_ubo(renderer.material_ubo, make_material_block(terrain.material));
+					bind_material_textures(terrain.material);
+					set_vertex_format(*variant, terrain.grid);
+					gl_state::bind_vertex_array(terrain.grid.vao);
+				}
+				set_uniform(variant->model_loc, chunk_world);
+				set_uniform(variant->tex_coord_transform_loc, chunk.tex_coord_transform);
+				mesh::draw_range(terrain.grid, terrain.variants[chunk.stitch]);
+				++renderer.stats.draw_calls;
+				renderer.stats.triangles += (size_t)terrain.variants[chunk.stitch].count / 3;
+			}
+			if (variant) {
+				// meshes drawn with the same variant cover their whole texture
+				set_uniform(variant->tex_coord_transform_loc, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+			}
+		}
+	}
 
-		// TODO Part A: do glPolygonOffset with accumulated z-fighting offset from parents
-		for (auto i = size_t{0}; i < node.model.meshes.size(); ++i) {
-			set_uniform("uDiffuseMapFactor", node.model.materials[i].diffuse_map ? 1.0f : 0.0f);
-			set_uniform("uSpecularMapFactor", node.model.materials[i].specular_map ? 1.0f : 0.0f);
-			set_uniform("uCubeMapFactor",
-			            node.model.materials[i].cube_map ? node.model.materials[i].cube_map_factor
-			                                             : 0.0f);
-			set_uniform("uNormalMapFactor", node.model.materials[i].normal_map ? 1.0f : 0.0f);
-			
-			set_uniform("uMat.ambient", node.model.materials[i].ambient);
-			set_uniform("uMat.diffuse", node.model.materials[i].diffuse);
-			set_uniform("uMat.specular", node.model.materials[i].specular);
-			set_uniform("uMat.phongExp", node.model.materials[i].phong_exp);
-			set_uniform("uIsWater",
-			            node.kind == scene::node_t::WATER || node.kind == scene::node_t::WATER_SURFACE);
-			set_uniform("uIsWaterSurface", node.kind == scene::node_t::WATER_SURFACE);
-            
-            //set_uniform("hdrBuffer", 0);
-			glActiveTexture(GL_TEXTURE0);
-			texture_2d::bind(node.model.materials[i].diffuse_map);
-			glActiveTexture(GL_TEXTURE1);
-			texture_2d::bind(node.model.materials[i].specular_map);
-			glActiveTexture(GL_TEXTURE2);
-			glBindTexture(GL_TEXTURE_CUBE_MAP, node.model.materials[i].cube_map);
-			glActiveTexture(GL_TEXTURE3);
-			texture_2d::bind(node.model.materials[i].normal_map);
-			glActiveTexture(GL_TEXTURE4);
-			texture_2d::bind(node.model.materials[i].height_map);
-			mesh::draw(node.model.meshes[i]);
-		}
-		for (auto const& child : node.children) {
-			draw(child, renderer, model, polygon_offset);
-		}
-	}
-
-	void render(const renderer_t& renderer,
+	// draw the sorted packets. Bindings that match the previous packet's are dropped by gl_state,
+	// uniforms are only set when they differ from the previous packet's with the same program
+	void submit(renderer_t& renderer, const std::vector<glm::mat4>& worlds) {
+		PROFILE_GPU_ZONE("submit");
+		const auto& queue = renderer.queue;
+		auto vao = ~GLuint{0};
+		auto material_id = ~uint32_t{0};
+		auto transform = ~uint32_t{0};
+		auto features = -1;
+
+		for (const auto& item : queue.order) {
+			const auto& packet = queue.packets[item.packet];
+			const auto& material = *packet.material;
+			const auto& variant = renderer.variants[packet.variant];
+
+			if (packet.variant != features) {
+				features = packet.variant;
+				gl_state::use_program(packet.program);
+				// uniforms belong to the program, this one still holds whatever it last drew with
+				transform = ~uint32_t{0};
+				vao = ~GLuint{0};
+			}
+			bind_material_textures(material);
+			if (packet.material_id != material_id) {
+				material_id = packet.material_id;
+				write_ubo(renderer.material_ubo, make_material_block(material));
+			}
+
+			if (packet.transform != transform) {
+				transform = packet.transform;
+				set_uniform(variant.model_loc, worlds[transform]);
+			}
+			if (packet.mesh->vao != vao) {
+				vao = packet.mesh->vao;
+				set_vertex_format(variant, *packet.mesh);
+			}
+			if (packet.instances) {
+				mesh::draw_instanced(*packet.mesh, *packet.instances, GL_TRIANGLES, packet.lod);
+				count_draw(renderer, *packet.mesh, packet.lod, (size_t)packet.instances->count);
+				continue;
+			}
+			gl_state::bind_vertex_array(vao);
+			mesh::draw_bound(*packet.mesh, GL_TRIANGLES, packet.lod);
+			count_draw(renderer, *packet.mesh, packet.lod, 1);
+		}
+	}
+
+	void render(renderer_t& renderer,
 	            const euler_camera::camera_t& camera,
-	            const scene::node_t& scene,
+	            const scene_graph::graph_t& scene,
 	            const model::model_t& skybox) {
+		PROFILE_ZONE("render");
+		stream_buffer::begin_frame(renderer.stream);
+		renderer.stats = stats_t{};
+		auto view = euler_camera::get_view(camera);
+		draw_shadows(renderer, scene, view);
+
 		glClearColor(0, 0, 0, 1.0);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glEnable(GL_POLYGON_OFFSET_FILL);
+		gl_state::enable(GL_POLYGON_OFFSET_FILL);
 
-		auto view = euler_camera::get_view(camera);
 		draw_skybox(skybox, renderer, view);
 
-		glUseProgram(renderer.program);
-		set_uniform("uCameraPos", camera.pos);
-
-		set_uniform("uSun.direction", renderer.sun_light_dir);
-		set_uniform("uSun.diffuse", renderer.sun_light_diffuse);
-		set_uniform("uSun.ambient", renderer.sun_light_ambient);
-		set_uniform("uSun.specular", renderer.sun_light_specular);
-        
-		set_uniform("uSpot.position", renderer.spot_light_pos);
-		set_uniform("uSpot.diffuse", renderer.spot_light_diffuse);
-		set_uniform("uSpot.ambient", renderer.spot_light_ambient);
-		set_uniform("uSpot.specular", renderer.spot_light_specular);
-
-        std::vector<glm::vec3> point_light_pos;
-        std::vector<glm::vec3> point_light_diffuse;
-        std::vector<glm::vec3> point_light_ambient;
-        std::vector<glm::vec3> point_light_specular;
-        
-        point_light_pos.push_back(glm::vec3(0,5,-14));
-        point_light_pos.push_back(glm::vec3(25,5,-25));
-        point_light_pos.push_back(glm::vec3(30,5,54));
-        point_light_pos.push_back(glm::vec3(24,5,-39));
-        point_light_pos.push_back(glm::vec3(46,5,-44));
-        
-		point_light_diffuse.push_back(glm::vec3(20.f, 18.f, 15.f));
-        point_light_diffuse.push_back(glm::vec3(0.f, 15.f, 0.f));
-        point_light_diffuse.push_back(glm::vec3(15.f, 0.f, 0.f));
-        point_light_diffuse.push_back(glm::vec3(0.f, 0.f, 15.f));
-        point_light_diffuse.push_back(glm::vec3(15.f, 15.f, 0.f));
-        
-        point_light_ambient.push_back(glm::vec3(0.25f));
-        point_light_ambient.push_back(glm::vec3(0.25f));
-        point_light_ambient.push_back(glm::vec3(0.25f));
-        point_light_ambient.push_back(glm::vec3(0.25f));
-        point_light_ambient.push_back(glm::vec3(0.25f));
-
-		point_light_specular.push_back(glm::vec3(0.12f));
-		point_light_specular.push_back(glm::vec3(0.12f));
-        point_light_specular.push_back(glm::vec3(0.12f));
-        point_light_specular.push_back(glm::vec3(0.12f));
-        point_light_specular.push_back(glm::vec3(0.12f));
-        
-        set_uniform("uPoint[0].position", point_light_pos[0]);
-		set_uniform("uPoint[0].diffuse", point_light_diffuse[0]);
-		set_uniform("uPoint[0].ambient", point_light_ambient[0]);
-		set_uniform("uPoint[0].specular", point_light_specular[0]);
-
-        set_uniform("uPoint[1].position", point_light_pos[1]);
-		set_uniform("uPoint[1].diffuse", point_light_diffuse[1]);
-		set_uniform("uPoint[1].ambient", point_light_ambient[1]);
-		set_uniform("uPoint[1].specular", point_light_specular[1]);
-
-        set_uniform("uPoint[2].position", point_light_pos[2]);
-		set_uniform("uPoint[2].diffuse", point_light_diffuse[2]);
-		set_uniform("uPoint[2].ambient", point_light_ambient[2]);
-		set_uniform("uPoint[2].specular", point_light_specular[2]);
-	
-        set_uniform("uPoint[3].position", point_light_pos[3]);
-		set_uniform("uPoint[3].diffuse", point_light_diffuse[3]);
-		set_uniform("uPoint[3].ambient", point_light_ambient[3]);
-		set_uniform("uPoint[3].specular", point_light_specular[3]);
-
-        set_uniform("uPoint[4].position", point_light_pos[4]);
-		set_uniform("uPoint[4].diffuse", point_light_diffuse[4]);
-		set_uniform("uPoint[4].ambient", point_light_ambient[4]);
-		set_uniform("uPoint[4].specular", point_light_specular[4]);
-
-		set_uniform("uDiffuseMap", 0);
-		set_uniform("uSpecularMap", 1);
-		set_uniform("uCubeMap", 2);
-		set_uniform("uNormalMap", 3);
-		set_uniform("uHeightMap", 4);
-		set_uniform("uNow", (float) glfwGetTime());
-
-		set_uniform("uClipPlane", renderer.clip_plane);
-        set_uniform("hdrBuffer", 0);
-		auto view_proj = renderer.projection * view;
-		set_uniform("uViewProj", view_proj);
-
-		draw(scene, renderer, glm::mat4(1.0f));
-		glDisable(GL_POLYGON_OFFSET_FILL);
+		auto camera_block = camera_block_t{};
+		camera_block.view_proj = renderer.projection * view;
+		camera_block.camera_pos = camera.pos;
+		camera_block.clip_plane = renderer.clip_plane;
+		camera_block.now = renderer.time;
+		cluster_lights(renderer, view, camera_block);
+		write_ubo(renderer.camera_ubo, camera_block);
+
+		auto lights_block = lights_block_t{};
+		lights_block.sun = make_light_block(renderer.sun_light_dir,
+		                                    sRGB_to_linear(renderer.sun_light_diffuse),
+		                                    sRGB_to_linear(renderer.sun_light_ambient),
+		                                    sRGB_to_linear(renderer.sun_light_specular));
+		lights_block.spot = make_light_block(renderer.spot_light_pos,
+		                                     sRGB_to_linear(renderer.spot_light_diffuse),
+		                                     sRGB_to_linear(renderer.spot_light_ambient),
+		                                     sRGB_to_linear(renderer.spot_light_specular));
+		for (int i = 0; i < shadows::CASCADES; ++i) {
+			lights_block.shadow_matrices[i] = shadows::shadow_matrix(renderer.shadows, i);
+			lights_block.cascade_ends[i] = renderer.shadows.cascades[i].end;
+		}
+		write_ubo(renderer.lights_ubo, lights_block);
+
+		render_queue::clear(renderer.queue);
+		auto frustum = bounds::make_frustum(camera_block.view_proj);
+		GLint viewport[4];
+		gl_state::get_viewport(viewport);
+		auto pixel_size = 2.0f / (renderer.projection[1][1] * (float)std::max(viewport[3], 1));
+		collect(scene, renderer, view, frustum, pixel_size);
+		{
+			PROFILE_ZONE("sort");
+			render_queue::sort(renderer.queue);
+		}
+		draw_terrain(renderer, scene, frustum, camera.pos, pixel_size);
+		submit(renderer, scene.worlds);
+		gl_state::disable(GL_POLYGON_OFFSET_FILL);
+		stream_buffer::end_frame(renderer.stream);
 	}
 } // namespace renderer
@@ -1,7 +1,6 @@
 #include "ass3/scene.hpp"
+#include "ass3/mesh_optimize.hpp"
 #include "ass3/shapes.hpp"
-#include "ass3/cubemap.hpp"
-#include "ass3/texture_2d.hpp"
 #include <iostream>
 
 const char* SKYBOX_BASE_PATH = "res/skybox/sky";
@@ -14,16 +13,30 @@ const char* SAND_ROUGH_MAP_PATH = "res/textures/sand/Sand_004_ROUGH.png";
 
 const char* MARCCOIN_NORMAL_MAP = "res/textures/marccoin_normal_map.png";
 
+// placeholders shown while the real maps stream in: flat normals and no displacement
+const glm::vec4 FLAT_NORMAL_PLACEHOLDER = glm::vec4(0.5f, 0.5f, 1.0f, 1.0f);
+const glm::vec4 NO_HEIGHT_PLACEHOLDER = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+// pick the compressed formats of data maps, see texture_cache
+const texture_2d::params_t NORMAL_MAP_PARAMS = {.content = texture_2d::NORMAL};
+const texture_2d::params_t HEIGHT_MAP_PARAMS = {.content = texture_2d::HEIGHT};
+
 namespace scene {
-	node_t make_marccoin() {
+	node_t make_marccoin(asset_registry::registry_t& registry) {
 		float coin_thickness = 0.1f;
 
 		auto face1 = scene::node_t{};
 		auto face1_template = shapes::make_circle(1.0f);
 		shapes::calc_vertex_normals(face1_template);
+		mesh_optimize::optimize(face1_template);
 		face1.model.meshes.push_back(mesh::init(face1_template));
-		face1.model.materials.push_back({.cube_map = cubemap::make_cubemap(SKYBOX_BASE_PATH),
-		                                 .normal_map = texture_2d::init(MARCCOIN_NORMAL_MAP),
+		face1.model.materials.push_back({.cube_map =
+		                                    asset_registry::acquire_cubemap(registry, SKYBOX_BASE_PATH),
+		                                 .normal_map =
+		                                    asset_registry::acquire_texture_2d(registry,
+		                                                                       MARCCOIN_NORMAL_MAP,
+		                                                                       NORMAL_MAP_PARAMS,
+		                                                                       FLAT_NORMAL_PLACEHOLDER),
 		                                 .diffuse = glm::vec4(0.805, 0.64, 0.054, 1),
 		                                 .specular = glm::vec3(1),
 		                                 .phong_exp = 50.0});
@@ -36,8 +49,10 @@ namespace scene {
 		auto edge = scene::node_t{};
 		auto edge_mesh_template = shapes::make_cylinder(1.0f, coin_thickness);
 		shapes::calc_vertex_normals(edge_mesh_template);
+		mesh_optimize::optimize(edge_mesh_template);
 		edge.model.meshes.push_back(mesh::init(edge_mesh_template));
-		edge.model.materials.push_back({.cube_map = cubemap::make_cubemap(SKYBOX_BASE_PATH),
+		edge.model.materials.push_back({.cube_map =
+		                                   asset_registry::acquire_cubemap(registry, SKYBOX_BASE_PATH),
 		                                .diffuse = glm::vec4(0.805, 0.64, 0.054, 1),
 		                                .specular = glm::vec3(1),
 		                                .phong_exp = 50.0});
@@ -56,13 +71,12 @@ namespace scene {
 		return marccoin;
 	}
 
-	node_t make_volume(int width,
-	                   int height,
-	                   int depth,
-	                   model::material_t top_material,
-	                   model::material_t side_material,
-	                   scene::node_t::KIND top_kind,
-	                   scene::node_t::KIND side_kind) {
+	// the four walls of a volume, its top is left to the caller
+	node_t make_volume_sides(int width,
+	                         int height,
+	                         int depth,
+	                         model::material_t side_material,
+	                         scene::node_t::KIND side_kind) {
 		auto volume = scene::node_t{};
 
 		std::vector<std::pair<int, int>> dims = {
@@ -90,6 +104,7 @@ namespace scene {
 			auto side = scene::node_t{};
 			auto side_template = shapes::make_plane(dims[i].first, dims[i].second);
 			shapes::calc_vertex_normals(side_template);
+			mesh_optimize::optimize(side_template);
 			side.kind = side_kind;
 			side.model.meshes.push_back(mesh::init(side_template));
 			side.model.materials.push_back(side_material);
@@ -98,9 +113,22 @@ namespace scene {
 			volume.children.push_back(side);
 		}
 
+		return volume;
+	}
+
+	node_t make_volume(int width,
+	                   int height,
+	                   int depth,
+	                   model::material_t top_material,
+	                   model::material_t side_material,
+	                   scene::node_t::KIND top_kind,
+	                   scene::node_t::KIND side_kind) {
+		auto volume = make_volume_sides(width, height, depth, side_material, side_kind);
+
 		auto top = scene::node_t{};
 		auto top_template = shapes::make_plane(width, height);
 		shapes::calc_vertex_normals(top_template);
+		mesh_optimize::optimize(top_template);
 		top.kind = top_kind;
 		top.model.meshes.push_back(mesh::init(top_template));
 		top.model.materials.push_back(top_material);
@@ -111,11 +139,13 @@ namespace scene {
 		return volume;
 	}
 
-	node_t make_sand_volume(int width, int height, int depth) {
+	node_t make_sand_volume(asset_registry::registry_t& registry, int width, int height, int depth) {
 		auto sand_top_material = model::material_t{
-		   .diffuse_map = texture_2d::init(SAND_DIFFUSE_MAP_PATH),
-		   .normal_map = texture_2d::init(SAND_NORMAL_MAP_PATH),
-		   .height_map = texture_2d::init(SAND_HEIGHT_MAP_PATH),
+		   .diffuse_map = asset_registry::acquire_texture_2d(registry, SAND_DIFFUSE_MAP_PATH),
+		   .normal_map = asset_registry::acquire_texture_2d(
+		      registry, SAND_NORMAL_MAP_PATH, NORMAL_MAP_PARAMS, FLAT_NORMAL_PLACEHOLDER),
+		   .height_map = asset_registry::acquire_texture_2d(
+		      registry, SAND_HEIGHT_MAP_PATH, HEIGHT_MAP_PARAMS, NO_HEIGHT_PLACEHOLDER),
 		   .specular = glm::vec3(0.5),
 		};
 
@@ -124,13 +154,15 @@ namespace scene {
 		                                            .specular = glm::vec3(1),
 		                                            .phong_exp = 50.0f};
 
-		auto sand_volume = make_volume(width,
-		                               height,
-		                               depth,
-		                               sand_top_material,
-		                               sand_side_material,
-		                               scene::node_t::STATIC_MESH,
-		                               scene::node_t::STATIC_MESH);
+		auto sand_volume =
+		   make_volume_sides(width, height, depth, sand_side_material, scene::node_t::STATIC_MESH);
+
+		// the top is far too large for one mesh at full density, it is drawn as terrain chunks
+		auto top = scene::node_t{};
+		top.kind = scene::node_t::TERRAIN;
+		top.terrain = terrain::init(glm::vec2((float)width, (float)height), sand_top_material);
+		top.translation = glm::vec3(0, 0, depth);
+		sand_volume.children.push_back(top);
 
 		sand_volume.rotation.x = glm::radians(-90.0);
 
@@ -161,10 +193,23 @@ namespace scene {
 		return water_volume;
 	}
 
-	model::model_t make_skybox() {
+	node_t make_instanced(model::model_t model,
+	                      const std::vector<glm::mat4>& transforms,
+	                      const std::vector<glm::vec4>& tints) {
+		auto node = node_t{};
+		node.kind = node_t::INSTANCED;
+		node.model = std::move(model);
+		node.instances = mesh::init_instances(transforms, tints);
+		return node;
+	}
+
+	model::model_t make_skybox(asset_registry::registry_t& registry) {
 		auto skybox = model::model_t{};
-		skybox.meshes.push_back(mesh::init(shapes::make_cube(1.0f)));
-		skybox.materials.push_back({.cube_map = cubemap::make_cubemap(SKYBOX_BASE_PATH)});
+		auto cube_template = shapes::make_cube(1.0f);
+		mesh_optimize::optimize(cube_template);
+		skybox.meshes.push_back(mesh::init(cube_template));
+		skybox.materials.push_back(
+		   {.cube_map = asset_registry::acquire_cubemap(registry, SKYBOX_BASE_PATH)});
 		return skybox;
 	}
 
@@ -0,0 +1,197 @@
+#include "ass3/scene_graph.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include <chicken3421/chicken3421.hpp>
+
+namespace {
+	// translate * rotate(z) * rotate(y) * rotate(x) * scale, written out instead of multiplied
+	glm::mat4 compose(glm::vec3 t, glm::vec3 r, glm::vec3 s) {
+		float cx = std::cos(r.x), sx = std::sin(r.x);
+		float cy = std::cos(r.y), sy = std::sin(r.y);
+		float cz = std::cos(r.z), sz = std::sin(r.z);
+
+		auto m = glm::mat4(1.0f);
+		m[0] = glm::vec4(cz * cy, sz * cy, -sy, 0.0f) * s.x;
+		m[1] = glm::vec4(cz * sy * sx - sz * cx, sz * sy * sx + cz * cx, cy * sx, 0.0f) * s.y;
+		m[2] = glm::vec4(cz * sy * cx + sz * sx, sz * sy * cx - cz * sx, cy * cx, 0.0f) * s.z;
+		m[3] = glm::vec4(t, 1.0f);
+		return m;
+	}
+
+	bounds::aabb_t model_bounds(const model::model_t& model) {
+		auto box = bounds::aabb_t{};
+		for (const auto& mesh : model.meshes) {
+			box = bounds::merge(box, mesh.bounds);
+		}
+		return box;
+	}
+
+	bounds::aabb_t node_bounds(const scene_graph::graph_t& graph, scene_graph::node_id_t id) {
+		if (graph.kinds[id] == scene::node_t::TERRAIN) {
+			auto it = std::find(graph.terrain_nodes.begin(), graph.terrain_nodes.end(), id);
+			auto half = graph.terrains[(size_t)(it - graph.terrain_nodes.begin())].size * 0.5f;
+			return bounds::aabb_t{glm::vec3(-half, 0.0f), glm::vec3(half, 0.0f)};
+		}
+		auto box = model_bounds(graph.models[id]);
+		if (graph.kinds[id] != scene::node_t::INSTANCED) {
+			return box;
+		}
+		auto instanced = bounds::aabb_t{};
+		for (const auto& transform : graph.instances[id].transforms) {
+			instanced = bounds::merge(instanced, bounds::transform(box, transform));
+		}
+		return instanced;
+	}
+
+	// redo the subtree aggregates of the nodes in graph.refresh, which are flagged in graph.dirty
+	// and hold every ancestor of each other. Children have higher ids than their parent, so going
+	// from the highest id down finds every child already final. A node merges its direct
+	// children, found by jumping from one child's subtree end to the next
+	void update_subtrees(scene_graph::graph_t& graph) {
+		auto& refresh = graph.refresh;
+		std::sort(refresh.begin(), refresh.end(), std::greater<scene_graph::node_id_t>());
+		for (auto i : refresh) {
+			auto box = graph.world_bounds[i];
+			auto meshes = (uint32_t)graph.models[i].meshes.size();
+			auto end = graph.subtree_ends[i];
+			for (auto child = i + 1; child < end; child = graph.subtree_ends[child]) {
+				box = bounds::merge(box, graph.subtree_bounds[child]);
+				meshes += graph.subtree_meshes[child];
+			}
+			graph.subtree_bounds[i] = box;
+			graph.subtree_meshes[i] = meshes;
+
+			auto sphere = bounds::enclosing_sphere(box);
+			graph.subtree_x[i] = sphere.center.x;
+			graph.subtree_y[i] = sphere.center.y;
+			graph.subtree_z[i] = sphere.center.z;
+			graph.subtree_radius[i] = sphere.radius;
+		}
+	}
+} // namespace
+
+namespace scene_graph {
+	node_id_t add(graph_t& graph, const scene::node_t& node, node_id_t parent) {
+		chicken3421::expect(parent == NO_PARENT || parent < size(graph),
+		                    "scene_graph: parent does not exist");
+		chicken3421::expect(parent == NO_PARENT || graph.subtree_ends[parent] == size(graph),
+		                    "scene_graph: the parent's subtree is no longer at the back");
+		auto id = (node_id_t)size(graph);
+		graph.translations.push_back(node.translation);
+		graph.rotations.push_back(node.rotation);
+		graph.scales.push_back(node.scale);
+		graph.parents.push_back(parent);
+		graph.kinds.push_back(node.kind);
+		graph.models.push_back(node.model);
+		graph.instances.push_back(node.instances);
+		graph.invisible.push_back(node.invisible);
+		graph.dynamic.push_back(node.dynamic);
+		if (node.kind == scene::node_t::TERRAIN) {
+			graph.terrain_nodes.push_back(id);
+			graph.terrains.push_back(node.terrain);
+		}
+		graph.local_bounds.push_back(node_bounds(graph, id));
+		graph.subtree_ends.push_back(id + 1);
+		graph.worlds.emplace_back(1.0f);
+		graph.hidden.push_back(0);
+		graph.world_bounds.emplace_back();
+		graph.subtree_bounds.emplace_back();
+		graph.subtree_meshes.push_back(0);
+		graph.subtree_x.push_back(0.0f);
+		graph.subtree_y.push_back(0.0f);
+		graph.subtree_z.push_back(0.0f);
+		graph.subtree_radius.push_back(0.0f);
+		graph.dirty.push_back(0);
+		mark_dirty(graph, id);
+		for (auto ancestor = parent; ancestor != NO_PARENT; ancestor = graph.parents[ancestor]) {
+			graph.subtree_ends[ancestor] = id + 1;
+		}
+
+		for (const auto& child : node.children) {
+			add(graph, child, id);
+		}
+		return id;
+	}
+
+	size_t size(const graph_t& graph) {
+		return graph.parents.size();
+	}
+
+	void mark_dirty(graph_t& graph, node_id_t id) {
+		graph.dirty[id] = 1;
+		graph.first_dirty = std::min(graph.first_dirty, (size_t)id);
+	}
+
+	void set_translation(graph_t& graph, node_id_t id, glm::vec3 translation) {
+		graph.translations[id] = translation;
+		mark_dirty(graph, id);
+	}
+
+	void set_rotation(graph_t& graph, node_id_t id, glm::vec3 rotation) {
+		graph.rotations[id] = rotation;
+		mark_dirty(graph, id);
+	}
+
+	void set_scale(graph_t& graph, node_id_t id, glm::vec3 scale) {
+		graph.scales[id] = scale;
+		mark_dirty(graph, id);
+	}
+
+	void set_invisible(graph_t& graph, node_id_t id, bool invisible) {
+		graph.invisible[id] = invisible;
+		mark_dirty(graph, id);
+	}
+
+	void set_model(graph_t& graph, node_id_t id, model::model_t model) {
+		graph.models[id] = std::move(model);
+		graph.local_bounds[id] = node_bounds(graph, id);
+		mark_dirty(graph, id);
+	}
+
+	void update(graph_t& graph) {
+		auto n = size(graph);
+		graph.refresh.clear();
+		bool static_moved = false;
+		for (auto i = graph.first_dirty; i < n; ++i) {
+			auto parent = graph.parents[i];
+			bool has_parent = parent != NO_PARENT;
+			// parents come first, so theirs is already final for this pass
+			if (has_parent && graph.dirty[parent]) {
+				graph.dirty[i] = 1;
+			}
+			if (!graph.dirty[i]) {
+				continue;
+			}
+
+			auto local = compose(graph.translations[i], graph.rotations[i], graph.scales[i]);
+			graph.worlds[i] = has_parent ? graph.worlds[parent] * local : local;
+			graph.hidden[i] = graph.invisible[i] || (has_parent && graph.hidden[parent]);
+			graph.world_bounds[i] = bounds::transform(graph.local_bounds[i], graph.worlds[i]);
+			graph.refresh.push_back((node_id_t)i);
+			static_moved = static_moved || !graph.dynamic[i];
+		}
+		if (static_moved) {
+			++graph.static_version;
+		}
+
+		// the ancestors of the recomputed nodes contain them, flag them too. Stops at the first
+		// one already flagged, its own ancestors are then as well
+		auto n_recomputed = graph.refresh.size();
+		for (auto k = size_t{0}; k < n_recomputed; ++k) {
+			auto ancestor = graph.parents[graph.refresh[k]];
+			while (ancestor != NO_PARENT && !graph.dirty[ancestor]) {
+				graph.dirty[ancestor] = 1;
+				graph.refresh.push_back(ancestor);
+				ancestor = graph.parents[ancestor];
+			}
+		}
+		update_subtrees(graph);
+		for (auto i : graph.refresh) {
+			graph.dirty[i] = 0;
+		}
+		graph.first_dirty = n;
+	}
+} // namespace scene_graph
@@ -0,0 +1,340 @@
+#include "ass3/shadows.hpp"
+
+#include <glm/ext.hpp>
+#include <algorithm>
+#include <cmath>
+
+#include <chicken3421/chicken3421.hpp>
+
+#include "ass3/bounds.hpp"
+#include "ass3/gl_state.hpp"
+#include "ass3/program_cache.hpp"
+#include "ass3/mesh.hpp"
+
+const char* SHADOW_VERT_PATH = "res/shaders/shadow.vert";
+const char* SHADOW_FRAG_PATH = "res/shaders/shadow.frag";
+
+namespace {
+	// slope scaled depth bias while drawing casters, keeps lit surfaces from shadowing themselves
+	const float OFFSET_FACTOR = 2.0f;
+	const float OFFSET_UNITS = 4.0f;
+
+	GLuint make_depth_array(bool compare) {
+		GLuint texture;
+		glGenTextures(1, &texture);
+		gl_state::bind_texture(0, GL_TEXTURE_2D_ARRAY, texture);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY,
+		             0,
+		             GL_DEPTH_COMPONENT32F,
+		             shadows::MAP_SIZE,
+		             shadows::MAP_SIZE,
+		             shadows::CASCADES,
+		             0,
+		             GL_DEPTH_COMPONENT,
+		             GL_FLOAT,
+		             nullptr);
+		// linear filtering of a comparison gives 2x2 percentage closer filtering for free
+		GLint filter = compare ? GL_LINEAR : GL_NEAREST;
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		if (compare) {
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		}
+		return texture;
+	}
+
+	// a light space basis that only depends on the light's direction
+	glm::mat4 light_rotation(glm::vec3 light_dir) {
+		auto up = std::abs(light_dir.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+		return glm::lookAt(glm::vec3(0.0f), light_dir, up);
+	}
+
+	// view depth at which each cascade ends
+	void split(float near_plane, float far_plane, float ends[shadows::CASCADES]) {
+		for (int i = 0; i < shadows::CASCADES; ++i) {
+			auto t = (float)(i + 1) / shadows::CASCADES;
+			auto uniform = near_plane + (far_plane - near_plane) * t;
+			auto logarithmic = near_plane * std::pow(far_plane / near_plane, t);
+			ends[i] = glm::mix(uniform, logarithmic, shadows::SPLIT_LAMBDA);
+		}
+	}
+
+	// sphere around the part of the view frustum between two view depths
+	bounds::sphere_t enclose_range(const glm::mat4& view,
+	                               const glm::mat4& projection,
+	                               float begin,
+	                               float end) {
+		auto to_world = glm::inverse(view);
+		auto tan_x = 1.0f / projection[0][0];
+		auto tan_y = 1.0f / projection[1][1];
+		glm::vec3 corners[8];
+		for (int i = 0; i < 8; ++i) {
+			auto depth = (i & 4) ? end : begin;
+			auto corner = glm::vec4((i & 1) ? depth * tan_x : -depth * tan_x,
+			                        (i & 2) ? depth * tan_y : -depth * tan_y,
+			                        -depth,
+			                        1.0f);
+			corners[i] = glm::vec3(to_world * corner);
+		}
+
+		auto sphere = bounds::sphere_t{};
+		for (const auto& corner : corners) {
+			sphere.center += corner / 8.0f;
+		}
+		sphere.radius = 0.0f;
+		for (const auto& corner : corners) {
+			sphere.radius = std::max(sphere.radius, glm::length(corner - sphere.center));
+		}
+		// the radius only changes with the projection, rounding keeps float noise from moving it
+		sphere.radius = std::ceil(sphere.radius * 16.0f) / 16.0f;
+		return sphere;
+	}
+
+	// move a cascade onto a sphere, snapped to its texel grid in light space
+	void place(shadows::cascade_t& cascade, const bounds::sphere_t& sphere, glm::vec3 light_dir) {
+		cascade.radius = sphere.radius * (1.0f + shadows::CACHE_MARGIN);
+		auto rotation = light_rotation(light_dir);
+		auto texel = 2.0f * cascade.radius / (float)shadows::MAP_SIZE;
+		auto center = glm::vec3(rotation * glm::vec4(sphere.center, 1.0f));
+		center.x = std::floor(center.x / texel) * texel;
+		center.y = std::floor(center.y / texel) * texel;
+		cascade.center = glm::vec3(glm::inverse(rotation) * glm::vec4(center, 1.0f));
+
+		auto eye = cascade.center - light_dir * (cascade.radius + shadows::CASTER_DISTANCE);
+		auto up = std::abs(light_dir.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+		auto light_view = glm::lookAt(eye, cascade.center, up);
+		auto light_proj = glm::ortho(-cascade.radius,
+		                             cascade.radius,
+		                             -cascade.radius,
+		                             cascade.radius,
+		                             0.0f,
+		                             2.0f * cascade.radius + shadows::CASTER_DISTANCE);
+		cascade.view_proj = light_proj * light_view;
+	}
+
+	void attach(GLenum target, GLuint fbo, GLuint texture, int layer) {
+		gl_state::bind_framebuffer(target, fbo);
+		glFramebufferTextureLayer(target, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+	}
+
+	// draw the casters of one kind, static or dynamic, that fall in a cascade's light frustum
+	size_t draw_casters(shadows::shadows_t& shadows,
+	                    const scene_graph::graph_t& scene,
+	                    const shadows::cascade_t& cascade,
+	                    int lod,
+	                    bool dynamic) {
+		auto frustum = bounds::make_frustum(cascade.view_proj);
+		auto n = scene_graph::size(scene);
+		shadows.subtree_visible.resize(n);
+		bounds::test_spheres(frustum,
+		                     scene.subtree_x.data(),
+		                     scene.subtree_y.data(),
+		                     scene.subtree_z.data(),
+		                     scene.subtree_radius.data(),
+		                     n,
+		                     shadows.subtree_visible.data());
+
+		size_t drawn = 0;
+		for (auto id = size_t{0}; id < n; ++id) {
+			if (!shadows.subtree_visible[id]) {
+				id = scene.subtree_ends[id] - 1;
+				continue;
+			}
+			auto kind = scene.kinds[id];
+			const auto& node_model = scene.models[id];
+			if (scene.hidden[id] || (bool)scene.dynamic[id] != dynamic || node_model.meshes.empty()
+			    || kind == scene::node_t::WATER || kind == scene::node_t::WATER_SURFACE
+			    || !bounds::test_aabb(frustum, scene.world_bounds[id])) {
+				continue;
+			}
+
+			glUniformMatrix4fv(shadows.model_loc, 1, GL_FALSE, glm::value_ptr(scene.worlds[id]));
+			for (auto i = size_t{0}; i < node_model.meshes.size(); ++i) {
+				const auto& mesh = node_model.meshes[i];
+				const auto& material = node_model.materials[i];
+				if (material.diffuse.a < 1.0f) {
+					continue; // translucent surfaces let the light through
+				}
+				glUniform3fv(shadows.position_offset_loc, 1, glm::value_ptr(mesh.position_offset));
+				glUniform3fv(shadows.position_scale_loc, 1, glm::value_ptr(mesh.position_scale));
+				gl_state::bind_texture(0, GL_TEXTURE_2D, material.height_map);
+				if (kind == scene::node_t::INSTANCED) {
+					mesh::draw_instanced(mesh, scene.instances[id], GL_TRIANGLES, lod);
+				}
+				else {
+					gl_state::bind_vertex_array(mesh.vao);
+					mesh::draw_bound(mesh, GL_TRIANGLES, lod);
+				}
+				++drawn;
+			}
+		}
+
+		// terrain never moves, its chunks are picked around the cascade rather than the camera so
+		// they stay the same for as long as the cache does
+		for (auto t = size_t{0}; !dynamic && t < scene.terrain_nodes.size(); ++t) {
+			auto id = scene.terrain_nodes[t];
+			if (scene.hidden[id]) {
+				continue;
+			}
+			const auto& terrain = scene.terrains[t];
+			const auto& world = scene.worlds[id];
+			auto viewer = glm::vec3(glm::inverse(world) * glm::vec4(cascade.center, 1.0f));
+			terrain::select(terrain, viewer, shadows.chunks);
+
+			glUniform3fv(shadows.position_offset_loc, 1, glm::value_ptr(terrain.grid.position_offset));
+			glUniform3fv(shadows.position_scale_loc, 1, glm::value_ptr(terrain.grid.position_scale));
+			gl_state::bind_texture(0, GL_TEXTURE_2D, terrain.material.height_map);
+			gl_state::bind_vertex_array(terrain.grid.vao);
+			for (const auto& chunk : shadows.chunks) {
+				auto box = bounds::transform(chunk.bounds, world);
+				box.max.y += terrain::MAX_HEIGHT;
+				if (!bounds::test_aabb(frustum, box)) {
+					continue;
+				}
+				auto model = world * chunk.transform;
+				glUniformMatrix4fv(shadows.model_loc, 1, GL_FALSE, glm::value_ptr(model));
+				glUniform4fv(shadows.tex_coord_transform_loc,
+				             1,
+				             glm::value_ptr(chunk.tex_coord_transform));
+				mesh::draw_range(terrain.grid, terrain.variants[chunk.stitch]);
+				++drawn;
+			}
+			glUniform4f(shadows.tex_coord_transform_loc, 0.0f, 0.0f, 1.0f, 1.0f);
+		}
+		return drawn;
+	}
+} // namespace
+
+namespace shadows {
+	shadows_t init() {
+		auto shadows = shadows_t{};
+		shadows.program = program_cache::load(SHADOW_VERT_PATH, SHADOW_FRAG_PATH);
+
+		shadows.light_view_proj_loc = glGetUniformLocation(shadows.program, "uLightViewProj");
+		shadows.model_loc = glGetUniformLocation(shadows.program, "uModel");
+		shadows.tex_coord_transform_loc = glGetUniformLocation(shadows.program, "uTexCoordTransform");
+		shadows.position_offset_loc = glGetUniformLocation(shadows.program, "uPositionOffset");
+		shadows.position_scale_loc = glGetUniformLocation(shadows.program, "uPositionScale");
+		gl_state::use_program(shadows.program);
+		glUniform1i(glGetUniformLocation(shadows.program, "uHeightMap"), 0);
+		glUniform4f(shadows.tex_coord_transform_loc, 0.0f, 0.0f, 1.0f, 1.0f);
+
+		shadows.static_maps = make_depth_array(false);
+		shadows.maps = make_depth_array(true);
+		glGenFramebuffers(1, &shadows.draw_fbo);
+		glGenFramebuffers(1, &shadows.read_fbo);
+
+		// depth only, and complete with just the depth attachment
+		gl_state::bind_framebuffer(GL_FRAMEBUFFER, shadows.draw_fbo);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		gl_state::bind_framebuffer(GL_FRAMEBUFFER, shadows.read_fbo);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		attach(GL_FRAMEBUFFER, shadows.read_fbo, shadows.static_maps, 0);
+		chicken3421::expect(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE,
+		                    "shadows: depth-only framebuffer is incomplete");
+		gl_state::bind_framebuffer(GL_FRAMEBUFFER, 0);
+		return shadows;
+	}
+
+	void destroy(shadows_t& shadows) {
+		gl_state::delete_framebuffers(1, &shadows.draw_fbo);
+		gl_state::delete_framebuffers(1, &shadows.read_fbo);
+		gl_state::delete_textures(1, &shadows.static_maps);
+		gl_state::delete_textures(1, &shadows.maps);
+		gl_state::delete_program(shadows.program);
+		shadows = shadows_t{};
+	}
+
+	void update(shadows_t& shadows,
+	            const scene_graph::graph_t& scene,
+	            glm::vec3 light_dir,
+	            const glm::mat4& view,
+	            const glm::mat4& projection) {
+		shadows.stats = stats_t{};
+		light_dir = glm::normalize(light_dir);
+
+		auto near_plane = projection[3][2] / (projection[2][2] - 1.0f);
+		auto far_plane = projection[3][2] / (projection[2][2] + 1.0f);
+		float ends[CASCADES];
+		split(near_plane, std::min(far_plane, SHADOW_DISTANCE), ends);
+
+		gl_state::use_program(shadows.program);
+		gl_state::viewport(0, 0, MAP_SIZE, MAP_SIZE);
+		gl_state::enable(GL_POLYGON_OFFSET_FILL);
+		gl_state::polygon_offset(OFFSET_FACTOR, OFFSET_UNITS);
+		// one-sided surfaces such as the terrain have to cast from their back as well
+		gl_state::disable(GL_CULL_FACE);
+
+		auto begin = near_plane;
+		for (int i = 0; i < CASCADES; ++i) {
+			auto& cascade = shadows.cascades[i];
+			cascade.end = ends[i];
+			auto sphere = enclose_range(view, projection, begin, ends[i]);
+			begin = ends[i];
+
+			bool turned = cascade.light_dir != light_dir;
+			bool left = glm::length(sphere.center - cascade.center) + sphere.radius > cascade.radius;
+			if (!cascade.cached || turned || left) {
+				place(cascade, sphere, light_dir);
+				cascade.cached = false;
+			}
+			auto view_proj = glm::value_ptr(cascade.view_proj);
+			glUniformMatrix4fv(shadows.light_view_proj_loc, 1, GL_FALSE, view_proj);
+
+			bool redraw = !cascade.cached || cascade.static_version != scene.static_version;
+			if (redraw) {
+				attach(GL_FRAMEBUFFER, shadows.draw_fbo, shadows.static_maps, i);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				// finer cascades have the coarser levels of detail in them
+				shadows.stats.static_casters += draw_casters(shadows, scene, cascade, i, false);
+				++shadows.stats.static_redraws;
+				cascade.cached = true;
+				cascade.static_version = scene.static_version;
+				cascade.light_dir = light_dir;
+			}
+
+			// the sampled map is rebuilt from the cache whenever either part of it changed
+			attach(GL_DRAW_FRAMEBUFFER, shadows.draw_fbo, shadows.maps, i);
+			auto frustum = bounds::make_frustum(cascade.view_proj);
+			bool has_dynamic = false;
+			for (auto id = size_t{0}; id < scene_graph::size(scene) && !has_dynamic; ++id) {
+				has_dynamic = scene.dynamic[id] && !scene.hidden[id]
+				              && bounds::test_aabb(frustum, scene.world_bounds[id]);
+			}
+			if (redraw || has_dynamic || cascade.composited_dynamic) {
+				attach(GL_READ_FRAMEBUFFER, shadows.read_fbo, shadows.static_maps, i);
+				glBlitFramebuffer(0,
+				                  0,
+				                  MAP_SIZE,
+				                  MAP_SIZE,
+				                  0,
+				                  0,
+				                  MAP_SIZE,
+				                  MAP_SIZE,
+				                  GL_DEPTH_BUFFER_BIT,
+				                  GL_NEAREST);
+			}
+			if (has_dynamic) {
+				shadows.stats.dynamic_casters += draw_casters(shadows, scene, cascade, i, true);
+			}
+			cascade.composited_dynamic = has_dynamic;
+		}
+
+		gl_state::enable(GL_CULL_FACE);
+		gl_state::polygon_offset(0.0f, 0.0f);
+		gl_state::disable(GL_POLYGON_OFFSET_FILL);
+		gl_state::bind_framebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	glm::mat4 shadow_matrix(const shadows_t& shadows, int cascade) {
+		// clip space [-1, 1] to texture space [0, 1]
+		auto bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f));
+		bias = glm::scale(bias, glm::vec3(0.5f));
+		return bias * shadows.cascades[cascade].view_proj;
+	}
+} // namespace shadows
@@ -0,0 +1,288 @@
+#include "ass3/simplify.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace {
+	// symmetric 4x4 error quadric, upper triangle, plus the total weight of the planes summed in
+	struct quadric_t {
+		double a2 = 0, ab = 0, ac = 0, ad = 0;
+		double b2 = 0, bc = 0, bd = 0;
+		double c2 = 0, cd = 0;
+		double d2 = 0;
+		double weight = 0;
+	};
+
+	struct vec3d_t {
+		double x, y, z;
+	};
+
+	struct collapse_t {
+		double cost;
+		GLuint from;
+		GLuint to;
+	};
+
+	vec3d_t to_vec3d(const glm::vec3& p) {
+		return vec3d_t{p.x, p.y, p.z};
+	}
+
+	vec3d_t sub(vec3d_t a, vec3d_t b) {
+		return vec3d_t{a.x - b.x, a.y - b.y, a.z - b.z};
+	}
+
+	vec3d_t cross(vec3d_t a, vec3d_t b) {
+		return vec3d_t{a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+	}
+
+	double dot(vec3d_t a, vec3d_t b) {
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	void add_plane(quadric_t& q, vec3d_t n, double d, double w) {
+		q.a2 += w * n.x * n.x;
+		q.ab += w * n.x * n.y;
+		q.ac += w * n.x * n.z;
+		q.ad += w * n.x * d;
+		q.b2 += w * n.y * n.y;
+		q.bc += w * n.y * n.z;
+		q.bd += w * n.y * d;
+		q.c2 += w * n.z * n.z;
+		q.cd += w * n.z * d;
+		q.d2 += w * d * d;
+		q.weight += w;
+	}
+
+	void add_quadric(quadric_t& q, const quadric_t& r) {
+		q.a2 += r.a2;
+		q.ab += r.ab;
+		q.ac += r.ac;
+		q.ad += r.ad;
+		q.b2 += r.b2;
+		q.bc += r.bc;
+		q.bd += r.bd;
+		q.c2 += r.c2;
+		q.cd += r.cd;
+		q.d2 += r.d2;
+		q.weight += r.weight;
+	}
+
+	// weighted mean squared distance of p from the planes of q and r together
+	double evaluate(const quadric_t& q, const quadric_t& r, vec3d_t p) {
+		auto sum = q;
+		add_quadric(sum, r);
+		double error = sum.a2 * p.x * p.x + 2 * sum.ab * p.x * p.y + 2 * sum.ac * p.x * p.z
+		               + 2 * sum.ad * p.x + sum.b2 * p.y * p.y + 2 * sum.bc * p.y * p.z
+		               + 2 * sum.bd * p.y + sum.c2 * p.z * p.z + 2 * sum.cd * p.z + sum.d2;
+		return sum.weight > 0 ? std::fabs(error) / sum.weight : 0.0;
+	}
+
+	uint64_t edge_key(GLuint a, GLuint b) {
+		return a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+	}
+
+	// vertices touching an edge used by exactly one triangle, or by more than two
+	std::vector<uint8_t> find_locked(size_t vertex_count, const std::vector<GLuint>& indices) {
+		std::vector<uint64_t> edges;
+		edges.reserve(indices.size());
+		for (size_t t = 0; t < indices.size(); t += 3) {
+			for (int e = 0; e < 3; ++e) {
+				edges.push_back(edge_key(indices[t + (size_t)e], indices[t + (size_t)(e + 1) % 3]));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+
+		std::vector<uint8_t> locked(vertex_count, 0);
+		for (size_t i = 0; i < edges.size();) {
+			size_t j = i;
+			while (j < edges.size() && edges[j] == edges[i]) {
+				++j;
+			}
+			if (j - i != 2) {
+				locked[(size_t)(edges[i] >> 32)] = 1;
+				locked[(size_t)(edges[i] & 0xffffffffu)] = 1;
+			}
+			i = j;
+		}
+		return locked;
+	}
+
+	vec3d_t triangle_normal(const glm::vec3* positions, GLuint a, GLuint b, GLuint c) {
+		auto p0 = to_vec3d(positions[a]);
+		return cross(sub(to_vec3d(positions[b]), p0), sub(to_vec3d(positions[c]), p0));
+	}
+} // namespace
+
+namespace simplify {
+	std::vector<GLuint> simplify(const glm::vec3* positions,
+	                             size_t vertex_count,
+	                             const std::vector<GLuint>& indices,
+	                             size_t target_index_count,
+	                             float max_error,
+	                             float* result_error) {
+		auto result = indices;
+		double worst = 0;
+
+		// errors are compared against the largest extent of the mesh
+		auto lo = vec3d_t{HUGE_VAL, HUGE_VAL, HUGE_VAL};
+		auto hi = vec3d_t{-HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+		for (size_t v = 0; v < vertex_count; ++v) {
+			auto p = to_vec3d(positions[v]);
+			lo = vec3d_t{std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z)};
+			hi = vec3d_t{std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z)};
+		}
+		double extent = std::max({hi.x - lo.x, hi.y - lo.y, hi.z - lo.z, 1e-12});
+		double max_cost = (double)max_error * extent * (double)max_error * extent;
+
+		// one quadric per vertex from the planes of its triangles, weighted by area
+		std::vector<quadric_t> quadrics(vertex_count);
+		for (size_t t = 0; t < result.size(); t += 3) {
+			auto n = triangle_normal(positions, result[t], result[t + 1], result[t + 2]);
+			double length = std::sqrt(dot(n, n));
+			if (length <= 0) {
+				continue;
+			}
+			n = vec3d_t{n.x / length, n.y / length, n.z / length};
+			double d = -dot(n, to_vec3d(positions[result[t]]));
+			for (int k = 0; k < 3; ++k) {
+				add_plane(quadrics[result[t + (size_t)k]], n, d, length * 0.5);
+			}
+		}
+
+		auto locked = find_locked(vertex_count, result);
+
+		std::vector<uint64_t> edges;
+		std::vector<collapse_t> collapses;
+		std::vector<GLuint> targets(vertex_count);
+		std::vector<uint8_t> touched(vertex_count);
+		std::vector<uint32_t> adjacency_offsets(vertex_count + 1);
+		std::vector<uint32_t> adjacency;
+
+		// every pass collapses a set of edges far enough apart not to interfere, cheapest first
+		while (result.size() > target_index_count) {
+			size_t n_tris = result.size() / 3;
+
+			// vertex -> triangles, as offsets into one array
+			std::fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0);
+			for (auto v : result) {
+				++adjacency_offsets[v + 1];
+			}
+			for (size_t v = 0; v < vertex_count; ++v) {
+				adjacency_offsets[v + 1] += adjacency_offsets[v];
+			}
+			adjacency.resize(result.size());
+			{
+				auto fill = adjacency_offsets;
+				for (size_t i = 0; i < result.size(); ++i) {
+					adjacency[fill[result[i]]++] = (uint32_t)(i / 3);
+				}
+			}
+
+			edges.clear();
+			for (size_t t = 0; t < result.size(); t += 3) {
+				for (int e = 0; e < 3; ++e) {
+					edges.push_back(edge_key(result[t + (size_t)e], result[t + (size_t)(e + 1) % 3]));
+				}
+			}
+			std::sort(edges.begin(), edges.end());
+			edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+			collapses.clear();
+			for (auto edge : edges) {
+				auto a = (GLuint)(edge >> 32);
+				auto b = (GLuint)(edge & 0xffffffffu);
+				double cost_ab = locked[a] ? HUGE_VAL
+				                           : evaluate(quadrics[a], quadrics[b], to_vec3d(positions[b]));
+				double cost_ba = locked[b] ? HUGE_VAL
+				                           : evaluate(quadrics[a], quadrics[b], to_vec3d(positions[a]));
+				if (cost_ab <= cost_ba && cost_ab <= max_cost) {
+					collapses.push_back(collapse_t{cost_ab, a, b});
+				}
+				else if (cost_ba < cost_ab && cost_ba <= max_cost) {
+					collapses.push_back(collapse_t{cost_ba, b, a});
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const auto& x, const auto& y) {
+				return x.cost < y.cost;
+			});
+
+			for (size_t v = 0; v < vertex_count; ++v) {
+				targets[v] = (GLuint)v;
+			}
+			std::fill(touched.begin(), touched.end(), 0);
+
+			// each collapse removes the triangles on its edge, stop once that reaches the target
+			size_t removable = n_tris - target_index_count / 3;
+			size_t removed = 0;
+			for (const auto& collapse : collapses) {
+				if (removed >= removable) {
+					break;
+				}
+				if (touched[collapse.from] || touched[collapse.to]) {
+					continue;
+				}
+
+				// reject collapses that would flip a triangle around the removed vertex
+				bool flips = false;
+				size_t shared = 0;
+				for (auto i = adjacency_offsets[collapse.from];
+				     i < adjacency_offsets[collapse.from + 1] && !flips;
+				     ++i) {
+					const GLuint* tri = &result[(size_t)adjacency[i] * 3];
+					if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) {
+						++shared;
+						continue;
+					}
+					GLuint moved[3];
+					for (int k = 0; k < 3; ++k) {
+						moved[k] = tri[k] == collapse.from ? collapse.to : tri[k];
+					}
+					auto before = triangle_normal(positions, tri[0], tri[1], tri[2]);
+					auto after = triangle_normal(positions, moved[0], moved[1], moved[2]);
+					flips = dot(before, after) <= 0;
+				}
+				if (flips) {
+					continue;
+				}
+
+				targets[collapse.from] = collapse.to;
+				add_quadric(quadrics[collapse.to], quadrics[collapse.from]);
+				worst = std::max(worst, collapse.cost);
+				removed += shared;
+
+				// freeze the neighbourhood so no other collapse this pass changes these triangles
+				for (auto i = adjacency_offsets[collapse.from];
+				     i < adjacency_offsets[collapse.from + 1];
+				     ++i) {
+					const GLuint* tri = &result[(size_t)adjacency[i] * 3];
+					touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+				}
+			}
+			if (removed == 0) {
+				break;
+			}
+
+			// targets never collapse themselves in the same pass, so one lookup is enough
+			size_t write = 0;
+			for (size_t t = 0; t < result.size(); t += 3) {
+				GLuint a = targets[result[t]];
+				GLuint b = targets[result[t + 1]];
+				GLuint c = targets[result[t + 2]];
+				if (a == b || b == c || a == c) {
+					continue;
+				}
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+			result.resize(write);
+		}
+
+		if (result_error) {
+			*result_error = (float)(std::sqrt(worst) / extent);
+		}
+		return result;
+	}
+} // namespace simplify
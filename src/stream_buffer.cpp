@@ -0,0 +1,78 @@
+#include "ass3/stream_buffer.hpp"
+#include "ass3/gl_state.hpp"
+
+#include <chicken3421/chicken3421.hpp>
+
+namespace {
+	const GLuint64 FENCE_TIMEOUT_NS = 1000000000; // per wait, waiting repeats until signalled
+} // namespace
+
+namespace stream_buffer {
+	stream_buffer_t init(size_t capacity) {
+		auto stream = stream_buffer_t{};
+		stream.segment_size = capacity / FRAMES_IN_FLIGHT / ALIGNMENT * ALIGNMENT;
+		glGenBuffers(1, &stream.buffer);
+		gl_state::bind_buffer(GL_ARRAY_BUFFER, stream.buffer);
+		glBufferData(GL_ARRAY_BUFFER,
+		             (GLsizeiptr)(stream.segment_size * FRAMES_IN_FLIGHT),
+		             nullptr,
+		             GL_STREAM_DRAW);
+		return stream;
+	}
+
+	void destroy(stream_buffer_t& stream) {
+		for (auto& fence : stream.fences) {
+			if (fence) {
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+		gl_state::delete_buffers(1, &stream.buffer);
+		stream.buffer = 0;
+	}
+
+	void begin_frame(stream_buffer_t& stream) {
+		auto& fence = stream.fences[stream.segment];
+		if (fence) {
+			GLenum status = glClientWaitSync(fence, 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED) {
+				++stream.stalls;
+				do {
+					status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+				} while (status == GL_TIMEOUT_EXPIRED);
+			}
+			chicken3421::expect(status != GL_WAIT_FAILED, "stream_buffer: waiting on a fence failed");
+			glDeleteSync(fence);
+			fence = nullptr;
+		}
+		stream.head = (size_t)stream.segment * stream.segment_size;
+	}
+
+	void end_frame(stream_buffer_t& stream) {
+		stream.fences[stream.segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		stream.segment = (stream.segment + 1) % FRAMES_IN_FLIGHT;
+	}
+
+	void* map(stream_buffer_t& stream, size_t size, size_t& offset) {
+		offset = (stream.head + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+		auto segment_end = (size_t)(stream.segment + 1) * stream.segment_size;
+		chicken3421::expect(offset + size <= segment_end,
+		                    "stream_buffer: out of space for this frame, raise the capacity");
+		stream.head = offset + size;
+
+		// this frame's segment is not in use by the GPU, so there is nothing to synchronise with
+		gl_state::bind_buffer(GL_ARRAY_BUFFER, stream.buffer);
+		void* data = glMapBufferRange(GL_ARRAY_BUFFER,
+		                              (GLintptr)offset,
+		                              (GLsizeiptr)size,
+		                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+		                                 | GL_MAP_UNSYNCHRONIZED_BIT);
+		chicken3421::expect(data != nullptr, "stream_buffer: mapping failed");
+		return data;
+	}
+
+	void unmap(stream_buffer_t& stream) {
+		gl_state::bind_buffer(GL_ARRAY_BUFFER, stream.buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+} // namespace stream_buffer
@@ -0,0 +1,160 @@
+#include "ass3/terrain.hpp"
+#include "ass3/mesh_optimize.hpp"
+
+#include <algorithm>
+
+namespace {
+	const int GRID_SIDE = terrain::CHUNK_CELLS + 1;
+
+	GLuint grid_vertex(int i, int j) {
+		return (GLuint)(j * GRID_SIDE + i);
+	}
+
+	// the vertex drawn in place of (i, j): odd vertices on a stitched edge fold onto the even one
+	// before them, which leaves that edge with exactly the coarser neighbour's vertices
+	GLuint stitched_vertex(int i, int j, int stitch) {
+		const int last = terrain::CHUNK_CELLS;
+		if (i % 2 == 1 && ((j == 0 && (stitch & terrain::STITCH_MIN_Y))
+		                   || (j == last && (stitch & terrain::STITCH_MAX_Y)))) {
+			--i;
+		}
+		if (j % 2 == 1 && ((i == 0 && (stitch & terrain::STITCH_MIN_X))
+		                   || (i == last && (stitch & terrain::STITCH_MAX_X)))) {
+			--j;
+		}
+		return grid_vertex(i, j);
+	}
+
+	// two counter-clockwise triangles per quad, dropping the ones folding left degenerate
+	void append_variant(int stitch, std::vector<GLuint>& indices) {
+		auto triangle = [&indices](GLuint a, GLuint b, GLuint c) {
+			if (a != b && b != c && a != c) {
+				indices.insert(indices.end(), {a, b, c});
+			}
+		};
+		for (int j = 0; j < terrain::CHUNK_CELLS; ++j) {
+			for (int i = 0; i < terrain::CHUNK_CELLS; ++i) {
+				auto a = stitched_vertex(i, j, stitch);
+				auto b = stitched_vertex(i + 1, j, stitch);
+				auto c = stitched_vertex(i + 1, j + 1, stitch);
+				auto d = stitched_vertex(i, j + 1, stitch);
+				triangle(a, b, c);
+				triangle(c, d, a);
+			}
+		}
+	}
+
+	bounds::aabb_t chunk_bounds(const terrain::terrain_t& terrain, int depth, int x, int y) {
+		auto extent = terrain.size / (float)(1 << depth);
+		auto min = terrain.size * -0.5f + extent * glm::vec2((float)x, (float)y);
+		return bounds::aabb_t{glm::vec3(min, 0.0f), glm::vec3(min + extent, 0.0f)};
+	}
+
+	bool should_split(const terrain::terrain_t& terrain, glm::vec3 viewer, int depth, int x, int y) {
+		if (depth >= terrain.max_depth) {
+			return false;
+		}
+		auto box = chunk_bounds(terrain, depth, x, y);
+		auto nearest = glm::clamp(viewer, box.min, box.max);
+		auto size = std::max(box.max.x - box.min.x, box.max.y - box.min.y);
+		return glm::length(viewer - nearest) < terrain::SPLIT_DISTANCE * size;
+	}
+
+	// a same-sized neighbour that does not exist as a leaf was merged into its unsplit parent
+	bool coarser_neighbour(const terrain::terrain_t& terrain,
+	                       glm::vec3 viewer,
+	                       int depth,
+	                       int x,
+	                       int y) {
+		int count = 1 << depth;
+		if (depth == 0 || x < 0 || y < 0 || x >= count || y >= count) {
+			return false;
+		}
+		return !should_split(terrain, viewer, depth - 1, x / 2, y / 2);
+	}
+
+	void refine(const terrain::terrain_t& terrain,
+	            glm::vec3 viewer,
+	            int depth,
+	            int x,
+	            int y,
+	            std::vector<terrain::chunk_t>& chunks) {
+		if (should_split(terrain, viewer, depth, x, y)) {
+			for (int child = 0; child < 4; ++child) {
+				refine(terrain, viewer, depth + 1, 2 * x + (child & 1), 2 * y + (child >> 1), chunks);
+			}
+			return;
+		}
+
+		auto chunk = terrain::chunk_t{};
+		chunk.bounds = chunk_bounds(terrain, depth, x, y);
+		chunk.depth = depth;
+		auto min = glm::vec2(chunk.bounds.min.x, chunk.bounds.min.y);
+		auto extent = glm::vec2(chunk.bounds.max.x, chunk.bounds.max.y) - min;
+		chunk.transform = glm::mat4(1.0f);
+		chunk.transform[0][0] = extent.x;
+		chunk.transform[1][1] = extent.y;
+		chunk.transform[3] = glm::vec4(min.x, min.y, 0.0f, 1.0f);
+		// the same mapping as shapes::make_plane, uvs run 0 to 1 across the whole plane
+		auto uv_offset = (min + terrain.size * 0.5f) / terrain.size;
+		auto uv_scale = extent / terrain.size;
+		chunk.tex_coord_transform = glm::vec4(uv_offset.x, uv_offset.y, uv_scale.x, uv_scale.y);
+
+		if (coarser_neighbour(terrain, viewer, depth, x, y - 1)) {
+			chunk.stitch |= terrain::STITCH_MIN_Y;
+		}
+		if (coarser_neighbour(terrain, viewer, depth, x + 1, y)) {
+			chunk.stitch |= terrain::STITCH_MAX_X;
+		}
+		if (coarser_neighbour(terrain, viewer, depth, x, y + 1)) {
+			chunk.stitch |= terrain::STITCH_MAX_Y;
+		}
+		if (coarser_neighbour(terrain, viewer, depth, x - 1, y)) {
+			chunk.stitch |= terrain::STITCH_MIN_X;
+		}
+		chunks.push_back(chunk);
+	}
+} // namespace
+
+namespace terrain {
+	terrain_t init(glm::vec2 size, const model::material_t& material) {
+		auto terrain = terrain_t{};
+		terrain.size = size;
+		terrain.material = material;
+		// deep enough that the finest chunks have about one quad per unit
+		auto largest = std::max(size.x, size.y);
+		while ((float)(CHUNK_CELLS << terrain.max_depth) < largest) {
+			++terrain.max_depth;
+		}
+
+		auto grid_template = mesh::mesh_template_t{};
+		for (int j = 0; j < GRID_SIDE; ++j) {
+			for (int i = 0; i < GRID_SIDE; ++i) {
+				auto uv = glm::vec2((float)i, (float)j) / (float)CHUNK_CELLS;
+				grid_template.positions.emplace_back(uv, 0.0f);
+				grid_template.tex_coords.push_back(uv);
+				grid_template.normals.emplace_back(0.0f, 0.0f, 1.0f);
+			}
+		}
+		for (int stitch = 0; stitch < STITCH_VARIANTS; ++stitch) {
+			auto first = grid_template.indices.size();
+			append_variant(stitch, grid_template.indices);
+			terrain.variants[stitch] =
+			   mesh::lod_t{(GLsizei)first, (GLsizei)(grid_template.indices.size() - first), 0.0f};
+		}
+		std::vector<mesh::lod_t> ranges(terrain.variants, terrain.variants + STITCH_VARIANTS);
+		mesh_optimize::optimize(grid_template, ranges);
+		// positions stay float: quantizing them would round shared edges differently per level
+		terrain.grid = mesh::init(grid_template, GL_STATIC_DRAW, mesh::COMPACT_VERTICES);
+		return terrain;
+	}
+
+	void destroy(const terrain_t& terrain) {
+		mesh::destroy(terrain.grid);
+	}
+
+	void select(const terrain_t& terrain, glm::vec3 viewer, std::vector<chunk_t>& chunks) {
+		chunks.clear();
+		refine(terrain, viewer, 0, 0, 0, chunks);
+	}
+} // namespace terrain
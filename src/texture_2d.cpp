@@ -1,59 +1,104 @@
 #include <glad/glad.h>
+#include <algorithm>
 #include <iostream>
 #include <stb/stb_image.h>
 #include <chicken3421/chicken3421.hpp>
 
 #include "ass3/texture_2d.hpp"
+#include "ass3/gl_state.hpp"
+#include "ass3/texture_cache.hpp"
 
 namespace texture_2d {
     GLuint init(std::string file_name, params_t const &params) {
         GLuint tex;
         glGenTextures(1, &tex);
 
-        stbi_set_flip_vertically_on_load(true);
+        // compressed with its mips where the context can sample the format, decoded otherwise
+        auto compressed = texture_cache::texture_t{};
+        image_t image;
+        if (texture_cache::load(file_name, params.content, compressed, image)) {
+            texture_cache::upload(tex, compressed, params);
+            texture_cache::close(compressed);
+            return tex;
+        }
+        upload(tex, image.width, image.height, image.n_channels, image.pixels.data(), params);
+
+        return tex;
+    }
+
+    image_t decode(const std::string &file_name, bool flip_vertically) {
+        // stb's flip flag is process-wide, so it is left off and rows are flipped here instead -
+        // decodes may run concurrently on loader threads
+        stbi_set_flip_vertically_on_load(false);
 
         // load the image using stb lib
-        void *data = 0;
         int width, height, n_channels;
-        data = stbi_load(file_name.data(), &width, &height, &n_channels, 0);
+        unsigned char *data = stbi_load(file_name.data(), &width, &height, &n_channels, 0);
 
         chicken3421::expect(data, "Could not read " + file_name);
 
-        glBindTexture(GL_TEXTURE_2D, tex);
+        image_t image;
+        image.width = width;
+        image.height = height;
+        image.n_channels = n_channels;
+        image.pixels.assign(data, data + (size_t) width * (size_t) height * (size_t) n_channels);
+        stbi_image_free(data);
+
+        if (flip_vertically) {
+            auto row_size = (size_t) width * (size_t) n_channels;
+            for (auto y = size_t{0}; y < (size_t) height / 2; ++y) {
+                auto top = image.pixels.begin() + (std::ptrdiff_t) (y * row_size);
+                auto bottom_row = (size_t) height - 1 - y;
+                auto bottom = image.pixels.begin() + (std::ptrdiff_t) (bottom_row * row_size);
+                std::swap_ranges(top, top + (std::ptrdiff_t) row_size, bottom);
+            }
+        }
+        return image;
+    }
+
+    void upload(GLuint tex, int width, int height, int n_channels, const void *data,
+                params_t const &params) {
+        gl_state::bind_texture(0, GL_TEXTURE_2D, tex);
 
         GLenum format = n_channels == 3 ? GL_RGB : GL_RGBA;
+        // rows of RGB images are not 4-byte aligned in general
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         glTexImage2D(GL_TEXTURE_2D, 0, (GLint)format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
         // generate mimap if filter_min is a mipmap filter
-        switch (params.filter_min) {
-            case GL_LINEAR_MIPMAP_LINEAR:
-            case GL_NEAREST_MIPMAP_LINEAR:
-            case GL_LINEAR_MIPMAP_NEAREST:
-            case GL_NEAREST_MIPMAP_NEAREST:
-                glGenerateMipmap(GL_TEXTURE_2D);
-                break;
-            default:
-                break;
+        if (uses_mipmaps(params)) {
+            glGenerateMipmap(GL_TEXTURE_2D);
         }
+        set_params(params);
+    }
 
+    void set_params(params_t const &params) {
         // wrap options
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, params.wrap_s);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, params.wrap_t);
         // mag/min options
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, params.filter_min);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, params.filter_max);
+    }
 
-        glBindTexture(GL_TEXTURE_2D, 0);
-
-        return tex;
+    bool uses_mipmaps(params_t const &params) {
+        switch (params.filter_min) {
+            case GL_LINEAR_MIPMAP_LINEAR:
+            case GL_NEAREST_MIPMAP_LINEAR:
+            case GL_LINEAR_MIPMAP_NEAREST:
+            case GL_NEAREST_MIPMAP_NEAREST:
+                return true;
+            default:
+                return false;
+        }
     }
 
     void bind(GLuint tex) {
-        glBindTexture(GL_TEXTURE_2D, tex);
+        gl_state::bind_texture(0, GL_TEXTURE_2D, tex);
     }
 
     void destroy(GLuint tex) {
-        glDeleteTextures(1, &tex);
+        gl_state::delete_textures(1, &tex);
     }
 }
-
@@ -0,0 +1,524 @@
+#include "ass3/texture_cache.hpp"
+#include "ass3/cache_file.hpp"
+#include "ass3/gl_state.hpp"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// EXT_texture_compression_s3tc, not part of core GL
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace {
+	const char* CACHE_EXTENSION = ".texcache";
+	const uint32_t CACHE_MAGIC = 0x58543341; // "A3TX"
+	const uint32_t CACHE_VERSION = 1;
+
+	// the gamma the shaders decode colour with, see sRGB_to_linear in shader.frag
+	const float GAMMA = 2.2f;
+
+	struct header_t {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t content; // texture_2d::content_t
+		uint32_t format; // texture_cache::format_t
+		uint32_t n_levels;
+		uint32_t reserved;
+		cache_file::source_info_t source;
+	};
+
+	// an 8-bit RGBA texel, as the blocks are encoded from
+	using texel_t = std::array<uint8_t, 4>;
+
+	// set once by init() before any load, read by the loader threads
+	std::atomic<bool> s3tc{false};
+
+	std::string cache_path(const std::string& source_path) {
+		return source_path + CACHE_EXTENSION;
+	}
+
+	size_t align16(size_t n) {
+		return (n + 15) & ~size_t{15};
+	}
+
+	size_t block_size(texture_cache::format_t format) {
+		return format == texture_cache::BC1 || format == texture_cache::BC4 ? 8 : 16;
+	}
+
+	bool supported(texture_cache::format_t format) {
+		return format == texture_cache::BC4 || format == texture_cache::BC5 || s3tc;
+	}
+
+	// check a mapped cache file, filling in the texture's format and levels
+	bool parse(const std::string& source_path,
+	           texture_2d::content_t content,
+	           texture_cache::texture_t& texture) {
+		auto header = header_t{};
+		if (texture.mapping_size < sizeof(header)) {
+			return false;
+		}
+		std::memcpy(&header, texture.mapping, sizeof(header));
+		if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION
+		    || header.content != (uint32_t)content || header.format > texture_cache::BC5
+		    || header.n_levels == 0
+		    || !cache_file::source_unchanged(source_path, header.source)) {
+			return false;
+		}
+		texture.format = (texture_cache::format_t)header.format;
+
+		auto table = sizeof(header) + header.n_levels * sizeof(texture_cache::level_t);
+		if (texture.mapping_size < table) {
+			return false;
+		}
+		texture.levels.resize(header.n_levels);
+		std::memcpy(texture.levels.data(),
+		            (const char*)texture.mapping + sizeof(header),
+		            header.n_levels * sizeof(texture_cache::level_t));
+		for (const auto& level : texture.levels) {
+			auto size = texture.mapping_size;
+			if (level.offset > size || level.size > size - level.offset) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool map_cache(const std::string& source_path,
+	               texture_2d::content_t content,
+	               texture_cache::texture_t& texture) {
+		texture = texture_cache::texture_t{};
+
+		int fd = ::open(cache_path(source_path).c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st {};
+		if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+			::close(fd);
+			return false;
+		}
+		void* mapping = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (mapping == MAP_FAILED) {
+			return false;
+		}
+		texture.mapping = mapping;
+		texture.mapping_size = (size_t)st.st_size;
+
+		if (!parse(source_path, content, texture) || !supported(texture.format)) {
+			texture_cache::close(texture);
+			return false;
+		}
+		return true;
+	}
+
+	void write_cache(const std::string& source_path,
+	                 texture_2d::content_t content,
+	                 const texture_cache::texture_t& texture) {
+		auto source = cache_file::source_info_t{};
+		if (!cache_file::stat_source(source_path, source)
+		    || !cache_file::hash_source(source_path, source.hash)) {
+			std::cerr << "texture_cache: not caching " << source_path << ", cannot read it"
+			          << std::endl;
+			return;
+		}
+
+		cache_file::write(cache_path(source_path), "texture_cache", [&](std::ofstream& out) {
+			auto header = header_t{CACHE_MAGIC,
+			                       CACHE_VERSION,
+			                       (uint32_t)content,
+			                       (uint32_t)texture.format,
+			                       (uint32_t)texture.levels.size(),
+			                       0,
+			                       source};
+			out.write((const char*)&header, sizeof(header));
+			// the blocks follow the level table, offsets are moved past it
+			auto table_end = sizeof(header) + texture.levels.size() * sizeof(texture_cache::level_t);
+			auto base = align16(table_end);
+			for (auto level : texture.levels) {
+				level.offset += base;
+				out.write((const char*)&level, sizeof(level));
+			}
+			const char zeros[16] = {};
+			out.write(zeros, (std::streamsize)(base - table_end));
+			out.write((const char*)texture.blocks.data(), (std::streamsize)texture.blocks.size());
+		});
+	}
+
+	// the image as floats to filter in: linear colour, normals in [-1, 1], heights in [0, 1]
+	std::vector<glm::vec4> to_linear(const texture_2d::image_t& image,
+	                                 texture_2d::content_t content) {
+		std::vector<glm::vec4> texels((size_t)image.width * (size_t)image.height);
+		auto n = (size_t)image.n_channels;
+		for (auto i = size_t{0}; i < texels.size(); ++i) {
+			const auto* p = &image.pixels[i * n];
+			// grey images fill every colour channel, alpha is opaque unless the image has one
+			auto texel = n >= 3 ? glm::vec4(p[0], p[1], p[2], n == 4 ? p[3] : 255)
+			                    : glm::vec4(p[0], p[0], p[0], n == 2 ? p[1] : 255);
+			texel /= 255.0f;
+			if (content == texture_2d::COLOR) {
+				texel = glm::vec4(glm::pow(glm::vec3(texel), glm::vec3(GAMMA)), texel.a);
+			}
+			else if (content == texture_2d::NORMAL) {
+				texel = glm::vec4(glm::vec3(texel) * 2.0f - 1.0f, 1.0f);
+			}
+			texels[i] = texel;
+		}
+		return texels;
+	}
+
+	// 2x2 box filter, the last row or column is reused for odd sizes
+	std::vector<glm::vec4> downsample(const std::vector<glm::vec4>& texels,
+	                                  uint32_t width,
+	                                  uint32_t height,
+	                                  texture_2d::content_t content) {
+		auto next_width = std::max(width / 2, 1u);
+		auto next_height = std::max(height / 2, 1u);
+		std::vector<glm::vec4> next((size_t)next_width * next_height);
+		for (uint32_t y = 0; y < next_height; ++y) {
+			auto y0 = std::min(y * 2, height - 1);
+			auto y1 = std::min(y * 2 + 1, height - 1);
+			for (uint32_t x = 0; x < next_width; ++x) {
+				auto x0 = std::min(x * 2, width - 1);
+				auto x1 = std::min(x * 2 + 1, width - 1);
+				auto sum = texels[(size_t)y0 * width + x0] + texels[(size_t)y0 * width + x1]
+				           + texels[(size_t)y1 * width + x0] + texels[(size_t)y1 * width + x1];
+				auto texel = sum * 0.25f;
+				if (content == texture_2d::NORMAL) {
+					auto length = glm::length(glm::vec3(texel));
+					texel = length > 0.0f ? glm::vec4(glm::vec3(texel) / length, 1.0f)
+					                      : glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+				}
+				next[(size_t)y * next_width + x] = texel;
+			}
+		}
+		return next;
+	}
+
+	uint8_t to_byte(float value) {
+		return (uint8_t)std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f);
+	}
+
+	// back to the 8-bit values the shaders expect to sample
+	std::vector<texel_t> quantise(const std::vector<glm::vec4>& texels,
+	                                  texture_2d::content_t content) {
+		std::vector<texel_t> pixels(texels.size());
+		for (auto i = size_t{0}; i < texels.size(); ++i) {
+			auto texel = texels[i];
+			if (content == texture_2d::COLOR) {
+				texel = glm::vec4(glm::pow(glm::vec3(texel), glm::vec3(1.0f / GAMMA)), texel.a);
+			}
+			else if (content == texture_2d::NORMAL) {
+				texel = glm::vec4(glm::vec3(texel) * 0.5f + 0.5f, 1.0f);
+			}
+			pixels[i] = {to_byte(texel.r), to_byte(texel.g), to_byte(texel.b), to_byte(texel.a)};
+		}
+		return pixels;
+	}
+
+	glm::vec3 rgb(const texel_t& texel) {
+		return glm::vec3(texel[0], texel[1], texel[2]);
+	}
+
+	uint16_t to_565(glm::vec3 colour) {
+		auto r = (uint16_t)std::lround(std::clamp(colour.r, 0.0f, 255.0f) * 31.0f / 255.0f);
+		auto g = (uint16_t)std::lround(std::clamp(colour.g, 0.0f, 255.0f) * 63.0f / 255.0f);
+		auto b = (uint16_t)std::lround(std::clamp(colour.b, 0.0f, 255.0f) * 31.0f / 255.0f);
+		return (uint16_t)(r << 11 | g << 5 | b);
+	}
+
+	glm::vec3 from_565(uint16_t packed) {
+		auto r = (uint32_t)(packed >> 11) & 31u;
+		auto g = (uint32_t)(packed >> 5) & 63u;
+		auto b = (uint32_t)packed & 31u;
+		// replicate the top bits into the bottom ones, as the hardware expands them
+		return glm::vec3(
+		   (float)(r << 3 | r >> 2), (float)(g << 2 | g >> 4), (float)(b << 3 | b >> 2));
+	}
+
+	void put16(unsigned char* out, uint16_t value) {
+		out[0] = (unsigned char)(value & 0xff);
+		out[1] = (unsigned char)(value >> 8);
+	}
+
+	// a BC1 colour block: endpoints at the ends of the colours' principal axis, pulled in a
+	// little, and the nearest of the four palette entries for each texel
+	void encode_colour_block(const texel_t (&block)[16], unsigned char* out) {
+		auto mean = glm::vec3(0.0f);
+		for (const auto& texel : block) {
+			mean += rgb(texel) / 16.0f;
+		}
+		auto covariance = glm::mat3(0.0f);
+		for (const auto& texel : block) {
+			auto d = rgb(texel) - mean;
+			covariance += glm::outerProduct(d, d);
+		}
+		// power iteration from the column of the channel that varies most, which cannot be
+		// orthogonal to the axis unless the block is flat
+		auto widest = 0;
+		for (int i = 1; i < 3; ++i) {
+			widest = covariance[i][i] > covariance[widest][widest] ? i : widest;
+		}
+		auto axis = covariance[widest];
+		for (int i = 0; i < 4; ++i) {
+			axis = covariance * axis;
+			auto length = glm::length(axis);
+			axis = length > 1e-6f ? axis / length : glm::vec3(0.0f);
+		}
+		auto low = 0.0f;
+		auto high = 0.0f;
+		for (const auto& texel : block) {
+			auto t = glm::dot(rgb(texel) - mean, axis);
+			low = std::min(low, t);
+			high = std::max(high, t);
+		}
+		auto inset = (high - low) / 16.0f;
+		auto c0 = to_565(mean + axis * (high - inset));
+		auto c1 = to_565(mean + axis * (low + inset));
+		// c0 > c1 selects the four colour palette, equal endpoints need only index 0
+		if (c0 < c1) {
+			std::swap(c0, c1);
+		}
+		put16(out, c0);
+		put16(out + 2, c1);
+
+		uint32_t indices = 0;
+		if (c0 != c1) {
+			auto e0 = from_565(c0);
+			auto e1 = from_565(c1);
+			const glm::vec3 palette[4] = {e0, e1, (2.0f * e0 + e1) / 3.0f, (e0 + 2.0f * e1) / 3.0f};
+			for (uint32_t i = 0; i < 16; ++i) {
+				uint32_t best = 0;
+				auto best_distance = INFINITY;
+				for (uint32_t j = 0; j < 4; ++j) {
+					auto d = rgb(block[i]) - palette[j];
+					auto distance = glm::dot(d, d);
+					if (distance < best_distance) {
+						best_distance = distance;
+						best = j;
+					}
+				}
+				indices |= best << (2 * i);
+			}
+		}
+		for (int i = 0; i < 4; ++i) {
+			out[4 + i] = (unsigned char)(indices >> (8 * i));
+		}
+	}
+
+	// a BC4 block of one channel: its range as the endpoints, in the eight value mode
+	void encode_channel_block(const texel_t (&block)[16], size_t channel, unsigned char* out) {
+		uint8_t high = 0;
+		uint8_t low = 255;
+		for (const auto& texel : block) {
+			high = std::max(high, texel[channel]);
+			low = std::min(low, texel[channel]);
+		}
+		out[0] = high;
+		out[1] = low;
+
+		uint64_t indices = 0;
+		if (high != low) {
+			float palette[8] = {(float)high, (float)low};
+			for (int i = 1; i <= 6; ++i) {
+				palette[i + 1] = ((float)(7 - i) * (float)high + (float)i * (float)low) / 7.0f;
+			}
+			for (uint32_t i = 0; i < 16; ++i) {
+				uint64_t best = 0;
+				auto best_distance = INFINITY;
+				for (uint64_t j = 0; j < 8; ++j) {
+					auto distance = std::abs((float)block[i][channel] - palette[j]);
+					if (distance < best_distance) {
+						best_distance = distance;
+						best = j;
+					}
+				}
+				indices |= best << (3 * i);
+			}
+		}
+		for (int i = 0; i < 6; ++i) {
+			out[2 + i] = (unsigned char)(indices >> (8 * i));
+		}
+	}
+
+	// append the blocks of one level, edge texels are repeated to fill partial blocks
+	void compress(const std::vector<texel_t>& pixels,
+	              uint32_t width,
+	              uint32_t height,
+	              texture_cache::format_t format,
+	              std::vector<unsigned char>& blocks) {
+		auto size = block_size(format);
+		for (uint32_t by = 0; by < (height + 3) / 4; ++by) {
+			for (uint32_t bx = 0; bx < (width + 3) / 4; ++bx) {
+				texel_t block[16];
+				for (uint32_t i = 0; i < 16; ++i) {
+					auto x = std::min(bx * 4 + i % 4, width - 1);
+					auto y = std::min(by * 4 + i / 4, height - 1);
+					block[i] = pixels[(size_t)y * width + x];
+				}
+				auto offset = blocks.size();
+				blocks.resize(offset + size);
+				auto out = &blocks[offset];
+				switch (format) {
+					case texture_cache::BC1:
+						encode_colour_block(block, out);
+						break;
+					case texture_cache::BC3:
+						encode_channel_block(block, 3, out);
+						encode_colour_block(block, out + 8);
+						break;
+					case texture_cache::BC4:
+						encode_channel_block(block, 0, out);
+						break;
+					case texture_cache::BC5:
+						encode_channel_block(block, 0, out);
+						encode_channel_block(block, 1, out + 8);
+						break;
+				}
+			}
+		}
+	}
+
+	texture_cache::format_t choose_format(const texture_2d::image_t& image,
+	                                      texture_2d::content_t content) {
+		switch (content) {
+			case texture_2d::NORMAL:
+				return texture_cache::BC5;
+			case texture_2d::HEIGHT:
+				return texture_cache::BC4;
+			case texture_2d::COLOR:
+				break;
+		}
+		if (image.n_channels == 2 || image.n_channels == 4) {
+			auto n = (size_t)image.n_channels;
+			for (auto i = n - 1; i < image.pixels.size(); i += n) {
+				if (image.pixels[i] != 255) {
+					return texture_cache::BC3;
+				}
+			}
+		}
+		return texture_cache::BC1;
+	}
+} // namespace
+
+namespace texture_cache {
+	const unsigned char* texture_t::data() const {
+		return mapping ? (const unsigned char*)mapping : blocks.data();
+	}
+
+	GLenum internal_format(format_t format) {
+		switch (format) {
+			case BC1:
+				return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+			case BC3:
+				return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			case BC4:
+				return GL_COMPRESSED_RED_RGTC1;
+			case BC5:
+				return GL_COMPRESSED_RG_RGTC2;
+		}
+		return 0;
+	}
+
+	void init() {
+		GLint n_extensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &n_extensions);
+		auto found = false;
+		for (GLint i = 0; i < n_extensions; ++i) {
+			auto name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+			if (name && std::string(name) == "GL_EXT_texture_compression_s3tc") {
+				found = true;
+			}
+		}
+		s3tc = found;
+	}
+
+	bool load(const std::string& source_path,
+	          texture_2d::content_t content,
+	          texture_t& texture,
+	          texture_2d::image_t& image) {
+		if (map_cache(source_path, content, texture)) {
+			return true;
+		}
+		image = texture_2d::decode(source_path);
+		if (!encode(image, content, texture)) {
+			return false;
+		}
+		write_cache(source_path, content, texture);
+		image = texture_2d::image_t{};
+		return true;
+	}
+
+	bool encode(const texture_2d::image_t& image,
+	            texture_2d::content_t content,
+	            texture_t& texture) {
+		texture = texture_t{};
+		texture.format = choose_format(image, content);
+		if (!supported(texture.format) || image.width <= 0 || image.height <= 0) {
+			return false;
+		}
+
+		auto width = (uint32_t)image.width;
+		auto height = (uint32_t)image.height;
+		auto texels = to_linear(image, content);
+		while (true) {
+			auto offset = texture.blocks.size();
+			compress(quantise(texels, content), width, height, texture.format, texture.blocks);
+			texture.levels.push_back({width, height, offset, texture.blocks.size() - offset});
+			if (width == 1 && height == 1) {
+				break;
+			}
+			texels = downsample(texels, width, height, content);
+			width = std::max(width / 2, 1u);
+			height = std::max(height / 2, 1u);
+		}
+		return true;
+	}
+
+	size_t upload(GLuint tex, const texture_t& texture, texture_2d::params_t const& params) {
+		// the levels come from client memory, not a pixel buffer
+		gl_state::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		gl_state::bind_texture(0, GL_TEXTURE_2D, tex);
+
+		auto n_levels = texture_2d::uses_mipmaps(params) ? texture.levels.size() : size_t{1};
+		auto format = internal_format(texture.format);
+		size_t bytes = 0;
+		for (auto i = size_t{0}; i < n_levels; ++i) {
+			const auto& level = texture.levels[i];
+			glCompressedTexImage2D(GL_TEXTURE_2D,
+			                       (GLint)i,
+			                       format,
+			                       (GLsizei)level.width,
+			                       (GLsizei)level.height,
+			                       0,
+			                       (GLsizei)level.size,
+			                       texture.data() + level.offset);
+			bytes += (size_t)level.size;
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)n_levels - 1);
+		texture_2d::set_params(params);
+		return bytes;
+	}
+
+	void close(texture_t& texture) {
+		if (texture.mapping) {
+			munmap(texture.mapping, texture.mapping_size);
+		}
+		texture = texture_t{};
+	}
+} // namespace texture_cache
@@ -0,0 +1,333 @@
+#include "ass3/texture_streamer.hpp"
+#include "ass3/gl_state.hpp"
+#include "ass3/profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+	using texture_streamer::entry_t;
+	using texture_streamer::load_t;
+	using texture_streamer::streamer_t;
+
+	// the levels are copied out of the cache's mapping here, so the page faults that read them
+	// from disk happen off the GL thread
+	void streamer_main(streamer_t& streamer) {
+		while (true) {
+			auto load = load_t{};
+			{
+				std::unique_lock<std::mutex> lock(streamer.mutex);
+				streamer.wake.wait(
+				   lock, [&streamer] { return streamer.stopping || !streamer.loads.empty(); });
+				if (streamer.stopping) {
+					return;
+				}
+				load = std::move(streamer.loads.front());
+				streamer.loads.pop_front();
+			}
+			{
+				PROFILE_ZONE("stream texture levels");
+				for (const auto& level : load.levels) {
+					auto begin = load.source + level.offset;
+					load.blocks.insert(load.blocks.end(), begin, begin + level.size);
+				}
+			}
+			std::lock_guard<std::mutex> lock(streamer.mutex);
+			streamer.finished.push_back(std::move(load));
+		}
+	}
+
+	size_t level_bytes(const entry_t& entry, size_t first, size_t end) {
+		size_t bytes = 0;
+		for (auto i = first; i < end; ++i) {
+			bytes += (size_t)entry.cache.levels[i].size;
+		}
+		return bytes;
+	}
+
+	// the level a texture has to keep: what it asked for this frame, or only the permanent ones
+	// when it was not drawn
+	size_t keep_level(const streamer_t& streamer, const entry_t& entry) {
+		return entry.last_used == streamer.frame ? entry.wanted : entry.tail;
+	}
+
+	bool evictable(const streamer_t& streamer, const entry_t& entry) {
+		// a load in flight fills the levels above resident, which have to stay
+		return !entry.loading && entry.resident < keep_level(streamer, entry);
+	}
+
+	// specify one level of the texture bound to unit 0
+	void upload_level(const entry_t& entry, size_t i, const unsigned char* blocks) {
+		const auto& level = entry.cache.levels[i];
+		glCompressedTexImage2D(GL_TEXTURE_2D,
+		                       (GLint)i,
+		                       texture_cache::internal_format(entry.cache.format),
+		                       (GLsizei)level.width,
+		                       (GLsizei)level.height,
+		                       0,
+		                       (GLsizei)level.size,
+		                       blocks);
+	}
+
+	// drop the levels finer than level. They are specified again as empty so the driver can free
+	// their storage, the base level keeps them out of sampling either way. Returns the bytes freed
+	size_t evict(streamer_t& streamer, GLuint tex, entry_t& entry, size_t level) {
+		gl_state::bind_texture(0, GL_TEXTURE_2D, tex);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)level);
+		auto format = texture_cache::internal_format(entry.cache.format);
+		for (auto i = entry.resident; i < level; ++i) {
+			glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, format, 0, 0, 0, 0, nullptr);
+		}
+		auto bytes = level_bytes(entry, entry.resident, level);
+		entry.resident = level;
+		streamer.stats.resident_bytes -= bytes;
+		streamer.stats.evicted_bytes += bytes;
+		++streamer.stats.evictions;
+		return bytes;
+	}
+
+	size_t freeable(const streamer_t& streamer) {
+		size_t bytes = 0;
+		for (const auto& [tex, entry] : streamer.entries) {
+			if (evictable(streamer, entry)) {
+				bytes += level_bytes(entry, entry.resident, keep_level(streamer, entry));
+			}
+		}
+		return bytes;
+	}
+
+	size_t used(const streamer_t& streamer) {
+		return streamer.stats.resident_bytes + streamer.reserved;
+	}
+
+	// evict the least recently used textures until bytes more fit in the budget, which the caller
+	// has checked they can. Returns the bytes evicted
+	size_t make_room(streamer_t& streamer, size_t bytes) {
+		if (used(streamer) + bytes <= streamer.budget) {
+			return 0;
+		}
+		std::vector<std::pair<uint64_t, GLuint>> candidates;
+		for (const auto& [tex, entry] : streamer.entries) {
+			if (evictable(streamer, entry)) {
+				candidates.emplace_back(entry.last_used, tex);
+			}
+		}
+		std::sort(candidates.begin(), candidates.end());
+		size_t evicted = 0;
+		for (auto [last_used, tex] : candidates) {
+			if (used(streamer) + bytes <= streamer.budget) {
+				break;
+			}
+			auto& entry = streamer.entries[tex];
+			evicted += evict(streamer, tex, entry, keep_level(streamer, entry));
+		}
+		return evicted;
+	}
+
+	// queue the finest levels this frame's requests need that fit in the budget, coarser ones
+	// when the finest do not. Returns the bytes evicted to make room
+	size_t start_load(streamer_t& streamer, GLuint tex, entry_t& entry, size_t room) {
+		auto first = entry.wanted;
+		while (first < entry.resident && level_bytes(entry, first, entry.resident) > room) {
+			++first;
+		}
+		if (first == entry.resident) {
+			return 0;
+		}
+		auto bytes = level_bytes(entry, first, entry.resident);
+		auto evicted = make_room(streamer, bytes);
+
+		auto load = load_t{};
+		load.texture = tex;
+		load.id = entry.id;
+		load.first = first;
+		load.levels.assign(entry.cache.levels.begin() + (std::ptrdiff_t)first,
+		                   entry.cache.levels.begin() + (std::ptrdiff_t)entry.resident);
+		load.source = entry.cache.data();
+		load.blocks.reserve(bytes);
+		entry.loading = true;
+		streamer.reserved += bytes;
+		{
+			std::lock_guard<std::mutex> lock(streamer.mutex);
+			streamer.loads.push_back(std::move(load));
+		}
+		streamer.wake.notify_one();
+		return evicted;
+	}
+
+	// upload a finished load and show its levels
+	size_t finish(streamer_t& streamer, load_t& load) {
+		auto bytes = load.blocks.size();
+		streamer.reserved -= bytes;
+		auto found = streamer.entries.find(load.texture);
+		if (found == streamer.entries.end() || found->second.id != load.id) {
+			// removed while it loaded, nothing reads its cache any more
+			auto retired =
+			   std::find_if(streamer.retired.begin(),
+			                streamer.retired.end(),
+			                [&load](const entry_t& entry) { return entry.id == load.id; });
+			if (retired != streamer.retired.end()) {
+				texture_cache::close(retired->cache);
+				streamer.retired.erase(retired);
+			}
+			return 0;
+		}
+
+		auto& entry = found->second;
+		gl_state::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		gl_state::bind_texture(0, GL_TEXTURE_2D, load.texture);
+		auto blocks = load.blocks.data();
+		for (auto i = size_t{0}; i < load.levels.size(); ++i) {
+			upload_level(entry, load.first + i, blocks);
+			blocks += load.levels[i].size;
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)load.first);
+		entry.resident = load.first;
+		entry.loading = false;
+		streamer.stats.resident_bytes += bytes;
+		streamer.stats.loaded_bytes += bytes;
+		return bytes;
+	}
+} // namespace
+
+namespace texture_streamer {
+	void init(streamer_t& streamer, size_t budget, size_t upload_budget) {
+		streamer.budget = budget;
+		streamer.upload_budget = upload_budget;
+		streamer.thread = std::thread(streamer_main, std::ref(streamer));
+	}
+
+	void destroy(streamer_t& streamer) {
+		{
+			std::lock_guard<std::mutex> lock(streamer.mutex);
+			streamer.stopping = true;
+		}
+		streamer.wake.notify_all();
+		if (streamer.thread.joinable()) {
+			streamer.thread.join();
+		}
+		streamer.loads.clear();
+		streamer.finished.clear();
+		for (auto& [tex, entry] : streamer.entries) {
+			texture_cache::close(entry.cache);
+		}
+		for (auto& entry : streamer.retired) {
+			texture_cache::close(entry.cache);
+		}
+		streamer.entries.clear();
+		streamer.retired.clear();
+		streamer.reserved = 0;
+	}
+
+	size_t add(streamer_t& streamer,
+	           GLuint tex,
+	           texture_cache::texture_t& texture,
+	           texture_2d::params_t const& params) {
+		auto n_levels = texture.levels.size();
+		auto tail = size_t{0};
+		while (tail + 1 < n_levels) {
+			const auto& level = texture.levels[tail];
+			if (std::max(level.width, level.height) <= RESIDENT_SIZE) {
+				break;
+			}
+			++tail;
+		}
+		if (!texture_2d::uses_mipmaps(params) || tail == 0) {
+			auto bytes = texture_cache::upload(tex, texture, params);
+			texture_cache::close(texture);
+			return bytes;
+		}
+
+		auto& entry = streamer.entries[tex];
+		entry.id = streamer.next_id++;
+		entry.cache = std::move(texture);
+		entry.tail = tail;
+		entry.resident = tail;
+		entry.wanted = tail;
+		texture = texture_cache::texture_t{};
+
+		// the levels are specified coarsest first, GL does not mind the finer ones missing while
+		// the base level hides them
+		gl_state::bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		gl_state::bind_texture(0, GL_TEXTURE_2D, tex);
+		for (auto i = tail; i < n_levels; ++i) {
+			upload_level(entry, i, entry.cache.data() + entry.cache.levels[i].offset);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)tail);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)n_levels - 1);
+		texture_2d::set_params(params);
+
+		auto bytes = level_bytes(entry, tail, n_levels);
+		streamer.stats.resident_bytes += bytes;
+		return bytes;
+	}
+
+	void request(streamer_t& streamer, GLuint tex, float uv_per_pixel) {
+		auto found = streamer.entries.find(tex);
+		if (found == streamer.entries.end()) {
+			return;
+		}
+		auto& entry = found->second;
+		if (entry.last_used != streamer.frame) {
+			entry.last_used = streamer.frame;
+			entry.wanted = entry.tail;
+		}
+		// texels of level 0 a pixel covers, each level halves them
+		const auto& top = entry.cache.levels[0];
+		auto texels = uv_per_pixel * (float)std::max(top.width, top.height);
+		auto level = texels > 1.0f ? std::floor(std::log2(texels)) : 0.0f;
+		if (level < (float)entry.wanted) {
+			entry.wanted = (size_t)level;
+		}
+	}
+
+	void update(streamer_t& streamer) {
+		PROFILE_ZONE("texture streaming");
+		size_t spent = 0;
+		while (true) {
+			auto load = load_t{};
+			{
+				std::lock_guard<std::mutex> lock(streamer.mutex);
+				if (streamer.finished.empty()
+				    || (spent > 0 && spent >= streamer.upload_budget)) {
+					break;
+				}
+				load = std::move(streamer.finished.front());
+				streamer.finished.pop_front();
+			}
+			spent += finish(streamer, load);
+		}
+
+		// only evictions change what can be freed, a texture starting a load was not evictable
+		auto can_free = freeable(streamer);
+		for (auto& [tex, entry] : streamer.entries) {
+			bool drawn = entry.last_used == streamer.frame;
+			if (!drawn || entry.loading || entry.wanted >= entry.resident) {
+				continue;
+			}
+			auto limit = streamer.budget + can_free;
+			auto room = limit > used(streamer) ? limit - used(streamer) : size_t{0};
+			can_free -= start_load(streamer, tex, entry, room);
+		}
+		++streamer.frame;
+	}
+
+	void remove(streamer_t& streamer, GLuint tex) {
+		auto found = streamer.entries.find(tex);
+		if (found == streamer.entries.end()) {
+			return;
+		}
+		auto& entry = found->second;
+		auto n_levels = entry.cache.levels.size();
+		streamer.stats.resident_bytes -= level_bytes(entry, entry.resident, n_levels);
+		if (entry.loading) {
+			// the thread may still be reading the cache, finish() closes it
+			streamer.retired.push_back(std::move(entry));
+		}
+		else {
+			texture_cache::close(entry.cache);
+		}
+		streamer.entries.erase(found);
+	}
+} // namespace texture_streamer